@@ -103,7 +103,7 @@ typedef struct
 	char struct_id[4];
 	/** The version number of this structure.  Must be 0 */
 	int struct_version;
-	/** Version of MQTT to be used.  3 = 3.1 4 = 3.1.1 */
+	/** Version of MQTT to be used.  3 = 3.1 4 = 3.1.1 5 = 5.0 (MQTTV5 builds only) */
 	unsigned char MQTTVersion;
 	MQTTString clientID;
 	unsigned short keepAliveInterval;
@@ -141,6 +141,13 @@ DLLExport int MQTTDeserialize_connect(MQTTPacket_connectData* data, unsigned cha
 DLLExport int MQTTSerialize_connack(unsigned char* buf, int buflen, unsigned char connack_rc, unsigned char sessionPresent);
 DLLExport int MQTTDeserialize_connack(unsigned char* sessionPresent, unsigned char* connack_rc, unsigned char* buf, int buflen);
 
+#if defined(MQTTV5)
+DLLExport int MQTTV5Serialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData* options,
+		MQTTProperties* connectProperties, MQTTProperties* willProperties);
+DLLExport int MQTTV5Deserialize_connack(MQTTProperties* connackProperties, unsigned char* sessionPresent,
+		unsigned char* connack_rc, unsigned char* buf, int buflen);
+#endif
+
 DLLExport int MQTTSerialize_disconnect(unsigned char* buf, int buflen);
 DLLExport int MQTTSerialize_pingreq(unsigned char* buf, int buflen);
 
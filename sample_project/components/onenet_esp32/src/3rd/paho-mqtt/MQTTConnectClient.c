@@ -24,7 +24,11 @@
   * @param options the options to be used to build the connect packet
   * @return the length of buffer needed to contain the serialized version of the packet
   */
+#if defined(MQTTV5)
+int MQTTV5Serialize_connectLength(MQTTPacket_connectData* options, MQTTProperties* connectProperties, MQTTProperties* willProperties)
+#else
 int MQTTSerialize_connectLength(MQTTPacket_connectData* options)
+#endif
 {
 	int len = 0;
 
@@ -32,12 +36,20 @@ int MQTTSerialize_connectLength(MQTTPacket_connectData* options)
 
 	if (options->MQTTVersion == 3)
 		len = 12; /* variable depending on MQTT or MQIsdp */
-	else if (options->MQTTVersion == 4)
+	else if (options->MQTTVersion >= 4)
 		len = 10;
 
 	len += MQTTstrlen(options->clientID)+2;
 	if (options->willFlag)
 		len += MQTTstrlen(options->will.topicName)+2 + MQTTstrlen(options->will.message)+2;
+#if defined(MQTTV5)
+	if (options->MQTTVersion == 5)
+	{
+		len += MQTTProperties_len(connectProperties);
+		if (options->willFlag)
+			len += MQTTProperties_len(willProperties);
+	}
+#endif
 	if (options->username.cstring || options->username.lenstring.data)
 		len += MQTTstrlen(options->username)+2;
 	if (options->password.cstring || options->password.lenstring.data)
@@ -55,7 +67,27 @@ int MQTTSerialize_connectLength(MQTTPacket_connectData* options)
   * @param options the options to be used to build the connect packet
   * @return serialized length, or error if 0
   */
+#if defined(MQTTV5)
+int MQTTSerialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData* options)
+{
+	return MQTTV5Serialize_connect(buf, buflen, options, NULL, NULL);
+}
+
+
+/**
+  * Serializes the connect options into the buffer, with the MQTT 5.0 properties
+  * @param buf the buffer into which the packet will be serialized
+  * @param len the length in bytes of the supplied buffer
+  * @param options the options to be used to build the connect packet
+  * @param connectProperties the properties of the connect packet, NULL for none
+  * @param willProperties the properties of the will message, NULL for none
+  * @return serialized length, or error if 0
+  */
+int MQTTV5Serialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData* options,
+	MQTTProperties* connectProperties, MQTTProperties* willProperties)
+#else
 int MQTTSerialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData* options)
+#endif
 {
 	unsigned char *ptr = buf;
 	MQTTHeader header = {0};
@@ -64,7 +96,12 @@ int MQTTSerialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData
 	int rc = -1;
 
 	FUNC_ENTRY;
-	if (MQTTPacket_len(len = MQTTSerialize_connectLength(options)) > buflen)
+#if defined(MQTTV5)
+	len = MQTTV5Serialize_connectLength(options, connectProperties, willProperties);
+#else
+	len = MQTTSerialize_connectLength(options);
+#endif
+	if (MQTTPacket_len(len) > buflen)
 	{
 		rc = MQTTPACKET_BUFFER_TOO_SHORT;
 		goto exit;
@@ -76,10 +113,10 @@ int MQTTSerialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData
 
 	ptr += MQTTPacket_encode(ptr, len); /* write remaining length */
 
-	if (options->MQTTVersion == 4)
+	if (options->MQTTVersion >= 4)
 	{
 		writeCString(&ptr, "MQTT");
-		writeChar(&ptr, (char) 4);
+		writeChar(&ptr, (char) options->MQTTVersion);
 	}
 	else
 	{
@@ -103,9 +140,17 @@ int MQTTSerialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData
 
 	writeChar(&ptr, flags.all);
 	writeInt(&ptr, options->keepAliveInterval);
+#if defined(MQTTV5)
+	if (options->MQTTVersion == 5)
+		MQTTProperties_write(&ptr, connectProperties);
+#endif
 	writeMQTTString(&ptr, options->clientID);
 	if (options->willFlag)
 	{
+#if defined(MQTTV5)
+		if (options->MQTTVersion == 5)
+			MQTTProperties_write(&ptr, willProperties);
+#endif
 		writeMQTTString(&ptr, options->will.topicName);
 		writeMQTTString(&ptr, options->will.message);
 	}
@@ -129,7 +174,27 @@ int MQTTSerialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData
   * @param len the length in bytes of the data in the supplied buffer
   * @return error code.  1 is success, 0 is failure
   */
+#if defined(MQTTV5)
 int MQTTDeserialize_connack(unsigned char* sessionPresent, unsigned char* connack_rc, unsigned char* buf, int buflen)
+{
+	return MQTTV5Deserialize_connack(NULL, sessionPresent, connack_rc, buf, buflen);
+}
+
+
+/**
+  * Deserializes the supplied (wire) buffer into MQTT 5.0 connack data
+  * @param connackProperties the properties returned, NULL for an MQTT 3.1.1 connack
+  * @param sessionPresent the session present flag returned
+  * @param connack_rc returned integer value of the connack reason code
+  * @param buf the raw buffer data, of the correct length determined by the remaining length field
+  * @param len the length in bytes of the data in the supplied buffer
+  * @return error code.  1 is success, 0 is failure
+  */
+int MQTTV5Deserialize_connack(MQTTProperties* connackProperties, unsigned char* sessionPresent, unsigned char* connack_rc,
+	unsigned char* buf, int buflen)
+#else
+int MQTTDeserialize_connack(unsigned char* sessionPresent, unsigned char* connack_rc, unsigned char* buf, int buflen)
+#endif
 {
 	MQTTHeader header = {0};
 	unsigned char* curdata = buf;
@@ -152,6 +217,16 @@ int MQTTDeserialize_connack(unsigned char* sessionPresent, unsigned char* connac
 	*sessionPresent = flags.bits.sessionpresent;
 	*connack_rc = readChar(&curdata);
 
+#if defined(MQTTV5)
+	/* a refused connection may come back without any property */
+	if (connackProperties && curdata < enddata &&
+		!MQTTProperties_read(connackProperties, &curdata, enddata))
+	{
+		rc = 0;
+		goto exit;
+	}
+#endif
+
 	rc = 1;
 exit:
 	FUNC_EXIT_RC(rc);
@@ -0,0 +1,377 @@
+/*******************************************************************************
+ * Copyright (c) 2017, 2018 IBM Corp.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Ian Craggs - initial API and implementation and/or initial documentation
+ *******************************************************************************/
+
+#include "MQTTPacket.h"
+
+#if defined(MQTTV5)
+
+#include "StackTrace.h"
+
+#include <string.h>
+
+static struct nameToType
+{
+	enum MQTTPropertyCodes name;
+	enum MQTTPropertyTypes type;
+} namesToTypes[] =
+{
+	{MQTTPROPERTY_CODE_PAYLOAD_FORMAT_INDICATOR, MQTTPROPERTY_TYPE_BYTE},
+	{MQTTPROPERTY_CODE_MESSAGE_EXPIRY_INTERVAL, MQTTPROPERTY_TYPE_FOUR_BYTE_INTEGER},
+	{MQTTPROPERTY_CODE_CONTENT_TYPE, MQTTPROPERTY_TYPE_UTF_8_ENCODED_STRING},
+	{MQTTPROPERTY_CODE_RESPONSE_TOPIC, MQTTPROPERTY_TYPE_UTF_8_ENCODED_STRING},
+	{MQTTPROPERTY_CODE_CORRELATION_DATA, MQTTPROPERTY_TYPE_BINARY_DATA},
+	{MQTTPROPERTY_CODE_SUBSCRIPTION_IDENTIFIER, MQTTPROPERTY_TYPE_VARIABLE_BYTE_INTEGER},
+	{MQTTPROPERTY_CODE_SESSION_EXPIRY_INTERVAL, MQTTPROPERTY_TYPE_FOUR_BYTE_INTEGER},
+	{MQTTPROPERTY_CODE_ASSIGNED_CLIENT_IDENTIFER, MQTTPROPERTY_TYPE_UTF_8_ENCODED_STRING},
+	{MQTTPROPERTY_CODE_SERVER_KEEP_ALIVE, MQTTPROPERTY_TYPE_TWO_BYTE_INTEGER},
+	{MQTTPROPERTY_CODE_AUTHENTICATION_METHOD, MQTTPROPERTY_TYPE_UTF_8_ENCODED_STRING},
+	{MQTTPROPERTY_CODE_AUTHENTICATION_DATA, MQTTPROPERTY_TYPE_BINARY_DATA},
+	{MQTTPROPERTY_CODE_REQUEST_PROBLEM_INFORMATION, MQTTPROPERTY_TYPE_BYTE},
+	{MQTTPROPERTY_CODE_WILL_DELAY_INTERVAL, MQTTPROPERTY_TYPE_FOUR_BYTE_INTEGER},
+	{MQTTPROPERTY_CODE_REQUEST_RESPONSE_INFORMATION, MQTTPROPERTY_TYPE_BYTE},
+	{MQTTPROPERTY_CODE_RESPONSE_INFORMATION, MQTTPROPERTY_TYPE_UTF_8_ENCODED_STRING},
+	{MQTTPROPERTY_CODE_SERVER_REFERENCE, MQTTPROPERTY_TYPE_UTF_8_ENCODED_STRING},
+	{MQTTPROPERTY_CODE_REASON_STRING, MQTTPROPERTY_TYPE_UTF_8_ENCODED_STRING},
+	{MQTTPROPERTY_CODE_RECEIVE_MAXIMUM, MQTTPROPERTY_TYPE_TWO_BYTE_INTEGER},
+	{MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM, MQTTPROPERTY_TYPE_TWO_BYTE_INTEGER},
+	{MQTTPROPERTY_CODE_TOPIC_ALIAS, MQTTPROPERTY_TYPE_TWO_BYTE_INTEGER},
+	{MQTTPROPERTY_CODE_MAXIMUM_QOS, MQTTPROPERTY_TYPE_BYTE},
+	{MQTTPROPERTY_CODE_RETAIN_AVAILABLE, MQTTPROPERTY_TYPE_BYTE},
+	{MQTTPROPERTY_CODE_USER_PROPERTY, MQTTPROPERTY_TYPE_UTF_8_STRING_PAIR},
+	{MQTTPROPERTY_CODE_MAXIMUM_PACKET_SIZE, MQTTPROPERTY_TYPE_FOUR_BYTE_INTEGER},
+	{MQTTPROPERTY_CODE_WILDCARD_SUBSCRIPTION_AVAILABLE, MQTTPROPERTY_TYPE_BYTE},
+	{MQTTPROPERTY_CODE_SUBSCRIPTION_IDENTIFIERS_AVAILABLE, MQTTPROPERTY_TYPE_BYTE},
+	{MQTTPROPERTY_CODE_SHARED_SUBSCRIPTION_AVAILABLE, MQTTPROPERTY_TYPE_BYTE}
+};
+
+
+int MQTTProperty_getType(enum MQTTPropertyCodes value)
+{
+	int i, rc = MQTT_INVALID_PROPERTY_ID;
+
+	for (i = 0; i < (int)(sizeof(namesToTypes) / sizeof(namesToTypes[0])); ++i)
+	{
+		if (namesToTypes[i].name == value)
+		{
+			rc = namesToTypes[i].type;
+			break;
+		}
+	}
+	return rc;
+}
+
+
+/**
+ * Number of bytes a value takes when written as a variable byte integer
+ */
+static int MQTTPacket_VBIlen(int rem_len)
+{
+	int rc = 0;
+
+	if (rem_len < 128)
+		rc = 1;
+	else if (rem_len < 16384)
+		rc = 2;
+	else if (rem_len < 2097152)
+		rc = 3;
+	else
+		rc = 4;
+	return rc;
+}
+
+
+/**
+ * Reads a variable byte integer, refusing to run past enddata
+ * @return 1 if the value was read, 0 otherwise
+ */
+static int MQTTPacket_readVBI(unsigned char** pptr, unsigned char* enddata, int* value)
+{
+	int multiplier = 1;
+	int len = 0;
+	unsigned char c;
+
+	*value = 0;
+	do
+	{
+		if (*pptr >= enddata || ++len > 4)
+			return 0;
+		c = readChar(pptr);
+		*value += (c & 127) * multiplier;
+		multiplier *= 128;
+	} while ((c & 128) != 0);
+	return 1;
+}
+
+
+static unsigned int readInt4(unsigned char** pptr)
+{
+	unsigned char* ptr = *pptr;
+	unsigned int value = ((unsigned int)ptr[0] << 24) + ((unsigned int)ptr[1] << 16) + ((unsigned int)ptr[2] << 8) + ptr[3];
+
+	*pptr += 4;
+	return value;
+}
+
+
+static void writeInt4(unsigned char** pptr, unsigned int anInt)
+{
+	**pptr = (unsigned char)(anInt >> 24);
+	(*pptr)++;
+	**pptr = (unsigned char)(anInt >> 16);
+	(*pptr)++;
+	**pptr = (unsigned char)(anInt >> 8);
+	(*pptr)++;
+	**pptr = (unsigned char)anInt;
+	(*pptr)++;
+}
+
+
+static void writeLenString(unsigned char** pptr, const MQTTLenString* lenstring)
+{
+	writeInt(pptr, lenstring->len);
+	memcpy(*pptr, lenstring->data, lenstring->len);
+	*pptr += lenstring->len;
+}
+
+
+static int readLenString(MQTTLenString* lenstring, unsigned char** pptr, unsigned char* enddata)
+{
+	MQTTString mqttstring = MQTTString_initializer;
+	int rc = readMQTTLenString(&mqttstring, pptr, enddata);
+
+	if (rc == 1)
+		*lenstring = mqttstring.lenstring;
+	return rc;
+}
+
+
+/**
+ * Serialized length of one property, identifier included
+ * @return the length, or -1 for an unknown identifier
+ */
+static int MQTTProperty_len(const MQTTProperty* prop)
+{
+	int len = 0;
+
+	switch (MQTTProperty_getType(prop->identifier))
+	{
+		case MQTTPROPERTY_TYPE_BYTE:
+			len = 1;
+			break;
+		case MQTTPROPERTY_TYPE_TWO_BYTE_INTEGER:
+			len = 2;
+			break;
+		case MQTTPROPERTY_TYPE_FOUR_BYTE_INTEGER:
+			len = 4;
+			break;
+		case MQTTPROPERTY_TYPE_VARIABLE_BYTE_INTEGER:
+			len = MQTTPacket_VBIlen(prop->value.integer4);
+			break;
+		case MQTTPROPERTY_TYPE_BINARY_DATA:
+		case MQTTPROPERTY_TYPE_UTF_8_ENCODED_STRING:
+			len = 2 + prop->value.data.len;
+			break;
+		case MQTTPROPERTY_TYPE_UTF_8_STRING_PAIR:
+			len = 2 + prop->value.data.len + 2 + prop->value.value.len;
+			break;
+		default:
+			return -1;
+	}
+	return len + MQTTPacket_VBIlen(prop->identifier);
+}
+
+
+int MQTTProperties_len(MQTTProperties* props)
+{
+	/* properties length is an mbi */
+	return (props == NULL) ? 1 : props->length + MQTTPacket_VBIlen(props->length);
+}
+
+
+int MQTTProperties_add(MQTTProperties* props, const MQTTProperty* prop)
+{
+	int rc = -1, len = 0;
+
+	FUNC_ENTRY;
+	if (props->count == props->max_count || (len = MQTTProperty_len(prop)) < 0)
+		goto exit;
+
+	props->array[props->count++] = *prop;
+	props->length += len;
+	rc = 0;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+int MQTTProperties_write(unsigned char** pptr, const MQTTProperties* properties)
+{
+	unsigned char* start = *pptr;
+	int rc = -1;
+	int i = 0;
+
+	FUNC_ENTRY;
+	if (properties == NULL)
+	{
+		writeChar(pptr, 0);
+		rc = 1;
+		goto exit;
+	}
+
+	*pptr += MQTTPacket_encode(*pptr, properties->length);
+	for (i = 0; i < properties->count; ++i)
+	{
+		const MQTTProperty* prop = &properties->array[i];
+
+		*pptr += MQTTPacket_encode(*pptr, prop->identifier);
+		switch (MQTTProperty_getType(prop->identifier))
+		{
+			case MQTTPROPERTY_TYPE_BYTE:
+				writeChar(pptr, prop->value.byte);
+				break;
+			case MQTTPROPERTY_TYPE_TWO_BYTE_INTEGER:
+				writeInt(pptr, prop->value.integer2);
+				break;
+			case MQTTPROPERTY_TYPE_FOUR_BYTE_INTEGER:
+				writeInt4(pptr, prop->value.integer4);
+				break;
+			case MQTTPROPERTY_TYPE_VARIABLE_BYTE_INTEGER:
+				*pptr += MQTTPacket_encode(*pptr, prop->value.integer4);
+				break;
+			case MQTTPROPERTY_TYPE_BINARY_DATA:
+			case MQTTPROPERTY_TYPE_UTF_8_ENCODED_STRING:
+				writeLenString(pptr, &prop->value.data);
+				break;
+			case MQTTPROPERTY_TYPE_UTF_8_STRING_PAIR:
+				writeLenString(pptr, &prop->value.data);
+				writeLenString(pptr, &prop->value.value);
+				break;
+			default:
+				goto exit;
+		}
+	}
+	rc = *pptr - start;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+int MQTTProperties_read(MQTTProperties* properties, unsigned char** pptr, unsigned char* enddata)
+{
+	unsigned char* curdata = *pptr;
+	unsigned char* propend = NULL;
+	int remlength = 0;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (!MQTTPacket_readVBI(&curdata, enddata, &remlength) || enddata - curdata < remlength)
+		goto exit;
+	propend = curdata + remlength;
+
+	if (properties)
+	{
+		properties->count = 0;
+		properties->length = remlength;
+	}
+
+	while (curdata < propend)
+	{
+		MQTTProperty prop;
+		int value = 0;
+
+		memset(&prop, 0, sizeof(prop));
+		if (!MQTTPacket_readVBI(&curdata, propend, &value))
+			goto exit;
+		prop.identifier = (enum MQTTPropertyCodes)value;
+
+		switch (MQTTProperty_getType(prop.identifier))
+		{
+			case MQTTPROPERTY_TYPE_BYTE:
+				if (propend - curdata < 1)
+					goto exit;
+				prop.value.byte = readChar(&curdata);
+				break;
+			case MQTTPROPERTY_TYPE_TWO_BYTE_INTEGER:
+				if (propend - curdata < 2)
+					goto exit;
+				prop.value.integer2 = (unsigned short)readInt(&curdata);
+				break;
+			case MQTTPROPERTY_TYPE_FOUR_BYTE_INTEGER:
+				if (propend - curdata < 4)
+					goto exit;
+				prop.value.integer4 = readInt4(&curdata);
+				break;
+			case MQTTPROPERTY_TYPE_VARIABLE_BYTE_INTEGER:
+				if (!MQTTPacket_readVBI(&curdata, propend, &value))
+					goto exit;
+				prop.value.integer4 = value;
+				break;
+			case MQTTPROPERTY_TYPE_BINARY_DATA:
+			case MQTTPROPERTY_TYPE_UTF_8_ENCODED_STRING:
+				if (!readLenString(&prop.value.data, &curdata, propend))
+					goto exit;
+				break;
+			case MQTTPROPERTY_TYPE_UTF_8_STRING_PAIR:
+				if (!readLenString(&prop.value.data, &curdata, propend) ||
+					!readLenString(&prop.value.value, &curdata, propend))
+					goto exit;
+				break;
+			default:
+				goto exit; /* unknown property, the rest of the packet can't be trusted */
+		}
+
+		if (properties && properties->count < properties->max_count)
+			properties->array[properties->count++] = prop;
+	}
+
+	*pptr = curdata;
+	rc = 1;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+int MQTTProperties_getNumericValue(MQTTProperties* props, enum MQTTPropertyCodes propid)
+{
+	int i = 0;
+
+	for (i = 0; props && i < props->count; ++i)
+	{
+		MQTTProperty* prop = &props->array[i];
+
+		if (prop->identifier != propid)
+			continue;
+
+		switch (MQTTProperty_getType(propid))
+		{
+			case MQTTPROPERTY_TYPE_BYTE:
+				return prop->value.byte;
+			case MQTTPROPERTY_TYPE_TWO_BYTE_INTEGER:
+				return prop->value.integer2;
+			case MQTTPROPERTY_TYPE_FOUR_BYTE_INTEGER:
+			case MQTTPROPERTY_TYPE_VARIABLE_BYTE_INTEGER:
+				return prop->value.integer4;
+			default:
+				return -9999999;
+		}
+	}
+	return -9999999;
+}
+
+#endif /* MQTTV5 */
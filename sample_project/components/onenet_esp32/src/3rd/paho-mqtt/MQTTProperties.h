@@ -0,0 +1,144 @@
+/*******************************************************************************
+ * Copyright (c) 2017, 2018 IBM Corp.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Ian Craggs - initial API and implementation and/or initial documentation
+ *******************************************************************************/
+
+#if !defined(MQTTPROPERTIES_H)
+#define MQTTPROPERTIES_H
+
+#define MQTT_INVALID_PROPERTY_ID -2
+
+enum MQTTPropertyCodes {
+	MQTTPROPERTY_CODE_PAYLOAD_FORMAT_INDICATOR = 1,  /**< The value is 1 */
+	MQTTPROPERTY_CODE_MESSAGE_EXPIRY_INTERVAL = 2,   /**< The value is 2 */
+	MQTTPROPERTY_CODE_CONTENT_TYPE = 3,              /**< The value is 3 */
+	MQTTPROPERTY_CODE_RESPONSE_TOPIC = 8,            /**< The value is 8 */
+	MQTTPROPERTY_CODE_CORRELATION_DATA = 9,          /**< The value is 9 */
+	MQTTPROPERTY_CODE_SUBSCRIPTION_IDENTIFIER = 11,  /**< The value is 11 */
+	MQTTPROPERTY_CODE_SESSION_EXPIRY_INTERVAL = 17,  /**< The value is 17 */
+	MQTTPROPERTY_CODE_ASSIGNED_CLIENT_IDENTIFER = 18,/**< The value is 18 */
+	MQTTPROPERTY_CODE_SERVER_KEEP_ALIVE = 19,        /**< The value is 19 */
+	MQTTPROPERTY_CODE_AUTHENTICATION_METHOD = 21,    /**< The value is 21 */
+	MQTTPROPERTY_CODE_AUTHENTICATION_DATA = 22,      /**< The value is 22 */
+	MQTTPROPERTY_CODE_REQUEST_PROBLEM_INFORMATION = 23,/**< The value is 23 */
+	MQTTPROPERTY_CODE_WILL_DELAY_INTERVAL = 24,      /**< The value is 24 */
+	MQTTPROPERTY_CODE_REQUEST_RESPONSE_INFORMATION = 25,/**< The value is 25 */
+	MQTTPROPERTY_CODE_RESPONSE_INFORMATION = 26,     /**< The value is 26 */
+	MQTTPROPERTY_CODE_SERVER_REFERENCE = 28,         /**< The value is 28 */
+	MQTTPROPERTY_CODE_REASON_STRING = 31,            /**< The value is 31 */
+	MQTTPROPERTY_CODE_RECEIVE_MAXIMUM = 33,          /**< The value is 33*/
+	MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM = 34,      /**< The value is 34 */
+	MQTTPROPERTY_CODE_TOPIC_ALIAS = 35,              /**< The value is 35 */
+	MQTTPROPERTY_CODE_MAXIMUM_QOS = 36,              /**< The value is 36 */
+	MQTTPROPERTY_CODE_RETAIN_AVAILABLE = 37,         /**< The value is 37 */
+	MQTTPROPERTY_CODE_USER_PROPERTY = 38,            /**< The value is 38 */
+	MQTTPROPERTY_CODE_MAXIMUM_PACKET_SIZE = 39,      /**< The value is 39 */
+	MQTTPROPERTY_CODE_WILDCARD_SUBSCRIPTION_AVAILABLE = 40,/**< The value is 40 */
+	MQTTPROPERTY_CODE_SUBSCRIPTION_IDENTIFIERS_AVAILABLE = 41,/**< The value is 41 */
+	MQTTPROPERTY_CODE_SHARED_SUBSCRIPTION_AVAILABLE = 42 /**< The value is 42 */
+};
+
+enum MQTTPropertyTypes {
+	MQTTPROPERTY_TYPE_BYTE,
+	MQTTPROPERTY_TYPE_TWO_BYTE_INTEGER,
+	MQTTPROPERTY_TYPE_FOUR_BYTE_INTEGER,
+	MQTTPROPERTY_TYPE_VARIABLE_BYTE_INTEGER,
+	MQTTPROPERTY_TYPE_BINARY_DATA,
+	MQTTPROPERTY_TYPE_UTF_8_ENCODED_STRING,
+	MQTTPROPERTY_TYPE_UTF_8_STRING_PAIR
+};
+
+/**
+ * Returns the type of a property, or MQTT_INVALID_PROPERTY_ID for an
+ * identifier this version of the protocol does not know.
+ */
+DLLExport int MQTTProperty_getType(enum MQTTPropertyCodes value);
+
+/**
+ * Structure to hold an MQTT version 5 property of any type
+ */
+typedef struct
+{
+	enum MQTTPropertyCodes identifier; /**<  The MQTT V5 property id. A multi-byte integer. */
+	/** The value of the property, as a union of the different possible types. */
+	union {
+		unsigned char byte;       /**< holds the value of a byte property type */
+		unsigned short integer2;  /**< holds the value of a 2 byte integer property type */
+		unsigned int integer4;    /**< holds the value of a 4 byte integer property type */
+		struct {
+			MQTTLenString data;  /**< The value of a string property, or the name of a user property. */
+			MQTTLenString value; /**< The value of a user property. */
+		};
+	} value;
+} MQTTProperty;
+
+/**
+ * A set of properties. The array is owned by the caller: serializing only
+ * reads it, and deserializing fills it with values that point into the packet
+ * buffer, so they are valid as long as that buffer is.
+ */
+typedef struct MQTTProperties
+{
+	int count;     /**< number of property entries in the array */
+	int max_count; /**< max number of properties that the currently allocated array can store */
+	int length;    /**< mbi: byte length of all properties */
+	MQTTProperty *array;  /**< array of properties */
+} MQTTProperties;
+
+#define MQTTProperties_initializer {0, 0, 0, NULL}
+
+/**
+ * Returns the length of the properties structure when serialized ready for
+ * network transmission, including the property length prefix.
+ * @param props an MQTT V5 property structure, NULL means no properties
+ * @return the length in bytes of the properties when serialized
+ */
+int MQTTProperties_len(MQTTProperties* props);
+
+/**
+ * Add the property pointer to the property array. The array must have been
+ * set up by the caller; string values are not copied.
+ * @param props The property list to add the property to.
+ * @param prop The property to add to the list.
+ * @return 0 on success, -1 on failure.
+ */
+DLLExport int MQTTProperties_add(MQTTProperties* props, const MQTTProperty* prop);
+
+/**
+ * Serialize the given property list to a character buffer, e.g. for writing to a socket
+ * @param pptr pointer to the buffer - move the pointer as we add data
+ * @param properties pointer to the property list, can be NULL
+ * @return whether the write succeeded or not: number of bytes written, or < 0 on failure.
+ */
+int MQTTProperties_write(unsigned char** pptr, const MQTTProperties* properties);
+
+/**
+ * Reads a property list from a character buffer into an array. Properties that
+ * no longer fit into the array are validated and skipped.
+ * @param properties pointer to the property list to be filled, can be NULL to skip the list
+ * @param pptr pointer to the character buffer.
+ * @param enddata pointer to the end of the character buffer.
+ * @return 1 if the properties were read successfully, 0 otherwise
+ */
+int MQTTProperties_read(MQTTProperties* properties, unsigned char** pptr, unsigned char* enddata);
+
+/**
+ * Returns the integer value of the first occurrence of a property
+ * @param props the property list
+ * @param propid the property id
+ * @return the integer value, or -9999999 if the property is not present
+ */
+DLLExport int MQTTProperties_getNumericValue(MQTTProperties* props, enum MQTTPropertyCodes propid);
+
+#endif /* MQTTPROPERTIES_H */
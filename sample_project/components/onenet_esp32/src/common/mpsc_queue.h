@@ -0,0 +1,79 @@
+/**
+ * Copyright (c), 2012~2024 iot.10086.cn All Rights Reserved
+ * @file        mpsc_queue.h
+ * @brief       Lock-free multi-producer single-consumer queue
+ */
+
+#ifndef __MPSC_QUEUE_H__
+#define __MPSC_QUEUE_H__
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <stdatomic.h>
+
+#include "data_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+/* External Definition（Constant and Macro )                                 */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* External Structures, Enum and Typedefs                                    */
+/*****************************************************************************/
+/**
+ * @brief node definition, embedded as the first member of the queued object
+ *
+ */
+struct mpsc_node
+{
+    struct mpsc_node *_Atomic next;
+};
+
+/**
+ * @brief queue definition.
+ *
+ */
+struct mpsc_queue
+{
+    /** Last pushed node, producers swap themselves in here */
+    struct mpsc_node *_Atomic head;
+    /** Next node to pop, only touched by the consumer */
+    struct mpsc_node *tail;
+    /** Placeholder that keeps the queue non-empty */
+    struct mpsc_node stub;
+};
+
+/*****************************************************************************/
+/* External Variables and Functions                                          */
+/*****************************************************************************/
+/**
+ * Initialize an empty queue
+ * @param queue Queue to initialize
+ */
+void mpsc_queue_init(struct mpsc_queue *queue);
+
+/**
+ * Append a node, safe to call from any number of threads at once
+ * @param queue Queue
+ * @param node Node to append, must stay valid until it is popped
+ */
+void mpsc_queue_push(struct mpsc_queue *queue, struct mpsc_node *node);
+
+/**
+ * Remove the oldest node, must only be called from the consumer thread
+ * @param queue Queue
+ * @return Oldest node, NULL when the queue is empty or a producer is in the
+ *         middle of a push, in which case the node shows up on a later call
+ */
+struct mpsc_node *mpsc_queue_pop(struct mpsc_queue *queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
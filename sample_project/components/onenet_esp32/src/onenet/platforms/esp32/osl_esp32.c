@@ -8,6 +8,9 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include "esp_random.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "plat_osl.h"
 
 char* g_server_ip = NULL;
@@ -121,6 +124,60 @@ uint8_t *osl_random_string(uint8_t *buf, int len) {
     return buf;
 }
 
+struct osl_thread_ctx {
+    osl_thread_entry entry;
+    void *arg;
+};
+
+static void osl_thread_main(void *param) {
+    struct osl_thread_ctx ctx = *(struct osl_thread_ctx *)param;
+
+    free(param);
+    ctx.entry(ctx.arg);
+    vTaskDelete(NULL);
+}
+
+handle_t osl_thread_create(const uint8_t *name, osl_thread_entry entry, void *arg, uint32_t stack_size,
+                           uint32_t priority) {
+    struct osl_thread_ctx *ctx = malloc(sizeof(*ctx));
+    TaskHandle_t task = NULL;
+
+    if (NULL == ctx) {
+        return 0;
+    }
+    ctx->entry = entry;
+    ctx->arg = arg;
+
+    // ESP-IDF takes the stack depth in bytes
+    if (pdPASS != xTaskCreate(osl_thread_main, (const char *)name, stack_size, ctx, priority, &task)) {
+        free(ctx);
+        return 0;
+    }
+    return (handle_t)task;
+}
+
+handle_t osl_thread_self(void) {
+    return (handle_t)xTaskGetCurrentTaskHandle();
+}
+
+handle_t osl_sem_create(void) {
+    return (handle_t)xSemaphoreCreateBinary();
+}
+
+int32_t osl_sem_take(handle_t sem, uint32_t timeout_ms) {
+    TickType_t ticks = (OSL_WAIT_FOREVER == timeout_ms) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+
+    return (pdTRUE == xSemaphoreTake((SemaphoreHandle_t)sem, ticks)) ? 0 : -1;
+}
+
+void osl_sem_give(handle_t sem) {
+    xSemaphoreGive((SemaphoreHandle_t)sem);
+}
+
+void osl_sem_delete(handle_t sem) {
+    vSemaphoreDelete((SemaphoreHandle_t)sem);
+}
+
 int32_t module_init(void *arg, void* callback) {
     return 0;
 }
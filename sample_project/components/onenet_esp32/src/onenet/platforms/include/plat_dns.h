@@ -0,0 +1,67 @@
+/**
+ * Copyright (c), 2012~2024 iot.10086.cn All Rights Reserved
+ *
+ * @file plat_dns.h
+ * @brief Host name resolution Interfaces.
+ */
+
+#ifndef __PLAT_DNS_H__
+#define __PLAT_DNS_H__
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include "data_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+/* External Definition ( Constant and Macro )                                */
+/*****************************************************************************/
+/** Addresses kept per host name */
+#ifndef PLAT_DNS_MAX_ADDRS
+#define PLAT_DNS_MAX_ADDRS 4
+#endif
+
+/*****************************************************************************/
+/* External Structures, Enum and Typedefs                                    */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* External Variables and Functions                                          */
+/*****************************************************************************/
+/**
+ * @brief Resolve a host name into IPv4 addresses，Served from the cache while it is fresh
+ *
+ * The lookup runs in the background，When it does not finish before the timeout the
+ * expired cache entry or the last address that connected is returned instead.
+ * The address that last connected comes first，Addresses that failed go last.
+ *
+ * @param host Host name or dotted IPv4 address
+ * @param addrs Buffer address used to receive the addresses，In network byte order
+ * @param max Maximum number of addresses to return
+ * @param timeout_ms Longest time to wait for the lookup
+ * @retval -1 - Failed，No address known for the host
+ * @retval Other - Number of addresses returned
+ */
+int32_t plat_dns_resolve(const uint8_t *host, uint32_t *addrs, uint32_t max, uint32_t timeout_ms);
+
+/**
+ * @brief Report the result of connecting to a resolved address
+ *
+ * An address that connected is tried first next time and saved so it survives a
+ * reboot，One that failed is tried last.
+ *
+ * @param host Host name passed to plat_dns_resolve
+ * @param addr Address that was tried，In network byte order
+ * @param ok Non-zero when the connection was established
+ */
+void plat_dns_report(const uint8_t *host, uint32_t addr, int32_t ok);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
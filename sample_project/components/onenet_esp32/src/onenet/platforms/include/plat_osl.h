@@ -21,10 +21,14 @@ extern "C" {
 /*****************************************************************************/
 /* External Definition（Constant and Macro )                                 */
 /*****************************************************************************/
+/** Timeout value that makes osl_sem_take block until the semaphore is given */
+#define OSL_WAIT_FOREVER 0xFFFFFFFF
 
 /*****************************************************************************/
 /* External Structures, Enum and Typedefs                                    */
 /*****************************************************************************/
+/** Thread entry, the thread exits when it returns */
+typedef void (*osl_thread_entry)(void *arg);
 
 /*****************************************************************************/
 /* External Variables and Functions                                          */
@@ -68,6 +72,33 @@ int32_t osl_rand(int32_t min, int32_t max);
 /// @return  Random String
 uint8_t *osl_random_string(uint8_t *buf, int len);
 
+/// @brief  Create and start a thread, its resources are released when entry returns
+/// @param  name Thread name
+/// @param  entry Thread entry
+/// @param  arg Argument passed to entry
+/// @param  stack_size Stack size in bytes
+/// @param  priority Platform priority, a larger value runs first
+/// @return  Thread handle, 0 - failed
+handle_t osl_thread_create(const uint8_t *name, osl_thread_entry entry, void *arg, uint32_t stack_size,
+                           uint32_t priority);
+
+/// @brief  Handle of the calling thread, comparable with osl_thread_create's result
+handle_t osl_thread_self(void);
+
+/// @brief  Create a binary semaphore, initially not available
+/// @return  Semaphore handle, 0 - failed
+handle_t osl_sem_create(void);
+
+/// @brief  Wait for the semaphore
+/// @param  sem Semaphore handle
+/// @param  timeout_ms Maximum wait time, OSL_WAIT_FOREVER blocks without limit
+/// @return  0 - Taken, -1 - Timeout
+int32_t osl_sem_take(handle_t sem, uint32_t timeout_ms);
+
+/// @brief  Make the semaphore available, may be called from any thread
+void osl_sem_give(handle_t sem);
+
+void osl_sem_delete(handle_t sem);
 
 int32_t module_init(void *arg,void* callback);
 int32_t module_deinit(void);
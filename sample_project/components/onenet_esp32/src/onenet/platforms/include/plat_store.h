@@ -0,0 +1,95 @@
+/**
+ * Copyright (c), 2012~2024 iot.10086.cn All Rights Reserved
+ *
+ * @file plat_store.h
+ * @brief Persistent key-value storage Interfaces.
+ */
+
+#ifndef __PLAT_STORE_H__
+#define __PLAT_STORE_H__
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include "data_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+/* External Definition ( Constant and Macro )                                */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* External Structures, Enum and Typedefs                                    */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* External Variables and Functions                                          */
+/*****************************************************************************/
+/**
+ * @brief Open a store whose entries survive a reboot
+ *
+ * @param name Store name，At most 15 characters
+ * @retval 0 - Failed
+ * @retval Other - Store operation handle
+ */
+handle_t plat_store_open(const uint8_t *name);
+
+/**
+ * @brief Save an entry，Replacing the entry already saved under the key
+ *
+ * @param handle Store operation handle
+ * @param key Entry key
+ * @param data Entry content
+ * @param len Entry content length
+ * @retval -1 - Failed
+ * @retval  0 - Succeed
+ */
+int32_t plat_store_put(handle_t handle, uint32_t key, const void *data, uint32_t len);
+
+/**
+ * @brief Read an entry
+ *
+ * @param handle Store operation handle
+ * @param key Entry key
+ * @param buf Buffer address used to receive the content，NULL only queries the length
+ * @param len Buffer length
+ * @retval -1 - No such entry or error
+ * @retval Other - Entry content length，Nothing is copied when it exceeds len
+ */
+int32_t plat_store_get(handle_t handle, uint32_t key, void *buf, uint32_t len);
+
+/**
+ * @brief Remove an entry
+ *
+ * @param handle Store operation handle
+ * @param key Entry key
+ * @retval 0 - Succeed，Also when there was no such entry
+ */
+int32_t plat_store_remove(handle_t handle, uint32_t key);
+
+/**
+ * @brief List the keys of saved entries，In no particular order
+ *
+ * @param handle Store operation handle
+ * @param keys Buffer address used to receive the keys
+ * @param max Maximum number of keys to return
+ * @retval -1 - Error
+ * @retval Other - Number of keys returned
+ */
+int32_t plat_store_keys(handle_t handle, uint32_t *keys, uint32_t max);
+
+/**
+ * @brief Close the store，Saved entries are kept
+ *
+ * @param handle Store operation handle
+ */
+void plat_store_close(handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -42,6 +42,8 @@ handle_t plat_tcp_connect(const uint8_t *host, uint16_t port, uint32_t timeout_m
 /**
  * @brief send TCP data
  *
+ * Keeps sending after a partial write until all data is sent or the timeout expires.
+ *
  * @param handle TCP Connection operation handle
  * @param buf Data buffer address to be sent
  * @param len Length of data to be sent
@@ -65,6 +67,31 @@ int32_t plat_tcp_send(handle_t handle, void *buf, uint32_t len, uint32_t timeout
  */
 int32_t plat_tcp_recv(handle_t handle, void *buf, uint32_t len, uint32_t timeout_ms);
 
+/**
+ * @brief Wait until TCP Connection has data to read
+ *
+ * An error or a connection closed by the peer also counts as readable，The following
+ * plat_tcp_recv reports it.
+ *
+ * @param handle TCP Connection operation handle
+ * @param timeout_ms Timeout time，0 only checks the current state
+ * @retval -1 - Error
+ * @retval  0 - Timeout
+ * @retval  1 - Readable
+ */
+int32_t plat_tcp_wait_readable(handle_t handle, uint32_t timeout_ms);
+
+/**
+ * @brief Wait until TCP Connection can accept more data to send
+ *
+ * @param handle TCP Connection operation handle
+ * @param timeout_ms Timeout time，0 only checks the current state
+ * @retval -1 - Error
+ * @retval  0 - Timeout
+ * @retval  1 - Writable
+ */
+int32_t plat_tcp_wait_writable(handle_t handle, uint32_t timeout_ms);
+
 /**
  * @brief Disconnect assigned TCP Connection
  *
@@ -0,0 +1,139 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+#include "plat_time.h"
+
+// 倒计时器结构体
+struct countdown_tmr_t {
+    uint64_t end_time_ms;
+};
+
+// 获取日期时间，返回自1970年起的毫秒数
+uint64_t time_get_date(int* year, int* month, int* day, int* hour, int* min, int* sec, int* ms)
+{
+    struct timespec ts;
+    struct tm tm;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    localtime_r(&ts.tv_sec, &tm);
+
+    *year = tm.tm_year + 1900;
+    *month = tm.tm_mon + 1;
+    *day = tm.tm_mday;
+    *hour = tm.tm_hour;
+    *min = tm.tm_min;
+    *sec = tm.tm_sec;
+    *ms = (int)(ts.tv_nsec / 1000000);
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 获取时间戳ms，使用单调时钟，不受系统时间调整影响
+uint64_t time_count_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 获取时间戳s
+uint64_t time_count(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec;
+}
+
+// 延时ms，被信号打断时继续睡完剩余时间
+void time_delay_ms(uint32_t m_sec)
+{
+    struct timespec ts;
+
+    ts.tv_sec = m_sec / 1000;
+    ts.tv_nsec = (long)(m_sec % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+    }
+}
+
+// 延时s
+void time_delay(uint32_t sec)
+{
+    time_delay_ms(sec * 1000);
+}
+
+// 启动截止时间
+deadline_t deadline_start(uint32_t ms)
+{
+    return time_count_ms() + ms;
+}
+
+// 获取截止时间剩余时间
+uint32_t deadline_left(deadline_t deadline)
+{
+    uint64_t current = time_count_ms();
+
+    if (current >= deadline) {
+        return 0;
+    }
+    return (uint32_t)(deadline - current);
+}
+
+// 检查截止时间是否已到
+uint32_t deadline_is_expired(deadline_t deadline)
+{
+    return (time_count_ms() >= deadline) ? 1 : 0;
+}
+
+// 启动倒计时器（兼容接口，新代码使用deadline_start）
+handle_t countdown_start(uint32_t ms)
+{
+    struct countdown_tmr_t *tmr = (struct countdown_tmr_t *)malloc(sizeof(struct countdown_tmr_t));
+
+    if (tmr) {
+        tmr->end_time_ms = time_count_ms() + ms;
+    }
+    return (handle_t)tmr;
+}
+
+// 重设倒计时器
+void countdown_set(handle_t handle, uint32_t new_ms)
+{
+    struct countdown_tmr_t *tmr = (struct countdown_tmr_t *)handle;
+
+    if (tmr) {
+        tmr->end_time_ms = time_count_ms() + new_ms;
+    }
+}
+
+// 获取倒计时器剩余时间
+uint32_t countdown_left(handle_t handle)
+{
+    struct countdown_tmr_t *tmr = (struct countdown_tmr_t *)handle;
+
+    if (!tmr) {
+        return 0;
+    }
+    return deadline_left(tmr->end_time_ms);
+}
+
+// 检查倒计时器是否超时
+uint32_t countdown_is_expired(handle_t handle)
+{
+    struct countdown_tmr_t *tmr = (struct countdown_tmr_t *)handle;
+
+    if (!tmr) {
+        return 1;
+    }
+    return deadline_is_expired(tmr->end_time_ms);
+}
+
+// 停止倒计时器并释放资源
+void countdown_stop(handle_t handle)
+{
+    if (handle) {
+        free((void *)handle);
+    }
+}
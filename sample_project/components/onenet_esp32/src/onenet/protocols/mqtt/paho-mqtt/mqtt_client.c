@@ -14,8 +14,12 @@
 #include <string.h>
 
 #include "data_types.h"
+#if defined(MQTTV5)
+#include "err_def.h"
+#endif
 #include "log.h"
 #include "mqtt_api.h"
+#include "mqtt_topic_trie.h"
 #include "plat_osl.h"
 #include "plat_tcp.h"
 #include "plat_time.h"
@@ -37,21 +41,104 @@ typedef struct mqtt_client {
   int isconnected;
   int cleansession;
 
-  struct MessageHandlers {
-    const char *topic_filter;
-    void (*fp)(void *, const uint8_t *, struct mqtt_message_t *);
-    void *arg;
+  struct topic_trie_handler defaultHandler;
+  struct topic_trie
+      message_handlers; /* Message handlers are indexed by subscription topic */
 
-  } message_handlers[MAX_MESSAGE_HANDLERS],
-      defaultHandler; /* Message handlers are indexed by subscription topic */
+  /* NUL terminated copy of the inbound topic for handlers that take a C
+   * string, grown on demand and reused for every message */
+  char *topic_scratch;
+  size_t topic_scratch_size;
 
   mqtt_network *ipstack;
-  handle_t keepalive_count;
+
+  /* keepalive bookkeeping in time_count_ms() units. The server only needs to
+   * hear from us once per interval, so any write counts, not just pings */
+  uint64_t last_sent_at, last_recv_at, ping_sent_at;
+  uint32_t ping_rtt_ms, ping_srtt_ms; /* 0 - no PINGRESP yet */
+
+  /* receive staging: bytes read from the transport but not parsed yet */
+  unsigned char rx_stage[MQTT_RX_STAGE_LEN];
+  int rx_head, rx_tail;
+  int rx_error;
+  deadline_t rx_deadline;
+  MQTTTransport rx_trp;
+
+  /* an inbound packet larger than readbuf, read through it piece by piece.
+   * Only a PUBLISH for a chunk handler is delivered, anything else is read
+   * to its end and dropped so the stream stays in sync */
+  struct OversizedPacket {
+    uint32_t left; /* packet bytes still to read, 0 - none in progress */
+    uint32_t rem_len;
+    int head; /* readbuf bytes collected for the variable header, -1 once
+               * it has been parsed */
+    unsigned char header;
+    struct topic_trie_handler handler;
+    struct mqtt_message_t msg;
+    uint32_t offset, total; /* payload delivered so far, payload length */
+  } rx_big;
+
+  /* QoS1 publishes waiting for their PUBACK, indexed by nothing in
+   * particular - the window is small enough for a linear scan */
+  struct InflightMessage {
+    unsigned short id;
+    unsigned char *packet; /* serialized PUBLISH, kept for resending */
+    int len;
+    uint32_t key; /* outbox entry, 0 - not in the outbox */
+    uint64_t resend_at;
+    publish_complete_handler cb;
+    void *arg;
+  } inflight[MQTT_MAX_INFLIGHT];
+  unsigned int inflight_cnt;
+  unsigned int inflight_window;
+  unsigned int inflight_retry_ms;
+
+  /* durable copy of the windowed publishes. Entries take increasing keys and
+   * are removed on PUBACK; replay_keys lists the ones an earlier connection
+   * left behind that still have to go out before any new publish */
+  mqtt_store *store;
+  uint32_t store_next_key;
+  uint32_t *replay_keys;
+  unsigned int replay_cnt, replay_pos;
+
+  /* completion callbacks of stored publishes a dropped connection cut off,
+   * handed to the replayed copy and fired on its PUBACK */
+  struct ParkedCallback {
+    uint32_t key; /* 0 - free */
+    unsigned short id; /* reported if the replay never happens */
+    publish_complete_handler cb;
+    void *arg;
+  } parked[MQTT_MAX_INFLIGHT];
+
+  /* outbound queue: packets serialized back-to-back at the start of buf and
+   * written to the transport in one go */
+  int tx_len;
+  unsigned int tx_flush_bytes; /* 0 - write every packet immediately */
+  unsigned int tx_flush_ms;
+  uint64_t tx_first_at;
+
+#if defined(MQTTV5)
+  unsigned char mqtt_version;
+  /* limits the server announced in its CONNACK */
+  unsigned int receive_max;
+  unsigned int max_packet_size; /* 0 - no limit */
+  unsigned int topic_alias_max;
+
+  /* publish topics bound to an alias on this connection, entry i holds alias
+   * i + 1. Aliases are handed out on first use and never reassigned */
+  struct TopicAlias {
+    char *topic;
+    size_t len;
+  } topic_alias[MQTT_TOPIC_ALIAS_MAX];
+  unsigned int topic_alias_cnt;
+#endif
 } mqtt_client;
 
 /*****************************************************************************/
 /* Local Function Prototype                                                  */
 /*****************************************************************************/
+static int stagedRead(void *sck, unsigned char *buf, int count);
+static int readOversized(mqtt_client *c, deadline_t deadline);
 
 /*****************************************************************************/
 /* Local Variables                                                           */
@@ -73,17 +160,36 @@ static void NewMessageData(mqtt_message_data *md, MQTTString *aTopicName,
 }
 #endif
 
+static struct InflightMessage *findInflight(mqtt_client *c,
+                                            unsigned short id) {
+  int i;
+
+  for (i = 0; i < MQTT_MAX_INFLIGHT; ++i) {
+    if (c->inflight[i].packet != NULL && c->inflight[i].id == id) {
+      return &c->inflight[i];
+    }
+  }
+
+  return NULL;
+}
+
 static int getNextPacketId(mqtt_client *c) {
-  return c->next_packetid =
-             (c->next_packetid == MAX_PACKET_ID) ? 1 : c->next_packetid + 1;
+  /* ids still waiting for a PUBACK must not be reused */
+  do {
+    c->next_packetid =
+        (c->next_packetid == MAX_PACKET_ID) ? 1 : c->next_packetid + 1;
+  } while (c->inflight_cnt > 0 && findInflight(c, c->next_packetid) != NULL);
+
+  return c->next_packetid;
 }
 
-static int sendPacket(mqtt_client *c, int length, handle_t cd_handle) {
+static int sendBuffer(mqtt_client *c, unsigned char *buf, int length,
+                      deadline_t deadline) {
   int rc = FAILURE, sent = 0;
 
   do {
-    rc = c->ipstack->mqttwrite(c->ipstack->handle, &c->buf[sent], length,
-                               countdown_left(cd_handle));
+    rc = c->ipstack->mqttwrite(c->ipstack->handle, &buf[sent], length - sent,
+                               deadline_left(deadline));
 
     if (rc < 0)  // there was an error writing the data
     {
@@ -91,7 +197,11 @@ static int sendPacket(mqtt_client *c, int length, handle_t cd_handle) {
     }
 
     sent += rc;
-  } while (sent < length && !countdown_is_expired(cd_handle));
+  } while (sent < length && !deadline_is_expired(deadline));
+
+  if (sent > 0) {
+    c->last_sent_at = time_count_ms();
+  }
 
   if (sent == length) {
     rc = SUCCESS;
@@ -103,202 +213,1081 @@ static int sendPacket(mqtt_client *c, int length, handle_t cd_handle) {
   return rc;
 }
 
+static unsigned char *txTail(mqtt_client *c) { return c->buf + c->tx_len; }
+
+static int txRoom(mqtt_client *c) { return (int)c->buf_size - c->tx_len; }
+
+static int flushQueue(mqtt_client *c, deadline_t deadline) {
+  int rc = SUCCESS;
+
+  if (c->tx_len > 0) {
+    rc = sendBuffer(c, c->buf, c->tx_len, deadline);
+    c->tx_len = 0;
+  }
+
+  return rc;
+}
+
+static int txFlushDue(mqtt_client *c) {
+  return c->tx_len > 0 &&
+         time_count_ms() >= c->tx_first_at + c->tx_flush_ms;
+}
+
+/* Serializers return MQTTPACKET_BUFFER_TOO_SHORT when queued packets leave too
+ * little room; flush once so the caller can serialize again. */
+static int txRetry(mqtt_client *c, int len, deadline_t deadline) {
+  return len == MQTTPACKET_BUFFER_TOO_SHORT && c->tx_len > 0 &&
+         flushQueue(c, deadline) == SUCCESS;
+}
+
+/* Append the packet just serialized at txTail() to the queue and write the
+ * queue out when the flush policy says so. */
+static int queuePacket(mqtt_client *c, int length, deadline_t deadline) {
+  if (c->tx_len == 0) {
+    c->tx_first_at = time_count_ms();
+  }
+
+  c->tx_len += length;
+
+  if (c->tx_flush_bytes == 0 || c->tx_len >= (int)c->tx_flush_bytes ||
+      txFlushDue(c)) {
+    return flushQueue(c, deadline);
+  }
+
+  return SUCCESS;
+}
+
+/* Queue the packet and write everything out now, for requests that are
+ * about to wait for their response. */
+static int sendPacket(mqtt_client *c, int length, deadline_t deadline) {
+  c->tx_len += length;
+
+  return flushQueue(c, deadline);
+}
+
+static void completeInflight(mqtt_client *c, struct InflightMessage *m,
+                             int rc) {
+  publish_complete_handler cb = m->cb;
+  void *arg = m->arg;
+  unsigned short id = m->id;
+
+  osl_free(m->packet);
+  osl_memset(m, 0, sizeof(*m));
+  c->inflight_cnt--;
+
+  if (cb) {
+    cb(arg, id, rc);
+  }
+}
+
+/* Fail the callbacks waiting for a replay that will not happen */
+static void failParked(mqtt_client *c) {
+  int i;
+
+  for (i = 0; i < MQTT_MAX_INFLIGHT; ++i) {
+    struct ParkedCallback *p = &c->parked[i];
+
+    if (p->key != 0) {
+      publish_complete_handler cb = p->cb;
+      void *arg = p->arg;
+      unsigned short id = p->id;
+
+      osl_memset(p, 0, sizeof(*p));
+      cb(arg, id, FAILURE);
+    }
+  }
+}
+
+static void failAllInflight(mqtt_client *c) {
+  int i;
+
+  for (i = 0; i < MQTT_MAX_INFLIGHT && c->inflight_cnt > 0; ++i) {
+    if (c->inflight[i].packet != NULL) {
+      completeInflight(c, &c->inflight[i], FAILURE);
+    }
+  }
+
+  failParked(c);
+}
+
+/* The connection is gone. A persistent session replays the stored publishes,
+ * so their callbacks wait for the PUBACK of the replayed copy; everything else
+ * fails, and a clean session drops the stored copy as well, so FAILURE always
+ * means the message will not be sent again. */
+static void closeInflight(mqtt_client *c) {
+  int i, j;
+
+  for (i = 0; i < MQTT_MAX_INFLIGHT && c->inflight_cnt > 0; ++i) {
+    struct InflightMessage *m = &c->inflight[i];
+
+    if (m->packet == NULL) {
+      continue;
+    }
+
+    if (m->key != 0 && !c->cleansession) {
+      for (j = 0; m->cb && j < MQTT_MAX_INFLIGHT; ++j) {
+        if (c->parked[j].key == 0) {
+          c->parked[j].key = m->key;
+          c->parked[j].id = m->id;
+          c->parked[j].cb = m->cb;
+          c->parked[j].arg = m->arg;
+          m->cb = NULL;
+          break;
+        }
+      }
+
+      if (m->cb == NULL) {
+        osl_free(m->packet);
+        osl_memset(m, 0, sizeof(*m));
+        c->inflight_cnt--;
+        continue;
+      }
+    }
+
+    if (m->key != 0) {
+      c->store->remove(c->store->handle, m->key);
+    }
+
+    completeInflight(c, m, FAILURE);
+  }
+}
+
+/* Hand back the callback parked under an outbox key, NULL if there is none */
+static publish_complete_handler takeParked(mqtt_client *c, uint32_t key,
+                                           void **arg, unsigned short *id) {
+  int i;
+
+  for (i = 0; i < MQTT_MAX_INFLIGHT; ++i) {
+    struct ParkedCallback *p = &c->parked[i];
+
+    if (p->key == key) {
+      publish_complete_handler cb = p->cb;
+
+      *arg = p->arg;
+      if (id) {
+        *id = p->id;
+      }
+      osl_memset(p, 0, sizeof(*p));
+      return cb;
+    }
+  }
+
+  return NULL;
+}
+
+static int resendInflight(mqtt_client *c, deadline_t deadline) {
+  int i;
+  uint64_t now = 0;
+
+  if (c->inflight_cnt == 0) {
+    return SUCCESS;
+  }
+
+  now = time_count_ms();
+
+  for (i = 0; i < MQTT_MAX_INFLIGHT; ++i) {
+    struct InflightMessage *m = &c->inflight[i];
+
+    if (m->packet != NULL && now >= m->resend_at) {
+      MQTTHeader header = {0};
+
+      header.byte = m->packet[0];
+      header.bits.dup = 1;
+      m->packet[0] = header.byte;
+
+      if (sendBuffer(c, m->packet, m->len, deadline) != SUCCESS) {
+        return FAILURE;
+      }
+
+      logd("Mqtt resend publish %u", m->id);
+      m->resend_at = now + c->inflight_retry_ms;
+    }
+  }
+
+  return SUCCESS;
+}
+
+static struct InflightMessage *freeInflight(mqtt_client *c) {
+  int i;
+
+  for (i = 0; i < MQTT_MAX_INFLIGHT; ++i) {
+    if (c->inflight[i].packet == NULL) {
+      return &c->inflight[i];
+    }
+  }
+
+  return NULL;
+}
+
+/* List the outbox entries an earlier connection left behind, oldest first.
+ * Keys only grow, so sorting them restores the order of publishing. */
+static void loadOutbox(mqtt_client *c) {
+  int cnt = 0, i = 0, j = 0;
+
+  c->replay_cnt = c->replay_pos = 0;
+
+  if (NULL == c->replay_keys &&
+      NULL == (c->replay_keys =
+                   osl_malloc(MQTT_OUTBOX_MAX * sizeof(*c->replay_keys)))) {
+    return;
+  }
+
+  cnt = c->store->keys(c->store->handle, c->replay_keys, MQTT_OUTBOX_MAX);
+
+  if (cnt <= 0) {
+    return;
+  }
+
+  for (i = 1; i < cnt; ++i) {
+    uint32_t key = c->replay_keys[i];
+
+    for (j = i; j > 0 && c->replay_keys[j - 1] > key; --j) {
+      c->replay_keys[j] = c->replay_keys[j - 1];
+    }
+
+    c->replay_keys[j] = key;
+  }
+
+  c->replay_cnt = cnt;
+
+  if (c->store_next_key <= c->replay_keys[cnt - 1]) {
+    c->store_next_key = c->replay_keys[cnt - 1] + 1;
+  }
+
+  logi("Mqtt outbox holds %d unacknowledged publishes", cnt);
+}
+
+/* Where the packet id of a stored QoS1 PUBLISH sits, it follows the topic
+ * name. NULL when the entry is not such a packet. */
+static unsigned char *outboxPacketId(unsigned char *packet, int len) {
+  MQTTHeader header = {0};
+  unsigned char *ptr = packet + 1;
+  unsigned char *end = packet + len;
+  int rem_len = 0, topic_len = 0;
+
+  header.byte = packet[0];
+
+  if (len < 2 || header.bits.type != PUBLISH || header.bits.qos != 1) {
+    return NULL;
+  }
+
+  ptr += MQTTPacket_decodeBuf(ptr, &rem_len);
+
+  if (end - ptr < 2 || (topic_len = readInt(&ptr)) + 2 > end - ptr) {
+    return NULL;
+  }
+
+  return ptr + topic_len;
+}
+
+/* Move outbox entries left over from an earlier connection into free window
+ * slots and send them again, never waiting for a slot to free up. */
+static int replayOutbox(mqtt_client *c, deadline_t deadline) {
+  while (c->replay_pos < c->replay_cnt &&
+         c->inflight_cnt < c->inflight_window) {
+    uint32_t key = c->replay_keys[c->replay_pos];
+    struct InflightMessage *m = freeInflight(c);
+    unsigned char *id_ptr = NULL;
+    unsigned short id = 0;
+    MQTTHeader header = {0};
+    int len = c->store->get(c->store->handle, key, NULL, 0);
+
+    if (len > 0 && NULL == (m->packet = osl_malloc(len))) {
+      break; /* try again on the next cycle, the order must hold */
+    }
+
+    c->replay_pos++;
+
+    if (len <= 0 ||
+        c->store->get(c->store->handle, key, m->packet, len) != len ||
+        NULL == (id_ptr = outboxPacketId(m->packet, len))) {
+      publish_complete_handler cb = NULL;
+      void *arg = NULL;
+
+      loge("Mqtt outbox entry %u dropped", (unsigned int)key);
+      c->store->remove(c->store->handle, key);
+      osl_free(m->packet);
+      m->packet = NULL;
+
+      if (NULL != (cb = takeParked(c, key, &arg, &id))) {
+        cb(arg, id, FAILURE);
+      }
+      continue;
+    }
+
+    id = (unsigned short)readInt(&id_ptr);
+    id_ptr -= 2;
+
+    /* a resumed session knows the entry by its id, only a clash with a
+     * publish of this connection makes it take a new one */
+    if (id == 0 || findInflight(c, id) != NULL) {
+      id = (unsigned short)getNextPacketId(c);
+      writeInt(&id_ptr, id);
+    }
+
+    m->id = id;
+
+    header.byte = m->packet[0];
+    header.bits.dup = 1;
+    m->packet[0] = header.byte;
+    m->len = len;
+    m->key = key;
+    m->cb = takeParked(c, key, &m->arg, NULL);
+    m->resend_at = time_count_ms() + c->inflight_retry_ms;
+    c->inflight_cnt++;
+
+    /* queued publishes were published first, they go out first */
+    if (flushQueue(c, deadline) != SUCCESS ||
+        sendBuffer(c, m->packet, len, deadline) != SUCCESS) {
+      return FAILURE;
+    }
+
+    logd("Mqtt replay publish %u", m->id);
+  }
+
+  if (c->replay_keys && c->replay_pos >= c->replay_cnt) {
+    osl_free(c->replay_keys);
+    c->replay_keys = NULL;
+    c->replay_cnt = c->replay_pos = 0;
+  }
+
+  return SUCCESS;
+}
+
+#if defined(MQTTV5)
+static void resetTopicAliases(mqtt_client *c) {
+  unsigned int i;
+
+  for (i = 0; i < c->topic_alias_cnt; ++i) {
+    osl_free(c->topic_alias[i].topic);
+  }
+
+  osl_memset(c->topic_alias, 0, sizeof(c->topic_alias));
+  c->topic_alias_cnt = 0;
+}
+
+static unsigned short findTopicAlias(mqtt_client *c, const char *topic,
+                                     size_t len) {
+  unsigned int i;
+
+  for (i = 0; i < c->topic_alias_cnt; ++i) {
+    if (c->topic_alias[i].len == len &&
+        memcmp(c->topic_alias[i].topic, topic, len) == 0) {
+      return (unsigned short)(i + 1);
+    }
+  }
+
+  return 0;
+}
+
+/* Record the alias once the PUBLISH binding it is on its way. Without memory
+ * the alias just stays free and the next publish binds it again. */
+static void bindTopicAlias(mqtt_client *c, unsigned short alias,
+                           const char *topic, size_t len) {
+  char *copy = NULL;
+
+  if (alias != c->topic_alias_cnt + 1 ||
+      NULL == (copy = osl_malloc(len))) {
+    return;
+  }
+
+  osl_memcpy(copy, topic, len);
+  c->topic_alias[alias - 1].topic = copy;
+  c->topic_alias[alias - 1].len = len;
+  c->topic_alias_cnt++;
+}
+
+int32_t mqtt_client_reason_to_err(uint8_t reason_code) {
+  switch (reason_code) {
+    case MQTTREASONCODE_MALFORMED_PACKET:
+    case MQTTREASONCODE_PROTOCOL_ERROR:
+    case MQTTREASONCODE_PACKET_IDENTIFIER_IN_USE:
+    case MQTTREASONCODE_PACKET_IDENTIFIER_NOT_FOUND:
+    case MQTTREASONCODE_TOPIC_ALIAS_INVALID:
+    case MQTTREASONCODE_PAYLOAD_FORMAT_INVALID:
+      return ERR_INVALID_DATA;
+
+    case MQTTREASONCODE_CLIENT_IDENTIFIER_NOT_VALID:
+    case MQTTREASONCODE_TOPIC_FILTER_INVALID:
+    case MQTTREASONCODE_TOPIC_NAME_INVALID:
+      return ERR_INVALID_PARAM;
+
+    case MQTTREASONCODE_UNSUPPORTED_PROTOCOL_VERSION:
+    case MQTTREASONCODE_RETAIN_NOT_SUPPORTED:
+    case MQTTREASONCODE_QOS_NOT_SUPPORTED:
+    case MQTTREASONCODE_SHARED_SUBSCRIPTIONS_NOT_SUPPORTED:
+    case MQTTREASONCODE_SUBSCRIPTION_IDENTIFIERS_NOT_SUPPORTED:
+    case MQTTREASONCODE_WILDCARD_SUBSCRIPTIONS_NOT_SUPPORTED:
+      return ERR_NOT_SUPPORT;
+
+    case MQTTREASONCODE_BAD_USER_NAME_OR_PASSWORD:
+    case MQTTREASONCODE_NOT_AUTHORIZED:
+    case MQTTREASONCODE_BANNED:
+    case MQTTREASONCODE_BAD_AUTHENTICATION_METHOD:
+      return ERR_REQUEST_FAILED;
+
+    case MQTTREASONCODE_SERVER_UNAVAILABLE:
+    case MQTTREASONCODE_SERVER_BUSY:
+    case MQTTREASONCODE_MESSAGE_RATE_TOO_HIGH:
+    case MQTTREASONCODE_CONNECTION_RATE_EXCEEDED:
+      return ERR_RESOURCE_BUSY;
+
+    case MQTTREASONCODE_RECEIVE_MAXIMUM_EXCEEDED:
+    case MQTTREASONCODE_PACKET_TOO_LARGE:
+    case MQTTREASONCODE_QUOTA_EXCEEDED:
+      return ERR_OVERFLOW;
+
+    case MQTTREASONCODE_KEEP_ALIVE_TIMEOUT:
+    case MQTTREASONCODE_MAXIMUM_CONNECT_TIME:
+      return ERR_TIMEOUT;
+
+    case MQTTREASONCODE_SESSION_TAKEN_OVER:
+      return ERR_REPETITIVE;
+
+    case MQTTREASONCODE_SERVER_SHUTTING_DOWN:
+    case MQTTREASONCODE_USE_ANOTHER_SERVER:
+    case MQTTREASONCODE_SERVER_MOVED:
+      return ERR_NETWORK;
+
+    default:
+      return (reason_code < 0x80) ? ERR_OK : ERR_CLOUD;
+  }
+}
+#endif
+
+/* Serialize a PUBLISH at txTail(). In MQTT 5.0 mode a topic that already owns
+ * an alias goes out as the alias alone, a new topic takes the next free alias
+ * and is sent in full once to bind it; *bind is set to that alias. A NULL bind
+ * keeps the full topic, for packets that may outlive the connection. With
+ * header_only the payload is left out, the caller sends it right after. */
+static int serializePublish(mqtt_client *c, const char *topicName,
+                            struct mqtt_message_t *message,
+                            unsigned short *bind, int header_only,
+                            deadline_t deadline) {
+  MQTTString topic = MQTTString_initializer;
+  int len = 0;
+
+  topic.cstring = (char *)topicName;
+  if (bind) {
+    *bind = 0;
+  }
+
+#if defined(MQTTV5)
+  if (c->mqtt_version == 5) {
+    MQTTProperty alias_prop;
+    MQTTProperties props = MQTTProperties_initializer;
+    unsigned short alias =
+        bind ? findTopicAlias(c, topicName, strlen(topicName)) : 0;
+
+    props.max_count = 1;
+    props.array = &alias_prop;
+
+    if (alias > 0) {
+      topic.cstring = "";
+    } else if (bind && c->topic_alias_cnt < c->topic_alias_max) {
+      alias = *bind = (unsigned short)(c->topic_alias_cnt + 1);
+    }
+
+    if (alias > 0) {
+      alias_prop.identifier = MQTTPROPERTY_CODE_TOPIC_ALIAS;
+      alias_prop.value.integer2 = alias;
+      MQTTProperties_add(&props, &alias_prop);
+    }
+
+    do {
+      if (header_only) {
+        len = MQTTV5Serialize_publishHeader(
+            txTail(c), txRoom(c), 0, message->qos, message->retained,
+            message->id, topic, &props, message->payload_len);
+      } else {
+        len = MQTTV5Serialize_publish(txTail(c), txRoom(c), 0, message->qos,
+                                      message->retained, message->id, topic,
+                                      &props, (unsigned char *)message->payload,
+                                      message->payload_len);
+      }
+    } while (txRetry(c, len, deadline));
+
+    if (c->max_packet_size > 0 &&
+        len + (header_only ? (int)message->payload_len : 0) >
+            (int)c->max_packet_size) {
+      loge("Mqtt publish exceeds server maximum packet size!");
+      len = FAILURE;
+    }
+
+    return len;
+  }
+#endif
+
+  do {
+    if (header_only) {
+      len = MQTTSerialize_publishHeader(txTail(c), txRoom(c), 0, message->qos,
+                                        message->retained, message->id, topic,
+                                        message->payload_len);
+    } else {
+      len = MQTTSerialize_publish(
+          txTail(c), txRoom(c), 0, message->qos, message->retained,
+          message->id, topic, (unsigned char *)message->payload,
+          message->payload_len);
+    }
+  } while (txRetry(c, len, deadline));
+
+  return len;
+}
+
+/* Parse PUBACK/PUBREC/PUBREL/PUBCOMP. *result is SUCCESS, or the error an
+ * MQTT 5.0 server reported for the packet */
+static int deserializeAck(mqtt_client *c, unsigned short *packetid,
+                          int *result) {
+  unsigned char dup, type;
+  int rc = 0;
+
+  *result = SUCCESS;
+
+#if defined(MQTTV5)
+  if (c->mqtt_version == 5) {
+    MQTTProperties props = MQTTProperties_initializer;
+    unsigned char reason = MQTTREASONCODE_SUCCESS;
+
+    rc = MQTTV5Deserialize_ack(&type, &dup, packetid, &reason, &props,
+                               c->readbuf, c->readbuf_size);
+
+    if (reason >= 0x80) {
+      *result = mqtt_client_reason_to_err(reason);
+    }
+
+    return rc;
+  }
+#endif
+
+  rc = MQTTDeserialize_ack(&type, &dup, packetid, c->readbuf, c->readbuf_size);
+
+  return rc;
+}
+
+static int serializeSubscribe(mqtt_client *c, unsigned short packetid,
+                              int count, MQTTString topics[], int qoss[],
+                              deadline_t deadline) {
+  int len = 0;
+
+#if defined(MQTTV5)
+  if (c->mqtt_version == 5) {
+    MQTTProperties props = MQTTProperties_initializer;
+
+    do {
+      len = MQTTV5Serialize_subscribe(txTail(c), txRoom(c), 0, packetid,
+                                      &props, count, topics, qoss);
+    } while (txRetry(c, len, deadline));
+
+    return len;
+  }
+#endif
+
+  do {
+    len = MQTTSerialize_subscribe(txTail(c), txRoom(c), 0, packetid, count,
+                                  topics, qoss);
+  } while (txRetry(c, len, deadline));
+
+  return len;
+}
+
+/* Granted QoS per topic, 0x80 and above means the topic was refused */
+static int deserializeSuback(mqtt_client *c, unsigned short *packetid,
+                             int maxcount, int *count, int granted[]) {
+#if defined(MQTTV5)
+  if (c->mqtt_version == 5) {
+    MQTTProperties props = MQTTProperties_initializer;
+
+    return MQTTV5Deserialize_suback(packetid, &props, maxcount, count, granted,
+                                    c->readbuf, c->readbuf_size);
+  }
+#endif
+
+  return MQTTDeserialize_suback(packetid, maxcount, count, granted, c->readbuf,
+                                c->readbuf_size);
+}
+
+static int serializeUnsubscribe(mqtt_client *c, unsigned short packetid,
+                                MQTTString *topic, deadline_t deadline) {
+  int len = 0;
+
+#if defined(MQTTV5)
+  if (c->mqtt_version == 5) {
+    MQTTProperties props = MQTTProperties_initializer;
+
+    do {
+      len = MQTTV5Serialize_unsubscribe(txTail(c), txRoom(c), 0, packetid,
+                                        &props, 1, topic);
+    } while (txRetry(c, len, deadline));
+
+    return len;
+  }
+#endif
+
+  do {
+    len = MQTTSerialize_unsubscribe(txTail(c), txRoom(c), 0, packetid, 1,
+                                    topic);
+  } while (txRetry(c, len, deadline));
+
+  return len;
+}
+
+static int deserializeUnsuback(mqtt_client *c, unsigned short *packetid) {
+#if defined(MQTTV5)
+  if (c->mqtt_version == 5) {
+    MQTTProperties props = MQTTProperties_initializer;
+    int count = 0, reason = 0;
+
+    return MQTTV5Deserialize_unsuback(packetid, &props, 1, &count, &reason,
+                                      c->readbuf, c->readbuf_size);
+  }
+#endif
+
+  return MQTTDeserialize_unsuback(packetid, c->readbuf, c->readbuf_size);
+}
+
 void *mqtt_client_init(mqtt_network *network, unsigned char *sendbuf,
                        size_t sendbuf_size, unsigned char *readbuf,
                        size_t readbuf_size) {
-  int i;
   mqtt_client *c = NULL;
 
   c = (mqtt_client *)osl_malloc(sizeof(*c));
 
-  if (NULL == c) {
-    return NULL;
+  if (NULL == c) {
+    return NULL;
+  }
+
+  osl_memset(c, 0, sizeof(*c));
+
+  c->ipstack = network;
+
+  topic_trie_init(&c->message_handlers);
+
+  c->buf = sendbuf;
+  c->buf_size = sendbuf_size;
+  c->readbuf = readbuf;
+  c->readbuf_size = readbuf_size;
+  c->isconnected = 0;
+  c->cleansession = 0;
+  c->ping_outstanding = 0;
+
+  osl_memset(&c->defaultHandler, 0, sizeof(c->defaultHandler));
+  c->next_packetid = 1;
+
+  c->rx_head = c->rx_tail = 0;
+  c->rx_trp.getfn = stagedRead;
+  c->rx_trp.sck = c;
+  c->rx_trp.state = 0;
+
+  c->inflight_cnt = 0;
+  c->inflight_window = MQTT_MAX_INFLIGHT;
+  c->inflight_retry_ms = MQTT_INFLIGHT_RETRY_MS;
+
+  c->tx_len = 0;
+  c->tx_flush_bytes = 0;
+  c->tx_flush_ms = 0;
+
+  c->store = NULL;
+  c->store_next_key = 1;
+  c->replay_keys = NULL;
+  c->replay_cnt = c->replay_pos = 0;
+
+#if defined(MQTTV5)
+  c->mqtt_version = 4;
+  c->receive_max = MAX_PACKET_ID;
+  c->max_packet_size = 0;
+  c->topic_alias_max = 0;
+  c->topic_alias_cnt = 0;
+#endif
+
+  return c;
+}
+
+void mqtt_client_deinit(void *client) {
+  if (client) {
+    failAllInflight((mqtt_client *)client);
+    topic_trie_clear(&((mqtt_client *)client)->message_handlers);
+
+    if (((mqtt_client *)client)->topic_scratch) {
+      osl_free(((mqtt_client *)client)->topic_scratch);
+    }
+
+    if (((mqtt_client *)client)->replay_keys) {
+      osl_free(((mqtt_client *)client)->replay_keys);
+    }
+#if defined(MQTTV5)
+    resetTopicAliases((mqtt_client *)client);
+#endif
+    osl_free(client);
+  }
+}
+
+/* Bytes the transport has received but not returned yet, a TLS record holding
+ * several packets is decrypted as a whole */
+static int transportPending(mqtt_client *c) {
+  return c->ipstack->pending && c->ipstack->pending(c->ipstack->handle) > 0;
+}
+
+/**
+ * Transport callback for MQTTPacket_readnb(). Serves bytes from the staging
+ * area and refills it with a single transport read when it runs dry, so the
+ * header byte and the remaining length no longer cost one read each. Bulk
+ * packet bodies bypass the staging area and are read straight into readbuf.
+ */
+static int stagedRead(void *sck, unsigned char *buf, int count) {
+  mqtt_client *c = (mqtt_client *)sck;
+  int avail = c->rx_tail - c->rx_head;
+  int rc = 0;
+
+  if (avail == 0) {
+    uint32_t wait_ms = deadline_left(c->rx_deadline);
+
+    if (transportPending(c)) {
+      /* already received, the read below does not wait */
+      wait_ms = 0;
+    } else if (wait_ms == 0) {
+      return 0;
+    } else if (c->tx_len > 0) {
+      /* don't sleep on the socket past the moment queued output is due */
+      uint64_t now = time_count_ms();
+      uint64_t due = c->tx_first_at + c->tx_flush_ms;
+
+      if (due <= now) {
+        return 0;
+      } else if (due - now < wait_ms) {
+        wait_ms = (uint32_t)(due - now);
+      }
+    }
+
+    if (count >= MQTT_RX_STAGE_LEN) {
+      rc = c->ipstack->mqttread(c->ipstack->handle, buf, count, wait_ms);
+    } else {
+      rc = c->ipstack->mqttread(c->ipstack->handle, c->rx_stage,
+                                MQTT_RX_STAGE_LEN, wait_ms);
+    }
+
+    if (rc < 0) {
+      c->rx_error = 1;
+      return -1;
+    }
+
+    if (count >= MQTT_RX_STAGE_LEN || rc == 0) {
+      return rc;
+    }
+
+    c->rx_head = 0;
+    c->rx_tail = avail = rc;
+  }
+
+  if (count > avail) {
+    count = avail;
+  }
+
+  memcpy(buf, &c->rx_stage[c->rx_head], count);
+  c->rx_head += count;
+
+  return count;
+}
+
+static int readPacket(mqtt_client *c, deadline_t deadline) {
+  int rc = 0;
+
+  c->rx_deadline = deadline;
+  c->rx_error = 0;
+
+  /* a packet split across reads keeps its progress in rx_trp, so a timeout in
+   * the middle of a packet no longer desynchronizes the stream */
+  do {
+    if (txFlushDue(c) && flushQueue(c, deadline) != SUCCESS) {
+      rc = FAILURE;
+      goto exit;
+    }
+
+    if (c->rx_big.left > 0) {
+      rc = readOversized(c, deadline);
+    } else if ((rc = MQTTPacket_readnb(c->readbuf, c->readbuf_size,
+                                       &c->rx_trp)) == MQTTPACKET_READ_ERROR &&
+               !c->rx_error &&
+               c->rx_trp.len + c->rx_trp.rem_len > (int)c->readbuf_size) {
+      /* only the fixed header has been read, the rest follows in pieces */
+      MQTTHeader header = {0};
+
+      header.byte = c->readbuf[0];
+      osl_memset(&c->rx_big, 0, sizeof(c->rx_big));
+      c->rx_big.left = c->rx_big.rem_len = (uint32_t)c->rx_trp.rem_len;
+      c->rx_big.header = header.byte;
+
+      if (header.bits.type != PUBLISH) {
+        loge("Mqtt packet type %d of %u bytes dropped, receive buffer too small",
+             header.bits.type, (unsigned)c->rx_big.rem_len);
+        c->rx_big.head = -1;
+      }
+
+      rc = 0;
+    }
+  } while (rc == 0 && !deadline_is_expired(deadline));
+
+  if (rc == MQTTPACKET_READ_ERROR) {
+    goto exit;
+  }
+
+  if (rc > 0) c->last_recv_at = time_count_ms();
+
+exit:
+  return rc;
+}
+
+/* Copy the topic into the client scratch buffer for handlers that expect a
+ * C string. The buffer only grows, so steady traffic does not touch the heap */
+static const char *topicString(mqtt_client *c, MQTTString *topicName) {
+  size_t data_len = topicName->lenstring.len;
+
+  if (data_len + 1 > c->topic_scratch_size) {
+    char *scratch = osl_malloc(data_len + 1);
+
+    if (NULL == scratch) {
+      return NULL;
+    }
+
+    if (c->topic_scratch) {
+      osl_free(c->topic_scratch);
+    }
+
+    c->topic_scratch = scratch;
+    c->topic_scratch_size = data_len + 1;
+  }
+
+  osl_memcpy(c->topic_scratch, topicName->lenstring.data, data_len);
+  c->topic_scratch[data_len] = '\0';
+
+  return c->topic_scratch;
+}
+
+static int deliverMessage(mqtt_client *c, MQTTString *topicName,
+                          struct mqtt_message_t *message) {
+  const struct topic_trie_handler *handler = NULL;
+  const char *topic = NULL;
+
+  // we have to find the right message handler - indexed by topic
+  if (NULL == (handler = topic_trie_match(&c->message_handlers,
+                                          topicName->lenstring.data,
+                                          topicName->lenstring.len))) {
+    handler = &c->defaultHandler;
   }
 
-  osl_memset(c, 0, sizeof(*c));
+  if (handler->view_fp) {
+    handler->view_fp(handler->arg, (const uint8_t *)topicName->lenstring.data,
+                     topicName->lenstring.len, message);
+  } else if (handler->chunk_fp) {
+    if (NULL == (topic = topicString(c, topicName))) {
+      return FAILURE;
+    }
 
-  c->ipstack = network;
+    handler->chunk_fp(handler->arg, (const uint8_t *)topic, message, 0,
+                      message->payload_len);
+  } else if (handler->fp) {
+    if (NULL == (topic = topicString(c, topicName))) {
+      return FAILURE;
+    }
 
-  for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
-    c->message_handlers[i].topic_filter = 0;
+    handler->fp(handler->arg, (const uint8_t *)topic, message);
+  } else {
+    return FAILURE;
   }
 
-  c->buf = sendbuf;
-  c->buf_size = sendbuf_size;
-  c->readbuf = readbuf;
-  c->readbuf_size = readbuf_size;
-  c->isconnected = 0;
-  c->cleansession = 0;
-  c->ping_outstanding = 0;
+  return SUCCESS;
+}
 
-  c->defaultHandler.fp = NULL;
-  c->next_packetid = 1;
-  c->keepalive_count = countdown_start(0);
+static int deserializePublish(mqtt_client *c, MQTTString *topicName,
+                              struct mqtt_message_t *msg) {
+  int int_qos = 0;
+  int rc = 0;
 
-  return c;
-}
+  msg->payload_len =
+      0; /* this is a size_t, but deserialize publish sets this as int */
 
-void mqtt_client_deinit(void *client) {
-  if (client) {
-    countdown_stop(((mqtt_client *)client)->keepalive_count);
-    osl_free(client);
+#if defined(MQTTV5)
+  if (c->mqtt_version == 5) {
+    /* CONNECT announces no topic alias maximum, so inbound topics are always
+     * spelled out and the properties can be skipped */
+    MQTTProperties props = MQTTProperties_initializer;
+
+    rc = MQTTV5Deserialize_publish(&msg->dup, &int_qos, &msg->retained,
+                                   &msg->id, topicName, &props,
+                                   (unsigned char **)&msg->payload,
+                                   (int *)&msg->payload_len, c->readbuf,
+                                   c->readbuf_size);
+    msg->qos = (enum mqtt_qos_e)int_qos;
+
+    return rc;
   }
+#endif
+
+  rc = MQTTDeserialize_publish(&msg->dup, &int_qos, &msg->retained, &msg->id,
+                               topicName, (unsigned char **)&msg->payload,
+                               (int *)&msg->payload_len, c->readbuf,
+                               c->readbuf_size);
+  msg->qos = (enum mqtt_qos_e)int_qos;
+
+  return rc;
 }
 
-static int decodePacket(mqtt_client *c, int *value, int timeout) {
-  unsigned char i;
-  int multiplier = 1;
+/* PUBACK or PUBREC for an inbound QoS1/QoS2 PUBLISH */
+static int ackPublish(mqtt_client *c, struct mqtt_message_t *msg,
+                      deadline_t deadline) {
   int len = 0;
-  const int k_max_no_of_remaining_length_bytes = 4;
 
-  *value = 0;
+  if (msg->qos == MQTT_QOS0) {
+    return SUCCESS;
+  }
 
   do {
-    int rc = MQTTPACKET_READ_ERROR;
-
-    if (++len > k_max_no_of_remaining_length_bytes) {
-      rc = MQTTPACKET_READ_ERROR; /* bad data */
-      goto exit;
-    }
-
-    rc = c->ipstack->mqttread(c->ipstack->handle, &i, 1, timeout);
-
-    if (rc != 1) {
-      goto exit;
-    }
+    len = MQTTSerialize_ack(txTail(c), txRoom(c),
+                            (msg->qos == MQTT_QOS1) ? PUBACK : PUBREC, 0,
+                            msg->id);
+  } while (txRetry(c, len, deadline));
 
-    *value += (i & 127) * multiplier;
-    multiplier *= 128;
-  } while ((i & 128) != 0);
+  if (len <= 0) {
+    return FAILURE;
+  }
 
-exit:
-  return len;
+  return queuePacket(c, len, deadline);
 }
 
-static int readPacket(mqtt_client *c, handle_t cd_handle) {
+/* Parse the variable header of an oversized PUBLISH from the first len bytes
+ * of readbuf and pick its handler. Returns where the payload starts in
+ * readbuf, -1 when the header does not fit and the packet can only be
+ * dropped. */
+static int parseOversized(mqtt_client *c, int len) {
+  struct OversizedPacket *p = &c->rx_big;
+  unsigned char *ptr = c->readbuf;
+  unsigned char *end = c->readbuf + len;
+  const struct topic_trie_handler *handler = NULL;
+  MQTTString topicName = MQTTString_initializer;
   MQTTHeader header = {0};
-  int len = 0;
-  int rem_len = 0;
+  int topic_len = 0;
 
-  /* 1. read the header byte.  This has the packet type in it */
-  int rc = c->ipstack->mqttread(c->ipstack->handle, c->readbuf, 1,
-                                countdown_left(cd_handle));
+  header.byte = p->header;
+  p->msg.dup = header.bits.dup;
+  p->msg.retained = header.bits.retain;
 
-  if (rc != 1) {
-    goto exit;
+  if (end - ptr < 2 || (topic_len = readInt(&ptr)) > end - ptr) {
+    goto drop;
   }
 
-  len = 1;
-  /* 2. read the remaining length.  This is variable in itself */
-  decodePacket(c, &rem_len, countdown_left(cd_handle));
-  len += MQTTPacket_encode(
-      c->readbuf + 1,
-      rem_len); /* put the original remaining length back into the buffer */
+  topicName.lenstring.data = (char *)ptr;
+  topicName.lenstring.len = topic_len;
+  ptr += topic_len;
 
-  if (rem_len > (c->readbuf_size - len)) {
-    rc = BUFFER_OVERFLOW;
-    goto exit;
+  if (header.bits.qos > 0) {
+    if (end - ptr < 2) {
+      goto drop;
+    }
+
+    p->msg.id = (uint16_t)readInt(&ptr);
   }
 
-  /* 3. read the rest of the buffer using a callback to supply the rest of the
-   * data */
+#if defined(MQTTV5)
+  if (c->mqtt_version == 5) {
+    /* inbound topics never use an alias, the properties are skipped */
+    int props_len = 0, multiplier = 1;
+    unsigned char byte = 0;
+
+    do {
+      if (ptr >= end || multiplier > 128 * 128 * 128) {
+        goto drop;
+      }
 
-  if (rem_len > 0) {
-    rc = c->ipstack->mqttread(c->ipstack->handle, c->readbuf + len, rem_len,
-                              countdown_left(cd_handle));
+      byte = *ptr++;
+      props_len += (byte & 127) * multiplier;
+      multiplier *= 128;
+    } while (byte & 128);
 
-    if (rc != rem_len) {
-      rc = 0;
-      goto exit;
+    if (props_len > end - ptr) {
+      goto drop;
     }
+
+    ptr += props_len;
   }
+#endif
 
-  header.byte = c->readbuf[0];
-  rc = header.bits.type;
+  p->msg.qos = (enum mqtt_qos_e)header.bits.qos;
+  p->total = p->rem_len - (uint32_t)(ptr - c->readbuf);
 
-  if (c->keepAliveInterval > 0)
-    countdown_set(c->keepalive_count, c->keepAliveInterval * 1000);
+  if (NULL == (handler = topic_trie_match(&c->message_handlers,
+                                          topicName.lenstring.data,
+                                          topicName.lenstring.len))) {
+    handler = &c->defaultHandler;
+  }
 
-exit:
-  return rc;
+  if (handler->chunk_fp && topicString(c, &topicName) != NULL) {
+    p->handler = *handler;
+  } else {
+    logw("Mqtt publish of %u bytes on %.*s dropped, receive buffer too small",
+         (unsigned)p->total, topic_len, topicName.lenstring.data);
+  }
+
+  return (int)(ptr - c->readbuf);
+
+drop:
+  loge("Mqtt publish dropped, header larger than the receive buffer");
+  return -1;
 }
 
-// assume topic filter and name is in correct format
-// # can only be at end
-// + and # can only be next to separator
-static char isTopicMatched(char *topic_filter, MQTTString *topicName) {
-  char *curf = topic_filter;
-  char *curn = topicName->lenstring.data;
-  char *curn_end = curn + topicName->lenstring.len;
+static void deliverChunk(mqtt_client *c, unsigned char *buf, int len) {
+  struct OversizedPacket *p = &c->rx_big;
 
-  while (*curf && curn < curn_end) {
-    if (*curn == '/' && *curf != '/') {
-      break;
-    }
+  if (p->handler.chunk_fp && len > 0) {
+    p->msg.payload = buf;
+    p->msg.payload_len = (uint32_t)len;
+    p->handler.chunk_fp(p->handler.arg, (const uint8_t *)c->topic_scratch,
+                        &p->msg, p->offset, p->total);
+  }
 
-    if (*curf != '+' && *curf != '#' && *curf != *curn) {
-      break;
-    }
+  p->offset += len;
+}
 
-    if (*curf == '+') {
-      // skip until we meet the next separator, or end of string
-      char *nextpos = curn + 1;
+/* Continue the oversized packet in rx_big: first collect as much of it as
+ * readbuf holds to parse the PUBLISH header, then pass the payload on in
+ * readbuf sized pieces. Returns 0 when the deadline hits before the end, the
+ * packet resumes on the next read. */
+static int readOversized(mqtt_client *c, deadline_t deadline) {
+  struct OversizedPacket *p = &c->rx_big;
+  int offset = 0, room = 0, n = 0, start = 0;
 
-      while (nextpos < curn_end && *nextpos != '/') {
-        nextpos = ++curn + 1;
-      }
-    } else if (*curf == '#') {
-      curn = curn_end - 1;  // skip until end of string
+  while (p->left > 0) {
+    offset = (p->head >= 0) ? p->head : 0;
+    room = (int)c->readbuf_size - offset;
+
+    if (room > (int)p->left) {
+      room = (int)p->left;
     }
 
-    curf++;
-    curn++;
-  };
+    if ((n = stagedRead(c, c->readbuf + offset, room)) <= 0) {
+      return n < 0 ? FAILURE : 0;
+    }
 
-  return (curn == curn_end) && (*curf == '\0');
-}
+    p->left -= n;
+    c->last_recv_at = time_count_ms();
 
-static int deliverMessage(mqtt_client *c, MQTTString *topicName,
-                          struct mqtt_message_t *message) {
-  int i;
-  int rc = FAILURE;
-  mqtt_message_handler fp = NULL;
-  void *arg = NULL;
+    if (p->head < 0) {
+      deliverChunk(c, c->readbuf, n);
+    } else if ((p->head += n) == (int)c->readbuf_size || p->left == 0) {
+      n = p->head;
+      p->head = -1;
 
-  // we have to find the right message handler - indexed by topic
-  for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
-    if (c->message_handlers[i].topic_filter != 0 &&
-        (MQTTPacket_equals(topicName,
-                           (char *)c->message_handlers[i].topic_filter) ||
-         isTopicMatched((char *)c->message_handlers[i].topic_filter,
-                        topicName))) {
-      if (c->message_handlers[i].fp != NULL) {
-        fp = c->message_handlers[i].fp;
-        arg = c->message_handlers[i].arg;
-        rc = SUCCESS;
+      if ((start = parseOversized(c, n)) >= 0) {
+        deliverChunk(c, c->readbuf + start, n - start);
       }
     }
   }
-  if (rc == FAILURE) {
-    fp = c->defaultHandler.fp;
-    arg = c->defaultHandler.arg;
-  }
-  if (fp) {
-    int data_len = topicName->lenstring.len;
-    char *data = NULL;
-    if (NULL != (data = malloc(data_len + 1))) {
-      memset(data, 0, data_len + 1);
-      memcpy(data, topicName->lenstring.data, data_len);
-      fp(arg, (const uint8_t *)data, message);
-      free(data);
-    }
-    rc = SUCCESS;
-  }
 
-  return rc;
+  /* QoS0 as well when the header could not be parsed, there is no id to ack */
+  return ackPublish(c, &p->msg, deadline) == SUCCESS ? 0 : FAILURE;
 }
 
 static int keepalive(mqtt_client *c) {
+  uint64_t interval = (uint64_t)c->keepAliveInterval * 1000;
+  uint64_t now = time_count_ms();
   int rc = SUCCESS;
 
   if (c->keepAliveInterval == 0) {
@@ -318,25 +1307,32 @@ static int keepalive(mqtt_client *c) {
    * heartbeat，Otherwise an error is reported，Prevent delayed resp making
    * heartbeat fail
    */
-  if (countdown_is_expired(c->keepalive_count)) {
-    if (c->ping_outstanding) {
-      rc = FAILURE; /* PINGRESP not received in keepalive interval */
-    } else {
-      handle_t countdown_hdl = countdown_start(2000);
+  if (c->ping_outstanding) {
+    /* PINGRESP not received and nothing else heard for a whole interval */
+    if (now >= c->ping_sent_at + interval && now >= c->last_recv_at + interval)
+      rc = FAILURE;
+    goto exit;
+  }
 
-      int len = MQTTSerialize_pingreq(c->buf, c->buf_size);
+  /* a link busy sending needs no ping; one that only sends is still probed
+   * now and then, as a dead peer would otherwise go unnoticed */
+  if (now < c->last_sent_at + interval &&
+      now < c->last_recv_at + interval * MQTT_KEEPALIVE_RX_IDLE) {
+    goto exit;
+  }
 
-      if (len > 0 && (rc = sendPacket(c, len, countdown_hdl)) ==
-                         SUCCESS)  // send the ping packet
-      {
-        c->ping_outstanding = 1;
-        countdown_set(
-            c->keepalive_count,
-            c->keepAliveInterval * 1000);  // record the fact that we have
-                                           // successfully sent the packet
-      }
+  {
+    deadline_t ping_deadline = deadline_start(2000);
+    int len = 0;
 
-      countdown_stop(countdown_hdl);
+    do {
+      len = MQTTSerialize_pingreq(txTail(c), txRoom(c));
+    } while (txRetry(c, len, ping_deadline));
+
+    /* the ping also carries out whatever is still queued */
+    if (len > 0 && (rc = sendPacket(c, len, ping_deadline)) == SUCCESS) {
+      c->ping_outstanding = 1;
+      c->ping_sent_at = time_count_ms();
     }
   }
 
@@ -345,27 +1341,27 @@ exit:
 }
 
 static void MQTTCleanSession(mqtt_client *c) {
-  int i = 0;
-
-  for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
-    c->message_handlers[i].topic_filter = NULL;
-  }
+  topic_trie_clear(&c->message_handlers);
 }
 
 static void MQTTCloseSession(mqtt_client *c) {
   c->ping_outstanding = 0;
   c->isconnected = 0;
+  c->tx_len = 0;
+
+  closeInflight(c);
+  c->replay_cnt = c->replay_pos = 0;
 
   if (c->cleansession) {
     MQTTCleanSession(c);
   }
 }
 
-static int cycle(mqtt_client *c, handle_t cd_handle) {
+static int cycle(mqtt_client *c, deadline_t deadline) {
   int len = 0, rc = SUCCESS;
 
   int packet_type =
-      readPacket(c, cd_handle); /* read the socket, see what work is due */
+      readPacket(c, deadline); /* read the socket, see what work is due */
 
   switch (packet_type) {
     default:
@@ -378,44 +1374,40 @@ static int cycle(mqtt_client *c, handle_t cd_handle) {
       break;
 
     case CONNACK:
-    case PUBACK:
     case SUBACK:
     case UNSUBACK:
       break;
 
+    case PUBACK: {
+      unsigned short mypacketid;
+      int result = SUCCESS;
+      struct InflightMessage *m = NULL;
+
+      if (c->inflight_cnt > 0 &&
+          deserializeAck(c, &mypacketid, &result) == 1 &&
+          (m = findInflight(c, mypacketid)) != NULL) {
+        if (m->key != 0) {
+          c->store->remove(c->store->handle, m->key);
+        }
+
+        completeInflight(c, m, result);
+      }
+
+      break;
+    }
+
     case PUBLISH: {
       MQTTString topicName;
       struct mqtt_message_t msg = {0};
-      int int_qos;
-      msg.payload_len =
-          0; /* this is a size_t, but deserialize publish sets this as int */
-
-      if (MQTTDeserialize_publish(&msg.dup, &int_qos, &msg.retained, &msg.id,
-                                  &topicName, (unsigned char **)&msg.payload,
-                                  (int *)&msg.payload_len, c->readbuf,
-                                  c->readbuf_size) != 1) {
+
+      if (deserializePublish(c, &topicName, &msg) != 1) {
         goto exit;
       }
 
-      msg.qos = (enum mqtt_qos_e)int_qos;
       deliverMessage(c, &topicName, &msg);
 
-      if (msg.qos != MQTT_QOS0) {
-        if (msg.qos == MQTT_QOS1) {
-          len = MQTTSerialize_ack(c->buf, c->buf_size, PUBACK, 0, msg.id);
-        } else if (msg.qos == MQTT_QOS2) {
-          len = MQTTSerialize_ack(c->buf, c->buf_size, PUBREC, 0, msg.id);
-        }
-
-        if (len <= 0) {
-          rc = FAILURE;
-        } else {
-          rc = sendPacket(c, len, cd_handle);
-        }
-
-        if (rc == FAILURE) {
-          goto exit;  // there was a problem
-        }
+      if ((rc = ackPublish(c, &msg, deadline)) == FAILURE) {
+        goto exit;  // there was a problem
       }
 
       break;
@@ -424,17 +1416,22 @@ static int cycle(mqtt_client *c, handle_t cd_handle) {
     case PUBREC:
     case PUBREL: {
       unsigned short mypacketid;
-      unsigned char dup, type;
+      int result = SUCCESS;
 
-      if (MQTTDeserialize_ack(&type, &dup, &mypacketid, c->readbuf,
-                              c->readbuf_size) != 1) {
+      if (deserializeAck(c, &mypacketid, &result) != 1) {
         rc = FAILURE;
-      } else if ((len = MQTTSerialize_ack(
-                      c->buf, c->buf_size,
-                      (packet_type == PUBREC) ? PUBREL : PUBCOMP, 0,
-                      mypacketid)) <= 0) {
+        goto exit;
+      }
+
+      do {
+        len = MQTTSerialize_ack(txTail(c), txRoom(c),
+                                (packet_type == PUBREC) ? PUBREL : PUBCOMP, 0,
+                                mypacketid);
+      } while (txRetry(c, len, deadline));
+
+      if (len <= 0) {
         rc = FAILURE;
-      } else if ((rc = sendPacket(c, len, cd_handle)) !=
+      } else if ((rc = queuePacket(c, len, deadline)) !=
                  SUCCESS)  // send the PUBREL packet
       {
         rc = FAILURE;  // there was a problem
@@ -451,9 +1448,32 @@ static int cycle(mqtt_client *c, handle_t cd_handle) {
       break;
 
     case PINGRESP:
-      logi("keep alive ok");
+      if (c->ping_outstanding) {
+        uint32_t rtt = (uint32_t)(time_count_ms() - c->ping_sent_at);
+
+        if (rtt == 0) rtt = 1; /* 0 is kept for "no sample yet" */
+
+        /* smoothed like TCP's SRTT, 1/8 of every new sample */
+        c->ping_srtt_ms =
+            c->ping_srtt_ms ? (c->ping_srtt_ms * 7 + rtt) / 8 : rtt;
+        c->ping_rtt_ms = rtt;
+        logi("keep alive ok, rtt %u ms", (unsigned)rtt);
+      }
       c->ping_outstanding = 0;
       break;
+
+#if defined(MQTTV5)
+    case DISCONNECT: {
+      /* an MQTT 5.0 server says why before it closes the connection */
+      unsigned char *ptr = c->readbuf + 1;
+      int rem_len = 0;
+
+      ptr += MQTTPacket_decodeBuf(ptr, &rem_len);
+      loge("Mqtt server disconnect, reason 0x%02x", rem_len > 0 ? *ptr : 0);
+      rc = FAILURE;
+      goto exit;
+    }
+#endif
   }
 
   if (keepalive(c) != SUCCESS) {
@@ -461,6 +1481,9 @@ static int cycle(mqtt_client *c, handle_t cd_handle) {
     // be considered as FAULT
     loge("Mqtt keep alive time out!");
     rc = FAILURE;
+  } else if (resendInflight(c, deadline) != SUCCESS ||
+             replayOutbox(c, deadline) != SUCCESS) {
+    rc = FAILURE;
   }
 
 exit:
@@ -477,38 +1500,124 @@ exit:
 int32_t mqtt_client_yield(void *client, int32_t timeout_ms) {
   mqtt_client *c = (mqtt_client *)client;
   int rc = SUCCESS;
-  handle_t yield_cd_hdl = 0;
+  deadline_t yield_deadline = 0;
 
-  yield_cd_hdl = countdown_start(timeout_ms);
+  yield_deadline = deadline_start(timeout_ms);
 
-  if (0 > cycle(c, yield_cd_hdl)) {
-    rc = FAILURE;
-  }
+  /* packets already sitting in the staging area or in the transport are
+   * handled in the same yield instead of waiting for the next one */
+  do {
+    if (0 > (rc = cycle(c, yield_deadline))) {
+      rc = FAILURE;
+      break;
+    }
+  } while (rc > 0 && (c->rx_tail > c->rx_head || transportPending(c)) &&
+           !deadline_is_expired(yield_deadline));
 
-  countdown_stop(yield_cd_hdl);
+  if (rc > 0) {
+    rc = SUCCESS;
+  }
 
   return rc;
 }
 
-static int waitfor(mqtt_client *c, int packet_type, handle_t cd_handle) {
+static int waitfor(mqtt_client *c, int packet_type, deadline_t deadline) {
   int rc = FAILURE;
 
   do {
-    if (countdown_is_expired(cd_handle)) {
+    if (deadline_is_expired(deadline)) {
       break;  // we timed out
     }
 
-    rc = cycle(c, cd_handle);
+    rc = cycle(c, deadline);
   } while (rc != packet_type && rc >= 0);
 
   return rc;
 }
 
+static int serializeConnect(mqtt_client *c, MQTTPacket_connectData *options) {
+#if defined(MQTTV5)
+  c->mqtt_version = (options->MQTTVersion == 5) ? 5 : 4;
+  c->receive_max = MAX_PACKET_ID;
+  c->max_packet_size = 0;
+  c->topic_alias_max = 0;
+  resetTopicAliases(c);
+
+  if (c->mqtt_version == 5) {
+    MQTTProperty array[2];
+    MQTTProperties props = MQTTProperties_initializer;
+
+    props.max_count = sizeof(array) / sizeof(array[0]);
+    props.array = array;
+
+    /* the server drops what would not fit into readbuf instead of sending it
+     * and making us close the session */
+    array[0].identifier = MQTTPROPERTY_CODE_MAXIMUM_PACKET_SIZE;
+    array[0].value.integer4 = (unsigned int)c->readbuf_size;
+    MQTTProperties_add(&props, &array[0]);
+
+    /* without an expiry interval the session ends with the connection */
+    if (!options->cleansession) {
+      array[1].identifier = MQTTPROPERTY_CODE_SESSION_EXPIRY_INTERVAL;
+      array[1].value.integer4 = MQTT_SESSION_EXPIRY;
+      MQTTProperties_add(&props, &array[1]);
+    }
+
+    return MQTTV5Serialize_connect(c->buf, c->buf_size, options, &props, NULL);
+  }
+#endif
+
+  return MQTTSerialize_connect(c->buf, c->buf_size, options);
+}
+
+static int deserializeConnack(mqtt_client *c, mqtt_conn_ack_data *data) {
+#if defined(MQTTV5)
+  if (c->mqtt_version == 5) {
+    MQTTProperty array[8];
+    MQTTProperties props = MQTTProperties_initializer;
+    int value = 0;
+
+    props.max_count = sizeof(array) / sizeof(array[0]);
+    props.array = array;
+
+    if (MQTTV5Deserialize_connack(&props, &data->sessionPresent, &data->rc,
+                                  c->readbuf, c->readbuf_size) != 1) {
+      return 0;
+    }
+
+    if ((value = MQTTProperties_getNumericValue(
+             &props, MQTTPROPERTY_CODE_RECEIVE_MAXIMUM)) > 0) {
+      c->receive_max = value;
+    }
+
+    if ((value = MQTTProperties_getNumericValue(
+             &props, MQTTPROPERTY_CODE_MAXIMUM_PACKET_SIZE)) > 0) {
+      c->max_packet_size = value;
+    }
+
+    if ((value = MQTTProperties_getNumericValue(
+             &props, MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM)) > 0) {
+      c->topic_alias_max =
+          (value < MQTT_TOPIC_ALIAS_MAX) ? value : MQTT_TOPIC_ALIAS_MAX;
+    }
+
+    if (c->inflight_window > c->receive_max) {
+      c->inflight_window = c->receive_max;
+    }
+
+    return 1;
+  }
+#endif
+
+  return MQTTDeserialize_connack(&data->sessionPresent, &data->rc, c->readbuf,
+                                 c->readbuf_size);
+}
+
 int32_t mqtt_client_connect_with_results(void *client,
                                          MQTTPacket_connectData *options,
                                          mqtt_conn_ack_data *data,
                                          uint32_t timeout_ms) {
-  handle_t connect_cd_hdl = 0;
+  deadline_t connect_deadline = 0;
   int rc = FAILURE;
   MQTTPacket_connectData default_options = MQTTPacket_connectData_initializer;
   mqtt_client *c = (mqtt_client *)client;
@@ -520,7 +1629,7 @@ int32_t mqtt_client_connect_with_results(void *client,
     goto exit;
   }
 
-  connect_cd_hdl = countdown_start(timeout_ms);
+  connect_deadline = deadline_start(timeout_ms);
 
   if (options == 0) {
     options = &default_options; /* set default options if none were supplied */
@@ -528,25 +1637,30 @@ int32_t mqtt_client_connect_with_results(void *client,
 
   c->keepAliveInterval = options->keepAliveInterval;
   c->cleansession = options->cleansession;
+  c->tx_len = 0;
 
-  if ((len = MQTTSerialize_connect(c->buf, c->buf_size, options)) <= 0) {
+  if ((len = serializeConnect(c, options)) <= 0) {
     goto exit;
   }
 
-  if ((rc = sendPacket(c, len, connect_cd_hdl)) !=
+  if ((rc = sendPacket(c, len, connect_deadline)) !=
       SUCCESS)  // send the connect packet
   {
     goto exit;  // there was a problem
   }
 
   // this will be a blocking call, wait for the connack
-  if (waitfor(c, CONNACK, connect_cd_hdl) == CONNACK) {
+  if (waitfor(c, CONNACK, connect_deadline) == CONNACK) {
     data->rc = 0;
     data->sessionPresent = 0;
 
-    if (MQTTDeserialize_connack(&data->sessionPresent, &data->rc, c->readbuf,
-                                c->readbuf_size) == 1) {
+    if (deserializeConnack(c, data) == 1) {
       rc = data->rc;
+#if defined(MQTTV5)
+      if (c->mqtt_version == 5 && rc >= 0x80) {
+        rc = mqtt_client_reason_to_err(data->rc);
+      }
+#endif
     } else {
       loge("Mqtt connect respond deserialize error!");
       rc = FAILURE;
@@ -557,12 +1671,17 @@ int32_t mqtt_client_connect_with_results(void *client,
   }
 
 exit:
-  countdown_stop(connect_cd_hdl);
-
   if (rc == SUCCESS) {
     c->isconnected = 1;
     c->ping_outstanding = 0;
-    countdown_set(c->keepalive_count, c->keepAliveInterval * 1000);
+    c->last_recv_at = time_count_ms();
+
+    /* whether or not the server kept the session, what it never acknowledged
+     * goes out again before anything new; send errors show up in yield */
+    if (c->store) {
+      loadOutbox(c);
+      replayOutbox(c, connect_deadline);
+    }
   }
 
   return rc;
@@ -574,45 +1693,96 @@ int32_t mqtt_client_connect(void *client, MQTTPacket_connectData *options,
   return mqtt_client_connect_with_results(client, options, &data, timeout_ms);
 }
 
+static int setHandler(mqtt_client *c, const char *topic_filter,
+                      const struct topic_trie_handler *handler) {
+  if (handler->fp == NULL && handler->view_fp == NULL &&
+      handler->chunk_fp == NULL) /* remove existing */
+  {
+    return (topic_trie_remove(&c->message_handlers, topic_filter) == 0)
+               ? SUCCESS
+               : FAILURE;
+  }
+
+  return (topic_trie_insert(&c->message_handlers, topic_filter, handler) == 0)
+             ? SUCCESS
+             : FAILURE;
+}
+
 int32_t mqtt_client_set_message_handler(void *client, const char *topic_filter,
                                         message_handler message_handler,
                                         void *arg) {
-  mqtt_client *c = (mqtt_client *)client;
+  struct topic_trie_handler handler = {.fp = message_handler, .arg = arg};
+
+  return setHandler((mqtt_client *)client, topic_filter, &handler);
+}
+
+int32_t mqtt_client_set_topic_view_handler(void *client,
+                                           const char *topic_filter,
+                                           topic_view_handler view_handler,
+                                           void *arg) {
+  struct topic_trie_handler handler = {.view_fp = view_handler, .arg = arg};
+
+  return setHandler((mqtt_client *)client, topic_filter, &handler);
+}
+
+int32_t mqtt_client_set_chunk_handler(void *client, const char *topic_filter,
+                                      chunk_handler chunk_handler, void *arg) {
+  struct topic_trie_handler handler = {.arg = arg,
+                                       .chunk_fp = chunk_handler};
+
+  return setHandler((mqtt_client *)client, topic_filter, &handler);
+}
+
+static int subscribeHandler(mqtt_client *c, const char *topic_filter,
+                            enum mqtt_qos_e qos,
+                            const struct topic_trie_handler *handler,
+                            mqtt_sub_ack_data *data, uint32_t timeout_ms) {
   int rc = FAILURE;
-  int i = -1;
+  deadline_t sub_deadline = 0;
+  int len = 0;
+  int packetid = 0;
+  MQTTString topic = MQTTString_initializer;
+  topic.cstring = (char *)topic_filter;
 
-  /* first check for an existing matching slot */
-  for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
-    if (c->message_handlers[i].topic_filter != NULL &&
-        strcmp(c->message_handlers[i].topic_filter, topic_filter) == 0) {
-      if (message_handler == NULL) /* remove existing */
-      {
-        c->message_handlers[i].topic_filter = NULL;
-        c->message_handlers[i].fp = NULL;
-        c->message_handlers[i].arg = arg;
-      }
+  if (!c->isconnected) {
+    goto exit;
+  }
 
-      rc = SUCCESS; /* return i when adding new subscription */
-      break;
-    }
+  sub_deadline = deadline_start(timeout_ms);
+  packetid = getNextPacketId(c);
+
+  len = serializeSubscribe(c, packetid, 1, &topic, (int *)&qos, sub_deadline);
+
+  if (len <= 0) {
+    goto exit;
   }
 
-  /* if no existing, look for empty slot (unless we are removing) */
-  if (message_handler != NULL) {
-    if (rc == FAILURE) {
-      for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
-        if (c->message_handlers[i].topic_filter == NULL) {
-          rc = SUCCESS;
-          break;
-        }
+  if ((rc = sendPacket(c, len, sub_deadline)) !=
+      SUCCESS)  // send the subscribe packet
+  {
+    goto exit;  // there was a problem
+  }
+
+  if (waitfor(c, SUBACK, sub_deadline) == SUBACK)  // wait for suback
+  {
+    int count = 0;
+    unsigned short mypacketid;
+    data->grantedQoS = MQTT_QOS0;
+
+    if (deserializeSuback(c, &mypacketid, 1, &count,
+                          (int *)&data->grantedQoS) == 1) {
+      if (data->grantedQoS < 0x80) {
+        rc = setHandler(c, topic_filter, handler);
       }
     }
+  } else {
+    loge("Mqtt subscribe respond time out!");
+    rc = FAILURE;
+  }
 
-    if (i < MAX_MESSAGE_HANDLERS) {
-      c->message_handlers[i].topic_filter = topic_filter;
-      c->message_handlers[i].fp = message_handler;
-      c->message_handlers[i].arg = arg;
-    }
+exit:
+  if (rc == FAILURE) {
+    MQTTCloseSession(c);
   }
 
   return rc;
@@ -624,44 +1794,127 @@ int32_t mqtt_client_subscribe_with_results(void *client,
                                            message_handler message_handler,
                                            void *arg, mqtt_sub_ack_data *data,
                                            uint32_t timeout_ms) {
+  struct topic_trie_handler handler = {.fp = message_handler, .arg = arg};
+
+  return subscribeHandler((mqtt_client *)client, topic_filter, qos, &handler,
+                          data, timeout_ms);
+}
+
+int32_t mqtt_client_subscribe(void *c, const char *topic_filter,
+                              enum mqtt_qos_e qos,
+                              message_handler message_handler, void *arg,
+                              uint32_t timeout_ms) {
+  mqtt_sub_ack_data data;
+  return mqtt_client_subscribe_with_results(
+      c, topic_filter, qos, message_handler, arg, &data, timeout_ms);
+}
+
+int32_t mqtt_client_subscribe_view(void *client, const char *topic_filter,
+                                   enum mqtt_qos_e qos,
+                                   topic_view_handler view_handler, void *arg,
+                                   uint32_t timeout_ms) {
+  mqtt_sub_ack_data data;
+  struct topic_trie_handler handler = {.view_fp = view_handler, .arg = arg};
+
+  return subscribeHandler((mqtt_client *)client, topic_filter, qos, &handler,
+                          &data, timeout_ms);
+}
+
+int32_t mqtt_client_subscribe_multi(void *client,
+                                    struct mqtt_subscription_t *subs,
+                                    uint32_t count, uint32_t timeout_ms) {
   mqtt_client *c = (mqtt_client *)client;
   int rc = FAILURE;
-  handle_t sub_cd_hdl = 0;
+  deadline_t sub_deadline = 0;
   int len = 0;
-  MQTTString topic = MQTTString_initializer;
-  topic.cstring = (char *)topic_filter;
+  int packetid = 0;
+  MQTTString *topics = NULL;
+  int *qoss = NULL;
+  struct topic_trie_handler *prev = NULL; /* what each filter had before */
+  int rejected = 0;
+  uint32_t i = 0;
+
+  if (!c->isconnected || NULL == subs || 0 == count) {
+    return FAILURE;
+  }
 
-  if (!c->isconnected) {
+  topics = osl_calloc(count, sizeof(MQTTString));
+  qoss = osl_calloc(count, sizeof(int));
+  prev = osl_calloc(count, sizeof(struct topic_trie_handler));
+
+  if (NULL == topics || NULL == qoss || NULL == prev) {
     goto exit;
   }
 
-  sub_cd_hdl = countdown_start(timeout_ms);
+  for (i = 0; i < count; i++) {
+    topics[i].cstring = (char *)subs[i].topic;
+    qoss[i] = subs[i].qos;
+    subs[i].granted_qos = 0x80;
+  }
+
+  sub_deadline = deadline_start(timeout_ms);
+  packetid = getNextPacketId(c);
 
-  len = MQTTSerialize_subscribe(c->buf, c->buf_size, 0, getNextPacketId(c), 1,
-                                &topic, (int *)&qos);
+  len = serializeSubscribe(c, packetid, count, topics, qoss, sub_deadline);
 
   if (len <= 0) {
+    rc = FAILURE;
     goto exit;
   }
 
-  if ((rc = sendPacket(c, len, sub_cd_hdl)) !=
+  if ((rc = sendPacket(c, len, sub_deadline)) !=
       SUCCESS)  // send the subscribe packet
   {
     goto exit;  // there was a problem
   }
 
-  if (waitfor(c, SUBACK, sub_cd_hdl) == SUBACK)  // wait for suback
+  if (waitfor(c, SUBACK, sub_deadline) == SUBACK)  // wait for suback
   {
-    int count = 0;
+    int granted = 0;
     unsigned short mypacketid;
-    data->grantedQoS = MQTT_QOS0;
 
-    if (MQTTDeserialize_suback(&mypacketid, 1, &count, (int *)&data->grantedQoS,
-                               c->readbuf, c->readbuf_size) == 1) {
-      if (data->grantedQoS != 0x80) {
-        rc = mqtt_client_set_message_handler(c, topic_filter, message_handler,
-                                             arg);
+    /* the granted QoS array is parsed in place of the requested one */
+    if (deserializeSuback(c, &mypacketid, count, &granted, qoss) != 1 ||
+        granted != (int)count) {
+      rc = FAILURE;
+      goto exit;
+    }
+
+    for (i = 0; i < count; i++) {
+      const struct topic_trie_handler *old = NULL;
+      struct topic_trie_handler handler = {.fp = subs[i].msg_handler,
+                                           .view_fp = subs[i].view_handler,
+                                           .arg = subs[i].arg,
+                                           .chunk_fp = subs[i].chunk_handler};
+
+      subs[i].granted_qos = (uint8_t)qoss[i];
+
+      if (subs[i].granted_qos >= 0x80) {
+        rejected++;
+        continue;
+      }
+
+      if (NULL != (old = topic_trie_find(&c->message_handlers,
+                                         (const char *)subs[i].topic))) {
+        prev[i] = *old;
+      }
+
+      if (setHandler(c, (const char *)subs[i].topic, &handler) != SUCCESS) {
+        break;
+      }
+    }
+
+    /* all or nothing: put back what the filters had when the table ran out
+     * of memory part way, newest first so a filter listed twice ends up with
+     * its original handler */
+    if (i < count) {
+      while (i-- > 0) {
+        if (subs[i].granted_qos < 0x80) {
+          setHandler(c, (const char *)subs[i].topic, &prev[i]);
+        }
       }
+
+      rc = FAILURE;
     }
   } else {
     loge("Mqtt subscribe respond time out!");
@@ -669,55 +1922,61 @@ int32_t mqtt_client_subscribe_with_results(void *client,
   }
 
 exit:
-  countdown_stop(sub_cd_hdl);
+  if (topics) {
+    osl_free(topics);
+  }
+
+  if (qoss) {
+    osl_free(qoss);
+  }
+
+  if (prev) {
+    osl_free(prev);
+  }
 
   if (rc == FAILURE) {
     MQTTCloseSession(c);
+  } else if (rejected > 0) {
+    /* the session is fine, the server just refused some of the filters */
+    rc = FAILURE;
   }
 
   return rc;
 }
 
-int32_t mqtt_client_subscribe(void *c, const char *topic_filter,
-                              enum mqtt_qos_e qos,
-                              message_handler message_handler, void *arg,
-                              uint32_t timeout_ms) {
-  mqtt_sub_ack_data data;
-  return mqtt_client_subscribe_with_results(
-      c, topic_filter, qos, message_handler, arg, &data, timeout_ms);
-}
-
 int32_t mqtt_client_unsubscribe(void *client, const char *topic_filter,
                                 uint32_t timeout_ms) {
   mqtt_client *c = (mqtt_client *)client;
   int rc = FAILURE;
-  handle_t unsub_cd_hdl = 0;
+  deadline_t unsub_deadline = 0;
   MQTTString topic = MQTTString_initializer;
   topic.cstring = (char *)topic_filter;
   int len = 0;
+  int packetid = 0;
 
   if (!c->isconnected) {
     goto exit;
   }
 
-  unsub_cd_hdl = countdown_start(timeout_ms);
+  unsub_deadline = deadline_start(timeout_ms);
+  packetid = getNextPacketId(c);
+
+  len = serializeUnsubscribe(c, packetid, &topic, unsub_deadline);
 
-  if ((len = MQTTSerialize_unsubscribe(c->buf, c->buf_size, 0,
-                                       getNextPacketId(c), 1, &topic)) <= 0) {
+  if (len <= 0) {
     goto exit;
   }
 
-  if ((rc = sendPacket(c, len,
-                       unsub_cd_hdl)) != SUCCESS)  // send the subscribe packet
+  if ((rc = sendPacket(c, len, unsub_deadline)) !=
+      SUCCESS)  // send the subscribe packet
   {
     goto exit;  // there was a problem
   }
 
-  if (waitfor(c, UNSUBACK, unsub_cd_hdl) == UNSUBACK) {
+  if (waitfor(c, UNSUBACK, unsub_deadline) == UNSUBACK) {
     unsigned short mypacketid;  // should be the same as the packetid above
 
-    if (MQTTDeserialize_unsuback(&mypacketid, c->readbuf, c->readbuf_size) ==
-        1) {
+    if (deserializeUnsuback(c, &mypacketid) == 1) {
       /* remove the subscription message handler associated with this topic, if
        * there is one */
       mqtt_client_set_message_handler(c, topic_filter, NULL, NULL);
@@ -728,8 +1987,6 @@ int32_t mqtt_client_unsubscribe(void *client, const char *topic_filter,
   }
 
 exit:
-  countdown_stop(unsub_cd_hdl);
-
   if (rc == FAILURE) {
     MQTTCloseSession(c);
   }
@@ -737,63 +1994,151 @@ exit:
   return rc;
 }
 
-int32_t mqtt_client_publish(void *client, const char *topicName,
-                            struct mqtt_message_t *message,
-                            uint32_t timeout_ms) {
-  mqtt_client *c = (mqtt_client *)client;
+/* Send a PUBLISH whose payload does not go through the send buffer. Only the
+ * header is serialized; the payload follows straight from the caller's buffer,
+ * or is read chunk by chunk into the free part of the send buffer. Once part
+ * of the packet is on the wire a failure leaves the stream unusable, so the
+ * session is closed. */
+static int streamPublish(mqtt_client *c, const char *topicName,
+                         struct mqtt_message_t *message,
+                         publish_payload_reader reader, void *arg,
+                         unsigned short *bind, deadline_t deadline) {
+  uint32_t left = message->payload_len;
+  int len = 0, n = 0;
+  int written = 0; /* part of the packet may be on the wire */
   int rc = FAILURE;
-  handle_t pub_cd_hdl = 0;
-  MQTTString topic = MQTTString_initializer;
-  topic.cstring = (char *)topicName;
+
+  len = serializePublish(c, topicName, message, bind, 1, deadline);
+
+  if (len <= 0) {
+    return FAILURE;
+  }
+
+  c->tx_len += len;
+
+  if (reader == NULL) {
+    written = 1;
+
+    if (flushQueue(c, deadline) == SUCCESS) {
+      rc = sendBuffer(c, message->payload, (int)left, deadline);
+    }
+  } else {
+    while (left > 0) {
+      if (txRoom(c) == 0) {
+        written = 1;
+
+        if (flushQueue(c, deadline) != SUCCESS) {
+          break;
+        }
+      }
+
+      n = txRoom(c) < (int)left ? txRoom(c) : (int)left;
+
+      if ((n = reader(arg, txTail(c), (uint32_t)n)) <= 0 || n > (int)left) {
+        loge("Mqtt publish payload read failed!");
+        break;
+      }
+
+      c->tx_len += n;
+      left -= n;
+    }
+
+    if (left == 0) {
+      written = 1;
+      rc = flushQueue(c, deadline);
+    }
+  }
+
+  if (rc != SUCCESS) {
+    if (written) {
+      MQTTCloseSession(c);
+    } else {
+      c->tx_len -= (int)(message->payload_len - left) + len;
+    }
+  }
+
+  return rc;
+}
+
+static int publish(mqtt_client *c, const char *topicName,
+                   struct mqtt_message_t *message,
+                   publish_payload_reader reader, void *arg,
+                   uint32_t timeout_ms) {
+  int rc = FAILURE;
+  deadline_t pub_deadline = 0;
+  unsigned short alias = 0;
   int len = 0;
+  int stream = 0;
 
   if (!c->isconnected) {
     goto exit;
   }
 
-  pub_cd_hdl = countdown_start(timeout_ms);
+  pub_deadline = deadline_start(timeout_ms);
 
   if (message->qos == MQTT_QOS1 || message->qos == MQTT_QOS2) {
     message->id = getNextPacketId(c);
   }
 
-  len = MQTTSerialize_publish(
-      c->buf, c->buf_size, 0, message->qos, message->retained, message->id,
-      topic, (unsigned char *)message->payload, message->payload_len);
+  /* large payloads skip the copy into the send buffer, smaller ones only
+   * when they do not fit in it */
+  stream = (reader != NULL || message->payload_len >= MQTT_PUBLISH_STREAM_MIN);
 
-  if (len <= 0) {
+  if (!stream) {
+    len = serializePublish(c, topicName, message, &alias, 0, pub_deadline);
+    stream = (len == MQTTPACKET_BUFFER_TOO_SHORT);
+  }
+
+  if (stream) {
+    rc = streamPublish(c, topicName, message, reader, arg, &alias,
+                       pub_deadline);
+  } else if (len <= 0) {
     goto exit;
+  } else if (message->qos == MQTT_QOS0) {
+    /* QoS0 may sit in the queue, anything that waits for an ack goes out now */
+    rc = queuePacket(c, len, pub_deadline);
+  } else {
+    rc = sendPacket(c, len, pub_deadline);
   }
 
-  if ((rc = sendPacket(c, len,
-                       pub_cd_hdl)) != SUCCESS)  // send the subscribe packet
-  {
+  if (rc != SUCCESS) {
     goto exit;  // there was a problem
   }
 
+#if defined(MQTTV5)
+  if (alias > 0) {
+    bindTopicAlias(c, alias, topicName, strlen(topicName));
+  }
+#endif
+
   if (message->qos == MQTT_QOS1) {
-    if (waitfor(c, PUBACK, pub_cd_hdl) == PUBACK) {
-      unsigned short mypacketid;
-      unsigned char dup, type;
+    /* PUBACKs of windowed publishes may arrive first, skip them */
+    unsigned short mypacketid = 0;
+    int result = SUCCESS;
 
-      if (MQTTDeserialize_ack(&type, &dup, &mypacketid, c->readbuf,
-                              c->readbuf_size) != 1) {
+    do {
+      if (waitfor(c, PUBACK, pub_deadline) != PUBACK) {
+        loge("Mqtt publish respond time out!");
+        rc = FAILURE;
+      } else if (deserializeAck(c, &mypacketid, &result) != 1) {
         loge("Mqtt publish respond deserialize error!");
         rc = FAILURE;
       }
-    } else {
-      loge("Mqtt publish respond time out!");
-      rc = FAILURE;
+    } while (rc == SUCCESS && mypacketid != message->id);
+
+    if (rc == SUCCESS) {
+      rc = result;
     }
   } else if (message->qos == MQTT_QOS2) {
-    if (waitfor(c, PUBCOMP, pub_cd_hdl) == PUBCOMP) {
+    if (waitfor(c, PUBCOMP, pub_deadline) == PUBCOMP) {
       unsigned short mypacketid;
-      unsigned char dup, type;
+      int result = SUCCESS;
 
-      if (MQTTDeserialize_ack(&type, &dup, &mypacketid, c->readbuf,
-                              c->readbuf_size) != 1) {
+      if (deserializeAck(c, &mypacketid, &result) != 1) {
         loge("Mqtt publish respond deserialize error!");
         rc = FAILURE;
+      } else {
+        rc = result;
       }
     } else {
       loge("Mqtt publish respond time out!");
@@ -802,8 +2147,6 @@ int32_t mqtt_client_publish(void *client, const char *topicName,
   }
 
 exit:
-  countdown_stop(pub_cd_hdl);
-
   if (rc == FAILURE) {
     //        MQTTCloseSession(c);
   }
@@ -811,22 +2154,256 @@ exit:
   return rc;
 }
 
+int32_t mqtt_client_publish(void *client, const char *topicName,
+                            struct mqtt_message_t *message,
+                            uint32_t timeout_ms) {
+  return publish((mqtt_client *)client, topicName, message, NULL, NULL,
+                 timeout_ms);
+}
+
+int32_t mqtt_client_publish_stream(void *client, const char *topicName,
+                                   struct mqtt_message_t *message,
+                                   publish_payload_reader reader, void *arg,
+                                   uint32_t timeout_ms) {
+  if (reader == NULL) {
+    return FAILURE;
+  }
+
+  return publish((mqtt_client *)client, topicName, message, reader, arg,
+                 timeout_ms);
+}
+
+int32_t mqtt_client_publish_async(void *client, const char *topicName,
+                                  struct mqtt_message_t *message,
+                                  publish_complete_handler complete_cb,
+                                  void *arg, uint32_t timeout_ms) {
+  mqtt_client *c = (mqtt_client *)client;
+  int rc = FAILURE;
+  deadline_t pub_deadline = 0;
+  struct InflightMessage *m = NULL;
+  unsigned short alias = 0;
+  int len = 0;
+  int step = 0;
+
+  if (!c->isconnected || message->qos == MQTT_QOS2) {
+    goto exit;
+  }
+
+  pub_deadline = deadline_start(timeout_ms);
+
+  if (message->qos == MQTT_QOS1) {
+    /* window full, or outbox entries of an earlier connection still waiting
+     * for a slot: keep processing acks, new publishes line up behind them */
+    while (c->isconnected && (c->inflight_cnt >= c->inflight_window ||
+                              c->replay_pos < c->replay_cnt)) {
+      if (c->inflight_cnt < c->inflight_window) {
+        step = replayOutbox(c, pub_deadline);
+      } else if (!deadline_is_expired(pub_deadline)) {
+        step = cycle(c, pub_deadline);
+      }
+
+      if (step < 0 || deadline_is_expired(pub_deadline)) {
+        loge("Mqtt publish window full!");
+        goto exit;
+      }
+    }
+
+    if (!c->isconnected) {
+      goto exit;
+    }
+
+    m = freeInflight(c);
+    message->id = getNextPacketId(c);
+  }
+
+  if (m == NULL) {
+    /* QoS0 has nothing to resend, it goes out like mqtt_client_publish */
+    if (message->payload_len < MQTT_PUBLISH_STREAM_MIN) {
+      len = serializePublish(c, topicName, message, &alias, 0, pub_deadline);
+    }
+
+    if (len > 0) {
+      rc = queuePacket(c, len, pub_deadline);
+    } else if (len == 0 || len == MQTTPACKET_BUFFER_TOO_SHORT) {
+      rc = streamPublish(c, topicName, message, NULL, NULL, &alias,
+                         pub_deadline);
+    }
+
+    if (rc != SUCCESS) {
+      goto exit;
+    }
+  } else {
+    /* the window keeps its own copy for resending, put together from the
+     * header and the caller's payload so the send buffer does not bound its
+     * size. A stored packet may be replayed on another connection, where the
+     * topic aliases of this one mean nothing */
+    len = serializePublish(c, topicName, message,
+                           c->store != NULL ? NULL : &alias, 1, pub_deadline);
+
+    if (len <= 0 ||
+        NULL == (m->packet = osl_malloc(len + message->payload_len))) {
+      goto exit;
+    }
+
+    osl_memcpy(m->packet, txTail(c), len);
+    osl_memcpy(m->packet + len, message->payload, message->payload_len);
+    len += (int)message->payload_len;
+
+    if (c->store) {
+      if (c->store->put(c->store->handle, c->store_next_key, m->packet, len) !=
+          0) {
+        loge("Mqtt outbox write failed!");
+        osl_free(m->packet);
+        m->packet = NULL;
+        goto exit;
+      }
+
+      m->key = c->store_next_key++;
+    }
+
+    m->len = len;
+    m->id = message->id;
+    m->cb = complete_cb;
+    m->arg = arg;
+    m->resend_at = time_count_ms() + c->inflight_retry_ms;
+    c->inflight_cnt++;
+
+    /* a packet that fits is queued like any other, a larger one is written
+     * out of the window copy behind whatever is queued */
+    if (len <= txRoom(c)) {
+      osl_memcpy(txTail(c), m->packet, len);
+      rc = queuePacket(c, len, pub_deadline);
+    } else if ((rc = flushQueue(c, pub_deadline)) == SUCCESS) {
+      rc = sendBuffer(c, m->packet, len, pub_deadline);
+    }
+
+    if (rc != SUCCESS) {
+      /* nobody will ack it - drop it silently */
+      if (m->key != 0) {
+        c->store->remove(c->store->handle, m->key);
+      }
+
+      osl_free(m->packet);
+      osl_memset(m, 0, sizeof(*m));
+      c->inflight_cnt--;
+      goto exit;
+    }
+  }
+
+#if defined(MQTTV5)
+  if (alias > 0) {
+    bindTopicAlias(c, alias, topicName, strlen(topicName));
+  }
+#endif
+
+  if (m == NULL && complete_cb) {
+    complete_cb(arg, message->id, SUCCESS);
+  }
+
+exit:
+  return rc;
+}
+
+int32_t mqtt_client_set_store(void *client, mqtt_store *store) {
+  mqtt_client *c = (mqtt_client *)client;
+
+  /* entries in the window refer to the store they were written to */
+  if (c->isconnected) {
+    return FAILURE;
+  }
+
+  if (store != c->store) {
+    failParked(c);
+  }
+
+  c->store = store;
+
+  return SUCCESS;
+}
+
+int32_t mqtt_client_set_inflight_window(void *client, uint32_t window,
+                                        uint32_t retry_ms) {
+  mqtt_client *c = (mqtt_client *)client;
+
+  if (window == 0 || window > MQTT_MAX_INFLIGHT) {
+    return FAILURE;
+  }
+
+#if defined(MQTTV5)
+  /* never more unacknowledged publishes than the server is willing to take */
+  if (c->mqtt_version == 5 && window > c->receive_max) {
+    window = c->receive_max;
+  }
+#endif
+
+  c->inflight_window = window;
+  c->inflight_retry_ms = retry_ms ? retry_ms : MQTT_INFLIGHT_RETRY_MS;
+
+  return SUCCESS;
+}
+
+uint32_t mqtt_client_inflight_count(void *client) {
+  return ((mqtt_client *)client)->inflight_cnt;
+}
+
+int32_t mqtt_client_get_ping_rtt(void *client, uint32_t *rtt_ms,
+                                 uint32_t *srtt_ms) {
+  mqtt_client *c = (mqtt_client *)client;
+
+  if (c->ping_srtt_ms == 0) {
+    return FAILURE;
+  }
+
+  if (rtt_ms) *rtt_ms = c->ping_rtt_ms;
+  if (srtt_ms) *srtt_ms = c->ping_srtt_ms;
+
+  return SUCCESS;
+}
+
+int32_t mqtt_client_set_tx_coalescing(void *client, uint32_t flush_bytes,
+                                      uint32_t flush_ms) {
+  mqtt_client *c = (mqtt_client *)client;
+
+  if (flush_bytes > c->buf_size) {
+    return FAILURE;
+  }
+
+  c->tx_flush_bytes = flush_bytes;
+  c->tx_flush_ms = flush_ms;
+
+  return SUCCESS;
+}
+
+int32_t mqtt_client_flush(void *client, uint32_t timeout_ms) {
+  mqtt_client *c = (mqtt_client *)client;
+  int rc = SUCCESS;
+  deadline_t flush_deadline = 0;
+
+  if (c->tx_len > 0) {
+    flush_deadline = deadline_start(timeout_ms);
+    rc = flushQueue(c, flush_deadline);
+  }
+
+  return rc;
+}
+
 int32_t mqtt_client_disconnect(void *client, uint32_t timeout_ms) {
   mqtt_client *c = (mqtt_client *)client;
   int rc = FAILURE;
-  handle_t discon_cd_hdl =
+  deadline_t discon_deadline =
       0;  // we might wait for incomplete incoming publishes to complete
   int len = 0;
 
-  discon_cd_hdl = countdown_start(timeout_ms);
+  discon_deadline = deadline_start(timeout_ms);
 
-  len = MQTTSerialize_disconnect(c->buf, c->buf_size);
+  do {
+    len = MQTTSerialize_disconnect(txTail(c), txRoom(c));
+  } while (txRetry(c, len, discon_deadline));
 
   if (len > 0) {
-    rc = sendPacket(c, len, discon_cd_hdl);  // send the disconnect packet
+    rc = sendPacket(c, len, discon_deadline);  // send the disconnect packet
   }
 
-  countdown_stop(discon_cd_hdl);
   MQTTCloseSession(c);
 
   return rc;
@@ -843,6 +2420,7 @@ int32_t mqtt_client_is_connected(void *client) {
 #else
 #include "plat_tcp.h"
 #endif
+#include "plat_store.h"
 
 /**
  * @brief Connect to the server.
@@ -855,28 +2433,29 @@ void *mqtt_connect(const uint8_t *remote_addr, uint16_t remote_port,
                    struct mqtt_param_t *mqtt_param, uint32_t timeout_ms) {
   struct mqtt_client *client = NULL;
   struct mqtt_network *net_cb = NULL;
+  struct mqtt_store *store = NULL;
   MQTTPacket_connectData conn_data;
-  handle_t cd_hdl = 0;
+  mqtt_conn_ack_data ack_data;
+  deadline_t deadline = 0;
 
   if (NULL == (net_cb = osl_malloc(sizeof(struct mqtt_network)))) {
     return NULL;
   }
   osl_memset(net_cb, 0, sizeof(struct mqtt_network));
 
-  if (0 == (cd_hdl = countdown_start(timeout_ms))) {
-    osl_free(net_cb);
-    return NULL;
-  }
+  deadline = deadline_start(timeout_ms);
+  mqtt_param->session_present = 0;
 
 #if defined(CONFIG_NETWORK_TLS) && CONFIG_NETWORK_TLS == 1
   net_cb->handle = tls_connect(remote_addr, remote_port, ca_cert, ca_cert_len,
-                               countdown_left(cd_hdl));
+                               deadline_left(deadline));
   net_cb->mqttread = tls_recv;
   net_cb->mqttwrite = tls_send;
   net_cb->disconnect = tls_disconnect;
+  net_cb->pending = tls_pending;
 #else
   net_cb->handle =
-      plat_tcp_connect(remote_addr, remote_port, countdown_left(cd_hdl));
+      plat_tcp_connect(remote_addr, remote_port, deadline_left(deadline));
   net_cb->mqttread = plat_tcp_recv;
   net_cb->mqttwrite = plat_tcp_send;
   net_cb->disconnect = plat_tcp_disconnect;
@@ -894,6 +2473,23 @@ void *mqtt_connect(const uint8_t *remote_addr, uint16_t remote_port,
     goto exit1;
   }
 
+  if (mqtt_param->outbox_name) {
+    if (NULL == (store = osl_malloc(sizeof(struct mqtt_store)))) {
+      goto exit2;
+    }
+
+    if (0 == (store->handle = plat_store_open(mqtt_param->outbox_name))) {
+      osl_free(store);
+      goto exit2;
+    }
+
+    store->put = plat_store_put;
+    store->get = plat_store_get;
+    store->remove = plat_store_remove;
+    store->keys = plat_store_keys;
+    mqtt_client_set_store(client, store);
+  }
+
   osl_memset(&conn_data, 0, sizeof(conn_data));
   osl_memcpy(conn_data.struct_id, "MQTC", 4);
   conn_data.MQTTVersion = 4;
@@ -912,6 +2508,12 @@ void *mqtt_connect(const uint8_t *remote_addr, uint16_t remote_port,
     conn_data.cleansession = 1;
   }
 
+#if defined(MQTTV5)
+  if (mqtt_param->connect_flag & MQTT_CONNECT_FLAG_PROTOCOL_V5) {
+    conn_data.MQTTVersion = 5;
+  }
+#endif
+
   if (mqtt_param->connect_flag & MQTT_CONNECT_FLAG_WILL) {
     conn_data.willFlag = 1;
     osl_memcpy(conn_data.will.struct_id, "MQTW", 4);
@@ -928,23 +2530,26 @@ void *mqtt_connect(const uint8_t *remote_addr, uint16_t remote_port,
     conn_data.will.qos = mqtt_param->will_msg.qos;
   }
   int ret = 0;
-  if (0 !=
-      (ret = mqtt_client_connect(client, &conn_data, countdown_left(cd_hdl)))) {
+  if (0 != (ret = mqtt_client_connect_with_results(
+                client, &conn_data, &ack_data, deadline_left(deadline)))) {
     logd("mqtt connect %d", ret);
     goto exit2;
   }
 
-  logi("MQTT connect ok");
+  mqtt_param->session_present = ack_data.sessionPresent;
+  logi("MQTT connect ok%s", ack_data.sessionPresent ? ", session resumed" : "");
 
-  countdown_stop(cd_hdl);
   return client;
 
 exit2:
+  if (client->store) {
+    plat_store_close(client->store->handle);
+    osl_free(client->store);
+  }
   mqtt_client_deinit(client);
 exit1:
   net_cb->disconnect(net_cb->handle);
 exit:
-  countdown_stop(cd_hdl);
   osl_free(net_cb);
   return NULL;
 }
@@ -982,17 +2587,94 @@ int32_t mqtt_publish(void *client, const uint8_t *topic,
   return -1;
 }
 
+int32_t mqtt_publish_stream(void *client, const uint8_t *topic,
+                            struct mqtt_message_t *message,
+                            mqtt_payload_reader reader, void *arg,
+                            uint32_t timeout_ms) {
+  if (client) {
+    return mqtt_client_publish_stream(client, (const char *)topic, message,
+                                      reader, arg, timeout_ms);
+  }
+
+  return -1;
+}
+
+int32_t mqtt_publish_async(void *client, const uint8_t *topic,
+                           struct mqtt_message_t *message,
+                           mqtt_publish_complete_handler complete_cb, void *arg,
+                           uint32_t timeout_ms) {
+  if (client) {
+    return mqtt_client_publish_async(client, (const char *)topic, message,
+                                     complete_cb, arg, timeout_ms);
+  }
+
+  return -1;
+}
+
+int32_t mqtt_flush(void *client, uint32_t timeout_ms) {
+  if (client) {
+    return mqtt_client_flush(client, timeout_ms);
+  }
+
+  return -1;
+}
+
+int32_t mqtt_get_ping_rtt(void *client, uint32_t *rtt_ms, uint32_t *srtt_ms) {
+  if (client) {
+    return mqtt_client_get_ping_rtt(client, rtt_ms, srtt_ms);
+  }
+
+  return -1;
+}
+
 int32_t mqtt_set_default_message_handler(void *client,
                                          mqtt_message_handler msg_handler,
                                          void *arg) {
   mqtt_client *c = (mqtt_client *)client;
 
   c->defaultHandler.fp = msg_handler;
+  c->defaultHandler.view_fp = NULL;
+  c->defaultHandler.chunk_fp = NULL;
+  c->defaultHandler.arg = arg;
+
+  return SUCCESS;
+}
+
+int32_t mqtt_set_default_topic_view_handler(
+    void *client, mqtt_topic_view_handler view_handler, void *arg) {
+  mqtt_client *c = (mqtt_client *)client;
+
+  c->defaultHandler.fp = NULL;
+  c->defaultHandler.view_fp = view_handler;
+  c->defaultHandler.chunk_fp = NULL;
+  c->defaultHandler.arg = arg;
+
+  return SUCCESS;
+}
+
+int32_t mqtt_set_default_chunk_handler(void *client,
+                                       mqtt_chunk_handler chunk_handler,
+                                       void *arg) {
+  mqtt_client *c = (mqtt_client *)client;
+
+  c->defaultHandler.fp = NULL;
+  c->defaultHandler.view_fp = NULL;
+  c->defaultHandler.chunk_fp = chunk_handler;
   c->defaultHandler.arg = arg;
 
   return SUCCESS;
 }
 
+int32_t mqtt_set_chunk_handler(void *client, const uint8_t *topic,
+                               mqtt_chunk_handler chunk_handler, void *arg) {
+  if (client) {
+    return mqtt_client_set_chunk_handler(client, (const char *)topic,
+                                         chunk_handler, arg);
+  }
+
+  return -1;
+}
+
 /**
  * @brief Subscribe designated topic
  *
@@ -1013,6 +2695,35 @@ int32_t mqtt_subscribe(void *client, const uint8_t *topic, enum mqtt_qos_e qos,
   return -1;
 }
 
+int32_t mqtt_subscribe_view(void *client, const uint8_t *topic,
+                            enum mqtt_qos_e qos,
+                            mqtt_topic_view_handler view_handler, void *arg,
+                            uint32_t timeout_ms) {
+  if (client) {
+    return mqtt_client_subscribe_view(client, (const char *)topic, qos,
+                                      view_handler, arg, timeout_ms);
+  }
+
+  return -1;
+}
+
+/**
+ * @brief Subscribe several topics with a single SUBSCRIBE packet.
+ *
+ * @param client MQTT Client instance action handle
+ * @param subs Subscription entries
+ * @param count Number of entries
+ * @return int32_t
+ */
+int32_t mqtt_subscribe_multi(void *client, struct mqtt_subscription_t *subs,
+                             uint32_t count, uint32_t timeout_ms) {
+  if (client) {
+    return mqtt_client_subscribe_multi(client, subs, count, timeout_ms);
+  }
+
+  return -1;
+}
+
 /**
  * @brief Cancel topic Subscribe.
  *
@@ -1043,6 +2754,10 @@ int32_t mqtt_disconnect(void *client, uint32_t timeout_ms) {
     c->ipstack->disconnect(c->ipstack->handle);
     osl_free(c->ipstack);
   }
+  if (c->store) {
+    plat_store_close(c->store->handle);
+    osl_free(c->store);
+  }
   mqtt_client_deinit(c);
 
   return 0;
@@ -21,7 +21,54 @@ extern "C" {
 /*****************************************************************************/
 /* External Definition（Constant and Macro )                                 */
 /*****************************************************************************/
-#define MAX_MESSAGE_HANDLERS 5
+/* Size of the receive staging area. One transport read pulls up to this many
+ * bytes, fixed headers and small packets are then parsed out of it without
+ * touching the socket again. */
+#ifndef MQTT_RX_STAGE_LEN
+#define MQTT_RX_STAGE_LEN 256
+#endif
+
+/* Upper bound of unacknowledged QoS1 publishes per client */
+#ifndef MQTT_MAX_INFLIGHT
+#define MQTT_MAX_INFLIGHT 16
+#endif
+
+/* Default time before an unacknowledged QoS1 publish is resent with DUP set */
+#ifndef MQTT_INFLIGHT_RETRY_MS
+#define MQTT_INFLIGHT_RETRY_MS 10000
+#endif
+
+/* Publish topics given a topic alias per connection in MQTT 5.0 mode, the
+ * server may allow fewer */
+#ifndef MQTT_TOPIC_ALIAS_MAX
+#define MQTT_TOPIC_ALIAS_MAX 8
+#endif
+
+/* Outbox entries left over from an earlier connection that are replayed after
+ * connecting, older entries stay in the store until the next connection */
+#ifndef MQTT_OUTBOX_MAX
+#define MQTT_OUTBOX_MAX 64
+#endif
+
+/* Keepalive probes a link that only sends once nothing has been received for
+ * this many keepalive intervals, a link that also receives is never pinged
+ * while it keeps sending */
+#ifndef MQTT_KEEPALIVE_RX_IDLE
+#define MQTT_KEEPALIVE_RX_IDLE 2
+#endif
+
+/* Publish payloads of at least this many bytes are written to the transport
+ * straight from the caller's buffer instead of being copied into the send
+ * buffer. Smaller payloads are copied unless they do not fit */
+#ifndef MQTT_PUBLISH_STREAM_MIN
+#define MQTT_PUBLISH_STREAM_MIN 1024
+#endif
+
+/* Session Expiry Interval asked for in MQTT 5.0 mode when connecting without
+ * clean session, in seconds. 0xFFFFFFFF keeps the session like MQTT 3.1.1 */
+#ifndef MQTT_SESSION_EXPIRY
+#define MQTT_SESSION_EXPIRY 0xFFFFFFFF
+#endif
 
 #define DefaultClient                                                                                                  \
     {                                                                                                                  \
@@ -56,10 +103,15 @@ typedef struct mqtt_sub_ack_data
 } mqtt_sub_ack_data;
 
 typedef void (*message_handler)(void *, const uint8_t *, struct mqtt_message_t *);
+typedef void (*topic_view_handler)(void *, const uint8_t *, uint32_t, struct mqtt_message_t *);
+typedef void (*chunk_handler)(void *, const uint8_t *, struct mqtt_message_t *, uint32_t, uint32_t);
+typedef void (*publish_complete_handler)(void *, uint16_t, int32_t);
+typedef int32_t (*publish_payload_reader)(void *, uint8_t *, uint32_t);
 
 typedef int32_t (*net_write_callback)(handle_t, void *, uint32_t, uint32_t);
 typedef int32_t (*net_read_callback)(handle_t, void *, uint32_t, uint32_t);
 typedef int32_t (*net_disconnect_callback)(handle_t);
+typedef int32_t (*net_pending_callback)(handle_t);
 
 typedef struct mqtt_network
 {
@@ -67,8 +119,25 @@ typedef struct mqtt_network
     net_read_callback       mqttread;
     net_write_callback      mqttwrite;
     net_disconnect_callback disconnect;
+    /* optional, bytes the transport holds that mqttread returns at once */
+    net_pending_callback    pending;
 } mqtt_network;
 
+typedef int32_t (*store_put_callback)(handle_t, uint32_t, const void *, uint32_t);
+typedef int32_t (*store_get_callback)(handle_t, uint32_t, void *, uint32_t);
+typedef int32_t (*store_remove_callback)(handle_t, uint32_t);
+typedef int32_t (*store_keys_callback)(handle_t, uint32_t *, uint32_t);
+
+/* 持久化存储，回调语义与plat_store.h中的同名接口一致 */
+typedef struct mqtt_store
+{
+    handle_t              handle;
+    store_put_callback    put;
+    store_get_callback    get;
+    store_remove_callback remove;
+    store_keys_callback   keys;
+} mqtt_store;
+
 /*****************************************************************************/
 /* External Variables and Functions                                          */
 /*****************************************************************************/
@@ -106,7 +175,9 @@ void mqtt_client_deinit(void *client);
  * @param data 连接确认返回结果结构体指针
  * @param timeout_ms 超时时间(毫秒)
  * @return 成功返回SUCCESS(0)，失败返回错误码
- * @note 调用前需确保网络已连接
+ * @note 调用前需确保网络已连接；options->MQTTVersion为5时使用MQTT 5.0登录(需定义MQTTV5)，
+ *       并按CONNACK中的Receive Maximum、Maximum Packet Size和Topic Alias Maximum约束后续发布；
+ *       data->sessionPresent为1表示服务器保留了之前的会话和订阅；已设置存储时连接后按顺序重发发件箱中的消息
  */
 int32_t mqtt_client_connect_with_results(void *client, MQTTPacket_connectData *options, mqtt_conn_ack_data *data,
                                          uint32_t timeout_ms);
@@ -134,10 +205,97 @@ int32_t mqtt_client_connect(void *client, MQTTPacket_connectData *options, uint3
  * @param message 消息结构体指针
  * @param timeout_ms 超时时间(毫秒)
  * @return 成功返回SUCCESS(0)，失败返回错误码
- * @note QoS级别由message->qos指定
+ * @note QoS级别由message->qos指定；MQTT 5.0模式下首次发布的主题会分配主题别名，之后只发送别名；
+ *       负载不小于MQTT_PUBLISH_STREAM_MIN或放不进发送缓冲区时不经拷贝直接写出
  */
 int32_t mqtt_client_publish(void *client, const char *topicName, struct mqtt_message_t *message, uint32_t timeout_ms);
 
+/**
+ * @brief 以分块读取负载的方式发布MQTT消息
+ * @param client 客户端对象指针
+ * @param topicName 目标主题字符串
+ * @param message 消息结构体指针，payload_len为负载总长度，payload不使用
+ * @param reader 负载读取回调，每次向缓冲区写入不超过给定长度的数据并返回写入的字节数，返回0或负数表示失败
+ * @param arg 传递给读取回调的参数
+ * @param timeout_ms 超时时间(毫秒)
+ * @return 成功返回SUCCESS(0)，失败返回错误码
+ * @note 负载直接读入发送缓冲区的空闲部分并分段写出，长度不受发送缓冲区大小限制；
+ *       部分数据已发出后失败时报文无法补全，会话随之关闭
+ */
+int32_t mqtt_client_publish_stream(void *client, const char *topicName, struct mqtt_message_t *message,
+                                   publish_payload_reader reader, void *arg, uint32_t timeout_ms);
+
+/**
+ * @brief 异步发布MQTT消息(窗口模式)
+ * @param client 客户端对象指针
+ * @param topicName 目标主题字符串
+ * @param message 消息结构体指针，发送后message->id为分配的报文标识
+ * @param complete_cb 完成回调，收到PUBACK或消息被丢弃时调用，可为NULL
+ * @param arg 传递给回调函数的参数
+ * @param timeout_ms 在途窗口已满时的最长等待时间(毫秒)
+ * @return 成功返回SUCCESS(0)，失败返回错误码
+ * @note 仅QoS1消息进入在途窗口，PUBACK在mqtt_client_yield中匹配；QoS0消息发送后立即回调；不支持QoS2
+ *       在途窗口为每条QoS1报文另行分配整包副本，负载长度受堆和存储条目大小限制，不受发送缓冲区大小限制
+ *       非清除会话下已写入存储的消息在连接断开时不回调，重连后随重发副本的PUBACK回调；
+ *       清除会话或未写入存储的消息在连接断开时以失败回调，存储中的副本一并删除，不会再发送
+ */
+int32_t mqtt_client_publish_async(void *client, const char *topicName, struct mqtt_message_t *message,
+                                  publish_complete_handler complete_cb, void *arg, uint32_t timeout_ms);
+
+/**
+ * @brief 设置发件箱存储
+ * @param client 客户端对象指针
+ * @param store 存储回调，NULL表示不使用发件箱，调用者需保证其在客户端释放前有效
+ * @return 成功返回SUCCESS(0)，失败返回错误码
+ * @note 设置后mqtt_client_publish_async发布的QoS1消息先写入存储，收到PUBACK后删除；
+ *       连接断开时仍未确认的消息留在存储中，下次连接成功后先于新消息按原顺序重发
+ */
+int32_t mqtt_client_set_store(void *client, mqtt_store *store);
+
+/**
+ * @brief 设置在途窗口
+ * @param client 客户端对象指针
+ * @param window 未确认QoS1消息的最大数量，范围1~MQTT_MAX_INFLIGHT
+ * @param retry_ms 未确认消息的重发间隔(毫秒)，0表示使用MQTT_INFLIGHT_RETRY_MS
+ * @return 成功返回SUCCESS(0)，失败返回错误码
+ */
+int32_t mqtt_client_set_inflight_window(void *client, uint32_t window, uint32_t retry_ms);
+
+/**
+ * @brief 获取当前未确认的QoS1消息数量
+ * @param client 客户端对象指针
+ * @return 在途消息数量
+ */
+uint32_t mqtt_client_inflight_count(void *client);
+
+/**
+ * @brief 获取心跳往返时延，作为链路质量指标
+ * @param client 客户端对象指针
+ * @param rtt_ms 最近一次PINGREQ到PINGRESP的时延(毫秒)，可为NULL
+ * @param srtt_ms 平滑后的时延(毫秒)，每个新样本占1/8权重，可为NULL
+ * @return 成功返回SUCCESS(0)，尚未收到过PINGRESP时返回FAILURE
+ * @note 链路持续有数据发送时不发心跳，样本可能较旧
+ */
+int32_t mqtt_client_get_ping_rtt(void *client, uint32_t *rtt_ms, uint32_t *srtt_ms);
+
+/**
+ * @brief 设置发送合并策略
+ * @param client 客户端对象指针
+ * @param flush_bytes 队列累计达到该字节数时写出，0表示关闭合并(每个报文立即写出)
+ * @param flush_ms 队列中最早报文的最长滞留时间(毫秒)
+ * @return 成功返回SUCCESS(0)，失败返回错误码
+ * @note QoS0发布、PUBACK等无需等待应答的报文进入队列，连接、订阅、心跳等需要应答的报文会连同队列一并立即写出
+ */
+int32_t mqtt_client_set_tx_coalescing(void *client, uint32_t flush_bytes, uint32_t flush_ms);
+
+/**
+ * @brief 立即写出发送队列中的全部报文
+ * @param client 客户端对象指针
+ * @param timeout_ms 超时时间(毫秒)
+ * @return 成功返回SUCCESS(0)，失败返回错误码
+ */
+int32_t mqtt_client_flush(void *client, uint32_t timeout_ms);
+
 /**
  * @brief 设置或移除主题消息处理器
  * @param client 客户端对象指针
@@ -145,11 +303,35 @@ int32_t mqtt_client_publish(void *client, const char *topicName, struct mqtt_mes
  * @param message_handler 消息处理回调函数指针，NULL表示移除
  * @param arg 传递给回调函数的参数
  * @return 成功返回SUCCESS(0)，失败返回错误码
- * @note 每个主题最多支持5个消息处理器
+ * @note 处理器数量不设上限，主题过滤器内容会被复制保存
  */
 int32_t mqtt_client_set_message_handler(void *client, const char *topic_filter, message_handler message_handler,
                                         void *arg);
 
+/**
+ * @brief 设置或移除主题消息处理器，处理器收到的主题为接收缓冲区中的视图
+ * @param client 客户端对象指针
+ * @param topic_filter 主题过滤器字符串
+ * @param view_handler 消息处理回调函数指针，NULL表示移除
+ * @param arg 传递给回调函数的参数
+ * @return 成功返回SUCCESS(0)，失败返回错误码
+ * @note 主题不以'\0'结尾，仅在回调期间有效
+ */
+int32_t mqtt_client_set_topic_view_handler(void *client, const char *topic_filter, topic_view_handler view_handler,
+                                           void *arg);
+
+/**
+ * @brief 设置或移除主题消息处理器，负载分块交付
+ * @param client 客户端对象指针
+ * @param topic_filter 主题过滤器字符串
+ * @param chunk_handler 消息处理回调函数指针，NULL表示移除
+ * @param arg 传递给回调函数的参数
+ * @return 成功返回SUCCESS(0)，失败返回错误码
+ * @note 能放进接收缓冲区的消息一次交付；更大的PUBLISH经接收缓冲区分段读取，每段回调一次，
+ *       主题以'\0'结尾。其他处理器收不到超过接收缓冲区的消息，这类消息读完后丢弃
+ */
+int32_t mqtt_client_set_chunk_handler(void *client, const char *topic_filter, chunk_handler chunk_handler, void *arg);
+
 /**
  * @brief 订阅主题并设置消息处理器
  * @param client 客户端对象指针
@@ -163,6 +345,31 @@ int32_t mqtt_client_set_message_handler(void *client, const char *topic_filter,
 int32_t mqtt_client_subscribe(void *c, const char *topic_filter, enum mqtt_qos_e qos, message_handler message_handler,
                               void *arg, uint32_t timeout_ms);
 
+/**
+ * @brief 订阅主题并设置以主题视图回调的消息处理器
+ * @param client 客户端对象指针
+ * @param topic_filter 主题过滤器字符串
+ * @param qos 订阅服务质量等级
+ * @param view_handler 消息处理回调函数指针
+ * @param arg 传递给回调函数的参数
+ * @param timeout_ms 超时时间(毫秒)
+ * @return 成功返回SUCCESS(0)，失败返回错误码
+ */
+int32_t mqtt_client_subscribe_view(void *client, const char *topic_filter, enum mqtt_qos_e qos,
+                                   topic_view_handler view_handler, void *arg, uint32_t timeout_ms);
+
+/**
+ * @brief 使用一个SUBSCRIBE报文订阅多个主题
+ * @param client 客户端对象指针
+ * @param subs 订阅项数组，返回时填写服务器授予的QoS
+ * @param count 订阅项个数
+ * @param timeout_ms 超时时间(毫秒)
+ * @return 全部主题订阅成功返回SUCCESS(0)，失败返回错误码
+ * @note 收到SUBACK后一次性注册全部被接受主题的处理器，注册失败时各主题恢复调用前的处理器
+ */
+int32_t mqtt_client_subscribe_multi(void *client, struct mqtt_subscription_t *subs, uint32_t count,
+                                    uint32_t timeout_ms);
+
 /**
  * MQTT订阅 - 发送MQTT订阅包并等待Suback响应
  * @param client 使用的客户端对象
@@ -201,6 +408,15 @@ int32_t mqtt_client_yield(void *client, int32_t timeout_ms);
  *  @return truth value indicating whether the client is connected to the server
  */
 int32_t mqtt_client_is_connected(void *client);
+
+#if defined(MQTTV5)
+/**
+ * @brief 将MQTT 5.0原因码转换为err_def.h中的错误码
+ * @param reason_code 服务器返回的原因码
+ * @return 小于0x80的原因码表示成功，返回ERR_OK，其他返回对应的错误码
+ */
+int32_t mqtt_client_reason_to_err(uint8_t reason_code);
+#endif
 #endif
 
 #ifdef __cplusplus
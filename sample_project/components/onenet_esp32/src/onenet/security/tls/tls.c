@@ -11,11 +11,13 @@
 #include "tls.h"
 #include "err_def.h"
 #include "plat_osl.h"
+#include "plat_store.h"
 #include "plat_tcp.h"
 #include "plat_time.h"
 
 #if defined(CONFIG_NETWORK_TLS) && CONFIG_NETWORK_TLS == 1
 #include "wolfssl/ssl.h"
+#include "wolfssl/internal.h"
 #endif
 
 #include "common.h"
@@ -23,6 +25,49 @@
 /*****************************************************************************/
 /* Local Definitions ( Constant and Macro )                                  */
 /*****************************************************************************/
+/** Lifetime of a session kept for resumption, in seconds */
+#ifndef TLS_SESSION_TIMEOUT
+#define TLS_SESSION_TIMEOUT 7200
+#endif
+
+/** Non-zero to keep the last session in plat_store so it also survives a
+ * reboot, the entry holds the session master secret */
+#ifndef TLS_SESSION_PERSIST
+#define TLS_SESSION_PERSIST 0
+#endif
+
+/** Cipher suites offered, most preferred first. The client only does RSA
+ * public key operations with RSA key transport, which makes those suites the
+ * cheapest handshakes for the device, and GCM needs one pass over a record
+ * where CBC needs another one for the HMAC. The bundled wolfcrypt has no ECC,
+ * so there are no ECDHE suites to offer. */
+#ifndef TLS_CIPHER_LIST
+#define TLS_CIPHER_LIST \
+  "AES128-GCM-SHA256:AES128-SHA256:AES256-SHA256:AES128-SHA:AES256-SHA"
+#endif
+
+/** Cipher suites offered after tls_set_psk() */
+#ifndef TLS_PSK_CIPHER_LIST
+#define TLS_PSK_CIPHER_LIST "PSK-AES128-GCM-SHA256:PSK-AES128-CBC-SHA256"
+#endif
+
+/** How long tls_disconnect() may wait to send close_notify */
+#ifndef TLS_CLOSE_NOTIFY_TIMEOUT
+#define TLS_CLOSE_NOTIFY_TIMEOUT 100
+#endif
+
+/** Size of the decrypted data buffer of a connection. Reads shorter than this
+ * are served from it, one wolfSSL_read() fills it with as much of the current
+ * record as fits. */
+#ifndef TLS_READ_BUF_LEN
+#define TLS_READ_BUF_LEN 512
+#endif
+
+#define TLS_SESSION_STORE_NAME "tls_session"
+#define TLS_SESSION_STORE_KEY 1
+#define TLS_SESSION_HOST_LEN 64
+#define TLS_PSK_IDENTITY_LEN 128
+#define TLS_PSK_KEY_LEN 64
 
 /*****************************************************************************/
 /* Structures, Enum and Typedefs                                             */
@@ -30,12 +75,25 @@
 struct tls_t {
   handle_t handle;
 #if defined(CONFIG_NETWORK_TLS) && CONFIG_NETWORK_TLS == 1
-  WOLFSSL_CTX *wolf_ctx;
   WOLFSSL *wolf_ssl;
+  /* decrypted bytes not handed to the caller yet */
+  uint8_t rx_buf[TLS_READ_BUF_LEN];
+  uint32_t rx_head, rx_tail;
 #endif
   uint32_t send_timeout;
   uint32_t recv_timeout;
 };
+
+#if defined(CONFIG_NETWORK_TLS) && CONFIG_NETWORK_TLS == 1
+/* Last session negotiated, offered again to the same server */
+struct tls_session_t {
+  /** sizeof(WOLFSSL_SESSION) of the build that saved it */
+  uint32_t size;
+  uint16_t port;
+  uint8_t host[TLS_SESSION_HOST_LEN];
+  WOLFSSL_SESSION session;
+};
+#endif
 /*****************************************************************************/
 /* Local Function Prototype                                                  */
 /*****************************************************************************/
@@ -43,6 +101,20 @@ struct tls_t {
 /*****************************************************************************/
 /* Local Variables                                                           */
 /*****************************************************************************/
+#if defined(CONFIG_NETWORK_TLS) && CONFIG_NETWORK_TLS == 1
+/* Context shared by every connection, see tls_init() */
+static WOLFSSL_CTX *g_tls_ctx = NULL;
+static struct tls_session_t g_tls_session;
+static uint8_t g_tls_session_valid = 0;
+#if TLS_SESSION_PERSIST
+static uint8_t g_tls_session_loaded = 0;
+#endif
+static struct tls_stats_t g_tls_stats;
+/* PSK set by tls_set_psk(), key length 0 - certificates */
+static uint8_t g_tls_psk_identity[TLS_PSK_IDENTITY_LEN + 1];
+static uint8_t g_tls_psk_key[TLS_PSK_KEY_LEN];
+static uint32_t g_tls_psk_key_len = 0;
+#endif
 
 /*****************************************************************************/
 /* Global Variables                                                          */
@@ -74,70 +146,274 @@ static int wolfssl_recv(WOLFSSL *ssl, char *buf, int sz, void *ctx) {
   return ret;
 }
 
+static unsigned int tls_psk_client_cb(WOLFSSL *ssl, const char *hint,
+                                      char *identity, unsigned int id_max_len,
+                                      unsigned char *key,
+                                      unsigned int key_max_len) {
+  if (osl_strlen(g_tls_psk_identity) >= id_max_len ||
+      g_tls_psk_key_len > key_max_len) {
+    return 0;
+  }
+  osl_strcpy((uint8_t *)identity, g_tls_psk_identity);
+  osl_memcpy(key, g_tls_psk_key, g_tls_psk_key_len);
+
+  return g_tls_psk_key_len;
+}
+
+static void tls_session_load(void) {
+#if TLS_SESSION_PERSIST
+  handle_t store = 0;
+
+  if (g_tls_session_loaded) {
+    return;
+  }
+  g_tls_session_loaded = 1;
+
+  if (0 == (store = plat_store_open((const uint8_t *)TLS_SESSION_STORE_NAME))) {
+    return;
+  }
+  if (sizeof(g_tls_session) == plat_store_get(store, TLS_SESSION_STORE_KEY,
+                                              &g_tls_session,
+                                              sizeof(g_tls_session)) &&
+      sizeof(WOLFSSL_SESSION) == g_tls_session.size) {
+#ifdef HAVE_SESSION_TICKET
+    /* the ticket pointer saved is from another run */
+    g_tls_session.session.ticket = g_tls_session.session.staticTicket;
+    g_tls_session.session.isDynamic = 0;
+#endif
+    g_tls_session_valid = 1;
+  }
+  plat_store_close(store);
+#endif
+}
+
+static int32_t tls_session_save(WOLFSSL *ssl, const uint8_t *host,
+                                uint16_t port, uint8_t persist) {
+  WOLFSSL_SESSION *session = wolfSSL_get_session(ssl);
+#if TLS_SESSION_PERSIST
+  handle_t store = 0;
+#endif
+
+  /* servers that give neither a session ID nor a ticket can't resume */
+  if (NULL == session ||
+      osl_strlen(host) >= sizeof(g_tls_session.host)) {
+    return ERR_FAIL;
+  }
+
+  g_tls_session.size = sizeof(WOLFSSL_SESSION);
+  g_tls_session.port = port;
+  osl_strcpy(g_tls_session.host, host);
+  g_tls_session.session = *session;
+#ifdef HAVE_SESSION_TICKET
+  /* tickets too big for the static buffer are left out, the session ID can
+   * still resume */
+  if (session->isDynamic) {
+    g_tls_session.session.ticketLen = 0;
+  }
+  g_tls_session.session.ticket = g_tls_session.session.staticTicket;
+  g_tls_session.session.isDynamic = 0;
+#endif
+  g_tls_session_valid = 1;
+
+#if TLS_SESSION_PERSIST
+  if (persist &&
+      0 != (store = plat_store_open((const uint8_t *)TLS_SESSION_STORE_NAME))) {
+    plat_store_put(store, TLS_SESSION_STORE_KEY, &g_tls_session,
+                   sizeof(g_tls_session));
+    plat_store_close(store);
+  }
+#else
+  (void)persist;
+#endif
+  return ERR_OK;
+}
+
+static void tls_session_clear(void) {
+#if TLS_SESSION_PERSIST
+  handle_t store = 0;
+
+  if (0 != (store = plat_store_open((const uint8_t *)TLS_SESSION_STORE_NAME))) {
+    plat_store_remove(store, TLS_SESSION_STORE_KEY);
+    plat_store_close(store);
+  }
+#endif
+  g_tls_session_valid = 0;
+}
+
+/* offer the saved session if it was negotiated with the same server */
+static uint8_t tls_session_offer(WOLFSSL *ssl, const uint8_t *host,
+                                 uint16_t port) {
+  tls_session_load();
+
+  if (!g_tls_session_valid || g_tls_session.port != port ||
+      0 != osl_strcmp(g_tls_session.host, host)) {
+    return 0;
+  }
+  if (SSL_SUCCESS != wolfSSL_set_session(ssl, &g_tls_session.session)) {
+    /* expired */
+    tls_session_clear();
+    return 0;
+  }
+  return 1;
+}
+
+int32_t tls_init(const uint8_t *ca_cert, uint32_t ca_cert_len) {
+  const char *cipher_list = TLS_CIPHER_LIST;
+
+  if (g_tls_ctx) {
+    return ERR_OK;
+  }
+
+  wolfSSL_Init();
+  g_tls_ctx = wolfSSL_CTX_new(wolfTLSv1_2_client_method());
+  CHECK_EXPR_GOTO(!g_tls_ctx, _ERROR, "Failed to create SSL context");
+
+  if (g_tls_psk_key_len) {
+    /* the key authenticates both ends, there is no certificate to check */
+    wolfSSL_CTX_set_psk_client_callback(g_tls_ctx, tls_psk_client_cb);
+    wolfSSL_CTX_set_verify(g_tls_ctx, WOLFSSL_VERIFY_NONE, NULL);
+    cipher_list = TLS_PSK_CIPHER_LIST;
+  } else if (ca_cert) {
+#if defined(CONFIG_TLS_VERIFY_PEER) && CONFIG_TLS_VERIFY_PEER == 0
+    /* verification turned off by the build, the CA is not even parsed */
+    wolfSSL_CTX_set_verify(g_tls_ctx, WOLFSSL_VERIFY_NONE, NULL);
+#else
+    /* Load and verify CA certificate, PEM is still taken but DER skips the
+     * base64 decoding */
+    CHECK_EXPR_GOTO(
+      wolfSSL_CTX_load_verify_buffer(
+          g_tls_ctx, ca_cert, ca_cert_len,
+          (ca_cert_len > 10 &&
+           0 == osl_strncmp(ca_cert, (const uint8_t *)"-----BEGIN", 10))
+              ? WOLFSSL_FILETYPE_PEM
+              : WOLFSSL_FILETYPE_ASN1) != SSL_SUCCESS,
+      _ERROR, "Failed to load CA certificate");
+    wolfSSL_CTX_set_verify(g_tls_ctx, WOLFSSL_VERIFY_PEER, NULL);
+#endif
+  } else {
+    /* no CA to check the server against */
+    wolfSSL_CTX_set_verify(g_tls_ctx, WOLFSSL_VERIFY_NONE, NULL);
+  }
+
+  CHECK_EXPR_GOTO(
+      wolfSSL_CTX_set_cipher_list(g_tls_ctx, cipher_list) != SSL_SUCCESS,
+      _ERROR, "No usable cipher suite in %s", cipher_list);
+
+  wolfSSL_SetIOSend(g_tls_ctx, wolfssl_send);
+  wolfSSL_SetIORecv(g_tls_ctx, wolfssl_recv);
+
+  /* ask for session tickets, see tls_session_offer() */
+  wolfSSL_CTX_set_timeout(g_tls_ctx, TLS_SESSION_TIMEOUT);
+  wolfSSL_CTX_UseSessionTicket(g_tls_ctx);
+
+  return ERR_OK;
+
+_ERROR:
+  tls_deinit();
+  return ERR_FAIL;
+}
+
+int32_t tls_set_psk(const struct tls_psk_t *psk) {
+  if (psk && (NULL == psk->identity || NULL == psk->key || 0 == psk->key_len ||
+              psk->key_len > sizeof(g_tls_psk_key) ||
+              osl_strlen(psk->identity) > TLS_PSK_IDENTITY_LEN)) {
+    return ERR_INVALID_PARAM;
+  }
+
+  osl_memset(g_tls_psk_identity, 0, sizeof(g_tls_psk_identity));
+  osl_memset(g_tls_psk_key, 0, sizeof(g_tls_psk_key));
+  g_tls_psk_key_len = 0;
+  if (psk) {
+    osl_strcpy(g_tls_psk_identity, psk->identity);
+    osl_memcpy(g_tls_psk_key, psk->key, psk->key_len);
+    g_tls_psk_key_len = psk->key_len;
+  }
+
+  /* the next tls_init() builds the context for the new mode */
+  tls_deinit();
+  tls_session_clear();
+
+  return ERR_OK;
+}
+
+void tls_deinit(void) {
+  if (g_tls_ctx) {
+    /* connections still open keep their reference until disconnected */
+    wolfSSL_CTX_free(g_tls_ctx);
+    g_tls_ctx = NULL;
+  }
+}
+
 handle_t tls_connect(const uint8_t *host, uint16_t port, const uint8_t *ca_cert,
                      uint16_t ca_cert_len, uint32_t timeout) {
   struct tls_t *net = NULL;
-  handle_t tmr = 0;
+  deadline_t deadline = 0;
   int connect_ret = ERR_OTHERS;
   int ssl_err = 0;
+  uint8_t offered = 0;
 
-  /* 1. Initialize TLS context */
+  /* 1. Get the shared TLS context */
+  if (ERR_OK != tls_init(ca_cert, ca_cert_len)) {
+    return ERR_FAIL;
+  }
   SAFE_ALLOC(net, sizeof(struct tls_t));
-  tmr = countdown_start(timeout);
-  CHECK_EXPR_GOTO(0 == tmr, _ERROR, "Failed to start timeout counter");
-
-  wolfSSL_Init();
-  net->wolf_ctx = wolfSSL_CTX_new(wolfTLSv1_2_client_method());
-  CHECK_EXPR_GOTO(!net->wolf_ctx, _ERROR, "Failed to create SSL context");
-
-  /* 2. Load and verify CA certificate */
-#if defined(USE_SDK_HTTPS)
-  CHECK_EXPR_GOTO(
-      wolfSSL_CTX_load_verify_buffer(net->wolf_ctx, ca_cert, ca_cert_len,
-                                     WOLFSSL_FILETYPE_PEM) != SSL_SUCCESS,
-      _ERROR, "Failed to load CA certificate");
-  wolfSSL_CTX_set_verify(net->wolf_ctx, WOLFSSL_VERIFY_PEER, NULL);
-#else
-  wolfSSL_CTX_set_verify(net->wolf_ctx, WOLFSSL_VERIFY_NONE, NULL);
-#endif
-
-  /* 3. Set IO callbacks */
-  wolfSSL_SetIOSend(net->wolf_ctx, wolfssl_send);
-  wolfSSL_SetIORecv(net->wolf_ctx, wolfssl_recv);
+  deadline = deadline_start(timeout);
 
-  /* 4. Establish TCP connection */
-  net->handle = plat_tcp_connect(host, port, countdown_left(tmr));
+  /* 2. Establish TCP connection */
+  net->handle = plat_tcp_connect(host, port, deadline_left(deadline));
   CHECK_EXPR_GOTO(net->handle < 0, _ERROR,
                   "Failed to establish TCP connection");
 
-  /* 5. Create SSL session */
-  net->wolf_ssl = wolfSSL_new(net->wolf_ctx);
+  /* 3. Create SSL session */
+  net->wolf_ssl = wolfSSL_new(g_tls_ctx);
   CHECK_EXPR_GOTO(!net->wolf_ssl, _ERROR, "Failed to create SSL session");
 
   wolfSSL_set_fd(net->wolf_ssl, net->handle);
   wolfSSL_SetIOWriteCtx(net->wolf_ssl, net);
   wolfSSL_SetIOReadCtx(net->wolf_ssl, net);
-  net->send_timeout = net->recv_timeout = countdown_left(tmr);
+  net->send_timeout = net->recv_timeout = deadline_left(deadline);
 
-  /* 6. Perform SSL handshake */
+  /* 4. Offer the last session */
+  offered = tls_session_offer(net->wolf_ssl, host, port);
+
+  /* 5. Perform SSL handshake */
   while ((connect_ret = wolfSSL_connect(net->wolf_ssl)) != SSL_SUCCESS) {
     ssl_err = wolfSSL_get_error(net->wolf_ssl, connect_ret);
 
     if (ssl_err == SSL_ERROR_WANT_READ) {
-      if (countdown_is_expired(tmr)) {
+      if (deadline_is_expired(deadline)) {
         logd("TLS handshake timeout");
         break;
       }
-      net->send_timeout = net->recv_timeout = countdown_left(tmr);
+      net->send_timeout = net->recv_timeout = deadline_left(deadline);
       continue;
     }
     logd("TLS handshake failed with error: %d", ssl_err);
     break;
   }
 
+  if (connect_ret != SSL_SUCCESS && offered) {
+    /* don't let a session the server chokes on fail every reconnect */
+    tls_session_clear();
+  }
   CHECK_EXPR_GOTO(connect_ret != SSL_SUCCESS, _ERROR, "TLS handshake failed");
 
-  countdown_stop(tmr);
+  g_tls_stats.handshakes++;
+  if (wolfSSL_session_reused(net->wolf_ssl)) {
+    g_tls_stats.resumed++;
+    tls_session_save(net->wolf_ssl, host, port, 0);
+  } else {
+    if (offered) {
+      g_tls_stats.resume_missed++;
+    }
+    if (ERR_OK != tls_session_save(net->wolf_ssl, host, port, 1)) {
+      tls_session_clear();
+    }
+  }
+  logd("TLS %s handshake, %u of %u resumed",
+       wolfSSL_session_reused(net->wolf_ssl) ? "abbreviated" : "full",
+       g_tls_stats.resumed, g_tls_stats.handshakes);
+
   return (handle_t)net;
 
 _ERROR:
@@ -146,9 +422,6 @@ _ERROR:
       plat_tcp_disconnect(net->handle);
     if (net->wolf_ssl)
       wolfSSL_free(net->wolf_ssl);
-    if (net->wolf_ctx)
-      wolfSSL_CTX_free(net->wolf_ctx);
-    countdown_stop(tmr);
     SAFE_FREE(net);
   }
   return ERR_FAIL;
@@ -170,30 +443,67 @@ int32_t tls_send(handle_t handle, void *buf, uint32_t len, uint32_t timeout) {
 
 int32_t tls_recv(handle_t handle, void *buf, uint32_t len, uint32_t timeout) {
   struct tls_t *net = (struct tls_t *)handle;
+  uint32_t avail = net->rx_tail - net->rx_head;
   int32_t ret = 0;
 
-  net->recv_timeout = timeout;
-  ret = wolfSSL_read(net->wolf_ssl, buf, len);
+  if (0 == avail) {
+    net->recv_timeout = timeout;
 
-  if (wolfSSL_want_read(net->wolf_ssl)) {
-    return 0;
+    /* large reads go straight to the caller, small ones through rx_buf */
+    if (len >= TLS_READ_BUF_LEN) {
+      ret = wolfSSL_read(net->wolf_ssl, buf, len);
+    } else {
+      ret = wolfSSL_read(net->wolf_ssl, net->rx_buf, TLS_READ_BUF_LEN);
+    }
+
+    if (wolfSSL_want_read(net->wolf_ssl)) {
+      return 0;
+    }
+
+    if (ret <= 0 || len >= TLS_READ_BUF_LEN) {
+      return ret;
+    }
+
+    net->rx_head = 0;
+    net->rx_tail = avail = ret;
   }
 
-  return ret;
+  if (len > avail) {
+    len = avail;
+  }
+
+  osl_memcpy(buf, &net->rx_buf[net->rx_head], len);
+  net->rx_head += len;
+
+  return len;
+}
+
+int32_t tls_pending(handle_t handle) {
+  struct tls_t *net = (struct tls_t *)handle;
+
+  return (net->rx_tail - net->rx_head) + wolfSSL_pending(net->wolf_ssl);
 }
 
 int32_t tls_disconnect(handle_t handle) {
   struct tls_t *net = (struct tls_t *)handle;
 
   if (net) {
+    /* servers drop the session of a connection closed without close_notify */
+    net->send_timeout = TLS_CLOSE_NOTIFY_TIMEOUT;
+    wolfSSL_shutdown(net->wolf_ssl);
     plat_tcp_disconnect(net->handle);
     wolfSSL_free(net->wolf_ssl);
-    wolfSSL_CTX_free(net->wolf_ctx);
     osl_free(net);
   }
 
   return 0;
 }
+
+void tls_get_stats(struct tls_stats_t *stats) {
+  if (stats) {
+    *stats = g_tls_stats;
+  }
+}
 #else
 handle_t tls_connect(const uint8_t *host, uint16_t port, const uint8_t *ca_cert,
                      uint16_t ca_cert_len, uint32_t timeout) {
@@ -209,4 +519,18 @@ int32_t tls_recv(handle_t handle, void *buf, uint32_t len, uint32_t timeout) {
 }
 
 int32_t tls_disconnect(handle_t handle) { return -1; }
+
+int32_t tls_pending(handle_t handle) { return 0; }
+
+int32_t tls_init(const uint8_t *ca_cert, uint32_t ca_cert_len) { return -1; }
+
+void tls_deinit(void) {}
+
+int32_t tls_set_psk(const struct tls_psk_t *psk) { return -1; }
+
+void tls_get_stats(struct tls_stats_t *stats) {
+  if (stats) {
+    osl_memset(stats, 0, sizeof(*stats));
+  }
+}
 #endif
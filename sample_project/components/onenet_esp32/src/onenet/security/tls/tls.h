@@ -24,16 +24,73 @@ extern "C" {
 /*****************************************************************************/
 /* External Structures, Enum and Typedefs                                    */
 /*****************************************************************************/
+/* Pre-shared key replacing the certificates, see tls_set_psk() */
+struct tls_psk_t {
+  /** Identity sent to the server, At most 128 characters */
+  const uint8_t *identity;
+  /** Key shared with the server */
+  const uint8_t *key;
+  /** Key length, At most 64 bytes */
+  uint32_t key_len;
+};
+
+struct tls_stats_t {
+  /** Handshakes completed */
+  uint32_t handshakes;
+  /** Handshakes that resumed the saved session */
+  uint32_t resumed;
+  /** Handshakes where the saved session was offered but the server did a full
+   * handshake */
+  uint32_t resume_missed;
+};
 
 /*****************************************************************************/
 /* External Variables and Functions                                          */
 /*****************************************************************************/
+/**
+ * @brief Create the TLS context shared by every connection
+ *
+ * The CA certificate is parsed once here instead of on every tls_connect().
+ * tls_connect() calls it itself when it was not called before. With a CA the
+ * server certificate must chain to it or the handshake fails, unless the build
+ * sets CONFIG_TLS_VERIFY_PEER to 0.
+ *
+ * @param ca_cert CA certificate, DER or PEM, NULL - the server is not verified
+ * @param ca_cert_len Certificate length
+ * @retval  0 - Succeed, Also when the context already exists
+ * @retval -1 - Operation failed
+ */
+int32_t tls_init(const uint8_t *ca_cert, uint32_t ca_cert_len);
+
+/**
+ * @brief Switch the connections to TLS-PSK
+ *
+ * Only for servers configured with the same identity and key. The handshake
+ * then skips certificate parsing and the RSA operations, and only PSK cipher
+ * suites are offered. The identity and key are copied. Call it before
+ * tls_init(), or before tm_login() when going through the thing model API. A
+ * context that already exists is freed so the next tls_init() picks the mode
+ * up.
+ *
+ * @param psk Identity and key, NULL - Back to certificates
+ * @retval  0 - Succeed
+ * @retval -2 - Invalid identity or key
+ */
+int32_t tls_set_psk(const struct tls_psk_t *psk);
+
+/**
+ * @brief Free the shared TLS context
+ *
+ * Connections still open keep working until tls_disconnect().
+ */
+void tls_deinit(void);
+
 /**
  * @brief Create TLS Secure connection.
  *
  * @param host TLS Connection destination address
  * @param port TLS Connect Target Port
- * @param ca_cert Safety Certificate
+ * @param ca_cert Safety Certificate, Only used when tls_init() was not called
  * @param ca_cert_len Certificate length
  * @param timeout Timeout to create connection
  * @retval -1 - Operation failed
@@ -66,6 +123,17 @@ int32_t tls_send(handle_t handle, void *buf, uint32_t len, uint32_t timeout);
  */
 int32_t tls_recv(handle_t handle, void *buf, uint32_t len, uint32_t timeout);
 
+/**
+ * @brief Get the number of received bytes already decrypted
+ *
+ * tls_recv() returns them without waiting on the socket, so a caller can keep
+ * parsing while this is non-zero instead of waiting for more network data.
+ *
+ * @param handle TLS Connection operation handle
+ * @return Bytes tls_recv() can return immediately
+ */
+int32_t tls_pending(handle_t handle);
+
 /**
  * @brief Close assignmentTLSSecure connection.
  *
@@ -74,6 +142,17 @@ int32_t tls_recv(handle_t handle, void *buf, uint32_t len, uint32_t timeout);
  */
 int32_t tls_disconnect(handle_t handle);
 
+/**
+ * @brief Get the handshake counters since startup
+ *
+ * The last session negotiated is offered again on the next tls_connect() to
+ * the same host and port, with its session ID and session ticket, resumed
+ * handshakes skip the key exchange and certificate verification.
+ *
+ * @param stats Buffer address used to receive the counters
+ */
+void tls_get_stats(struct tls_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -28,6 +28,7 @@
 #include "tm_user.h"
 
 #if defined(SDK_USE_MQTTS)
+#include "tm_io.h"
 #include "tm_mqtt.h"
 #elif defined(SDK_USE_COAP)
 #include "tm_coap.h"
@@ -195,14 +196,14 @@ int32_t tm_send_response(const uint8_t *name, uint8_t *msg_id, int32_t msg_code,
 }
 
 #if defined(SDK_USE_MQTTS)
-static int32_t wait_post_reply(int32_t post_id, handle_t cd_hdl) {
+static int32_t wait_post_reply(int32_t post_id, deadline_t deadline) {
   uint8_t temp_id[16] = {0};
   int32_t ret = ERR_TIMEOUT;
 
   osl_sprintf(temp_id, (const uint8_t *)"%d", post_id);
 
   do {
-    ret = tm_mqtt_step(countdown_left(cd_hdl));
+    ret = tm_mqtt_step(deadline_left(deadline));
 
     if (0 > ret) {
       loge("wait reply error");
@@ -218,40 +219,73 @@ static int32_t wait_post_reply(int32_t post_id, handle_t cd_hdl) {
         }
       }
     }
-  } while (0 == countdown_is_expired(cd_hdl));
+  } while (0 == deadline_is_expired(deadline));
 
   return ret;
 }
 #endif
 
-int32_t tm_send_request(const uint8_t *name, uint8_t as_raw, void *data,
-                        uint32_t data_len, void **reply_data,
-                        uint32_t *reply_data_len, uint32_t timeout_ms) {
+/* Pack data into a request with the given id and publish it, tm_data params are
+ * consumed whether or not the publish succeeds */
+static int32_t tm_publish_request(const uint8_t *name, uint8_t as_raw,
+                                  void *data, int32_t post_id,
+                                  uint32_t timeout_ms) {
   uint8_t *topic = NULL;
   uint8_t *payload = NULL;
   uint32_t payload_len = 0;
-  int32_t post_id = get_post_id();
-  handle_t cd_hdl = 0;
   int32_t ret = ERR_OTHERS;
 
-  cd_hdl = countdown_start(timeout_ms);
-
   if (NULL == (payload = osl_malloc(SDK_PAYLOAD_LEN))) {
+    if (!as_raw && data) {
+      tm_data_delete(data);
+    }
     return ERR_IO;
   }
 
   osl_memset(payload, 0, SDK_PAYLOAD_LEN);
   payload_len = tm_onejson_pack_request(payload, post_id, data, as_raw);
-  g_tm_obj.reply_info.reply_as_raw = as_raw;
 
   topic = construct_topic(g_tm_obj.topic_prefix, name);
 
 #if defined(SDK_USE_MQTTS)
-  ret =
-      tm_mqtt_send_packet(topic, payload, payload_len, countdown_left(cd_hdl));
+  ret = tm_mqtt_send_packet(topic, payload, payload_len, timeout_ms);
+#elif defined(SDK_USE_COAP)
+  ret = tm_coap_send_packet(topic, payload, payload_len, timeout_ms);
+#elif defined(SDK_USE_NBIOT)
+  ret = tm_lwm2m_send_packet(topic, payload, payload_len, timeout_ms);
+#elif defined(SDK_USE_HTTPS)
+  ret = tm_https_send_packet(topic, payload, payload_len, timeout_ms);
+#endif
+
+  SAFE_FREE(topic);
+  SAFE_FREE(payload);
+
+  return ret;
+}
+
+int32_t tm_send_request(const uint8_t *name, uint8_t as_raw, void *data,
+                        uint32_t data_len, void **reply_data,
+                        uint32_t *reply_data_len, uint32_t timeout_ms) {
+  int32_t post_id = 0;
+  deadline_t deadline = 0;
+  int32_t ret = ERR_OTHERS;
+
+#if defined(SDK_USE_MQTTS)
+  if (tm_io_active()) {
+    return tm_io_post(name, as_raw, data, reply_data, timeout_ms);
+  }
+#endif
+
+  post_id = get_post_id();
+  deadline = deadline_start(timeout_ms);
+
+  g_tm_obj.reply_info.reply_as_raw = as_raw;
+  ret = tm_publish_request(name, as_raw, data, post_id, timeout_ms);
+
+#if defined(SDK_USE_MQTTS)
   if (ERR_OK == ret) {
     g_tm_obj.reply_info.reply_status = REPLY_STATUS_WAIT;
-    if (0 == wait_post_reply(post_id, cd_hdl)) {
+    if (0 == wait_post_reply(post_id, deadline)) {
       // logd("reply err code: %d", g_tm_obj.reply_info.reply_code);
       if (200 == g_tm_obj.reply_info.reply_code) {
         logd("post data ok");
@@ -267,35 +301,26 @@ int32_t tm_send_request(const uint8_t *name, uint8_t as_raw, void *data,
     g_tm_obj.reply_info.reply_code = 0;
     g_tm_obj.reply_info.reply_as_raw = 0;
   }
-
-#elif defined(SDK_USE_COAP)
-  ret =
-      tm_coap_send_packet(topic, payload, payload_len, countdown_left(cd_hdl));
-  if (ERR_OK == ret) {
-    logd("tm_send_request ok.");
-  } else {
-    logd("tm_send_request failed.");
-  }
-#elif defined(SDK_USE_NBIOT)
-  ret =
-      tm_lwm2m_send_packet(topic, payload, payload_len, countdown_left(cd_hdl));
+#elif defined(SDK_USE_COAP) || defined(SDK_USE_NBIOT)
   if (ERR_OK == ret) {
     logd("tm_send_request ok.");
   } else {
     logd("tm_send_request failed.");
   }
-#elif defined(SDK_USE_HTTPS)
-  ret =
-      tm_https_send_packet(topic, payload, payload_len, countdown_left(cd_hdl));
 #endif
 
-  SAFE_FREE(topic);
-  SAFE_FREE(payload);
-  countdown_stop(cd_hdl);
-
   return ret;
 }
 
+#if defined(SDK_USE_MQTTS)
+int32_t tm_send_request_nowait(const uint8_t *name, uint8_t as_raw, void *data,
+                               int32_t *post_id, uint32_t timeout_ms) {
+  *post_id = get_post_id();
+
+  return tm_publish_request(name, as_raw, data, *post_id, timeout_ms);
+}
+#endif
+
 static int32_t tm_prop_set_handle(const uint8_t *name, void *res) {
   uint16_t i = 0;
   int32_t ret = 0;
@@ -374,6 +399,12 @@ static void tm_prop_get(uint8_t *payload, uint32_t payload_len) {
 }
 
 static void tm_post_reply(uint8_t *payload, uint32_t payload_len) {
+#if defined(SDK_USE_MQTTS)
+  // 回复属于I/O任务队列中的请求
+  if (0 == tm_io_reply(payload, payload_len)) {
+    return;
+  }
+#endif
   if (REPLY_STATUS_WAIT == g_tm_obj.reply_info.reply_status) {
     g_tm_obj.reply_info.reply_data = tm_onejson_parse_reply(
         payload, payload_len, g_tm_obj.reply_info.reply_id,
@@ -576,8 +607,7 @@ int tm_mqtt_cmp_post(const char *product_id, const char *device_name,
   char payload[256] = {0};
   uint32_t payload_len = 0;
 
-  handle_t cd_hdl = countdown_start(timeout_ms);
-  AIOT_ASSERT(cd_hdl > 0);
+  deadline_t deadline = deadline_start(timeout_ms);
 
   uint32_t post_id = get_post_id();
   snprintf(topic, sizeof(topic), "$sys/%s/%s/cmp/property/post", product_id,
@@ -586,10 +616,10 @@ int tm_mqtt_cmp_post(const char *product_id, const char *device_name,
   generate_cardmgr_msg(payload, sizeof(payload), CARDMGR_MSG_MODE_TOPIC);
   payload_len = strlen(payload);
   int ret =
-      tm_mqtt_send_packet(topic, payload, payload_len, countdown_left(cd_hdl));
+      tm_mqtt_send_packet(topic, payload, payload_len, deadline_left(deadline));
   if (ERR_OK == ret) {
     g_tm_obj.reply_info.reply_status = REPLY_STATUS_WAIT;
-    if (0 == wait_post_reply(post_id, cd_hdl)) {
+    if (0 == wait_post_reply(post_id, deadline)) {
       if (200 == g_tm_obj.reply_info.reply_code) {
         ret = ERR_OK;
       } else {
@@ -602,7 +632,6 @@ int tm_mqtt_cmp_post(const char *product_id, const char *device_name,
   }
 
 _END:
-  countdown_stop(cd_hdl);
   return ret;
 }
 #endif
@@ -722,6 +751,30 @@ int32_t tm_post_event(void *event_data, uint32_t timeout_ms) {
                          NULL, NULL, timeout_ms);
 }
 
+#if defined(SDK_USE_MQTTS)
+int32_t tm_post_property_async(void *prop_data, tm_post_cb callback, void *arg,
+                               uint32_t timeout_ms) {
+  return tm_io_post_async((const uint8_t *)TM_TOPIC_PROP_POST, prop_data,
+                          callback, arg, timeout_ms);
+}
+
+int32_t tm_post_event_async(void *event_data, tm_post_cb callback, void *arg,
+                            uint32_t timeout_ms) {
+  return tm_io_post_async((const uint8_t *)TM_TOPIC_EVENT_POST, event_data,
+                          callback, arg, timeout_ms);
+}
+
+int32_t tm_post_history_data_async(void *history_data, tm_post_cb callback,
+                                   void *arg, uint32_t timeout_ms) {
+  return tm_io_post_async((const uint8_t *)TM_TOPIC_HISTORY_DATA_POST,
+                          history_data, callback, arg, timeout_ms);
+}
+
+int32_t tm_get_ping_rtt(uint32_t *rtt_ms, uint32_t *srtt_ms) {
+  return tm_mqtt_get_ping_rtt(rtt_ms, srtt_ms);
+}
+#endif
+
 int32_t tm_get_desired_props(uint32_t timeout_ms) {
   void *prop_list = tm_data_array_create(g_tm_obj.downlink_tbl.prop_tbl_size);
   uint32_t i = 0;
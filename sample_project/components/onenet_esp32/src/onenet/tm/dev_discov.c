@@ -576,13 +576,13 @@ exit:
 
 int32_t discovery_step(uint32_t timeout_ms)
 {
-    handle_t cd_hdl     = countdown_start(timeout_ms);
-    uint32_t recved_len = 0;
-    int32_t  ret        = ERR_TIMEOUT;
+    deadline_t deadline   = deadline_start(timeout_ms);
+    uint32_t   recved_len = 0;
+    int32_t    ret        = ERR_TIMEOUT;
 
     do {
         /** Attempt to receive UDP Message*/
-        recved_len = plat_udp_recv(g_discov->net_handle, g_discov->net_buf, NETWORK_SENDRECV_BUF_LEN, countdown_left(cd_hdl));
+        recved_len = plat_udp_recv(g_discov->net_handle, g_discov->net_buf, NETWORK_SENDRECV_BUF_LEN, deadline_left(deadline));
         if (0 < recved_len) {
             if (1 == parse_and_process_query(g_discov->net_buf, recved_len)) {
                 ret = ERR_OK;
@@ -600,8 +600,7 @@ int32_t discovery_step(uint32_t timeout_ms)
             }
         }
         time_delay_ms(10);
-    } while (0 == countdown_is_expired(cd_hdl));
-    countdown_stop(cd_hdl);
+    } while (0 == deadline_is_expired(deadline));
 
     return ret;
 }
@@ -0,0 +1,599 @@
+/**
+ * Copyright (c), 2012~2024 iot.10086.cn All Rights Reserved
+ *
+ * @file tm_io.c
+ * @brief Thing Model I/O task, serializes requests from any thread onto the
+ *        task that owns the MQTT connection
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include "tm_io.h"
+
+#include <stdatomic.h>
+
+#include "common.h"
+#include "err_def.h"
+#include "log.h"
+#include "mpsc_queue.h"
+#include "plat_osl.h"
+#include "plat_time.h"
+#include "tm_data.h"
+#include "tm_offline.h"
+#include "tm_onejson.h"
+
+/*****************************************************************************/
+/* Local Definitions ( Constant and Macro )                                  */
+/*****************************************************************************/
+#ifndef TM_IO_STACK_SIZE
+#define TM_IO_STACK_SIZE 8192
+#endif
+
+#ifndef TM_IO_PRIORITY
+#define TM_IO_PRIORITY 5
+#endif
+
+/* Longest time the task stays in tm_step, which bounds how long a new command
+ * sits in the queue before it is sent */
+#ifndef TM_IO_STEP_MS
+#define TM_IO_STEP_MS 20
+#endif
+
+/* Reconnect backoff: the delay starts at MIN and doubles per failed attempt up
+ * to MAX, then up to JITTER percent of it is taken off at random so devices
+ * that dropped together do not come back in step */
+#ifndef TM_IO_RECONNECT_MIN_MS
+#define TM_IO_RECONNECT_MIN_MS 1000
+#endif
+
+#ifndef TM_IO_RECONNECT_MAX_MS
+#define TM_IO_RECONNECT_MAX_MS 120000
+#endif
+
+#ifndef TM_IO_RECONNECT_JITTER
+#define TM_IO_RECONNECT_JITTER 50
+#endif
+
+/* A connection that stayed up this long is retried at once when it drops,
+ * shorter ones keep backing off so a flapping link is not hammered */
+#ifndef TM_IO_RESUME_UPTIME_MS
+#define TM_IO_RESUME_UPTIME_MS 30000
+#endif
+
+/*****************************************************************************/
+/* Structures, Enum and Typedefs                                             */
+/*****************************************************************************/
+struct tm_io_cmd {
+  struct mpsc_node node;  /* must be the first member */
+  struct tm_io_cmd *next; /* pending list, I/O task only */
+  void *data;
+  void *reply_data;
+  int32_t post_id;
+  int32_t ret;
+  deadline_t deadline;
+  tm_post_cb callback;
+  void *arg;
+  handle_t done; /* given when a synchronous caller may collect the result */
+  atomic_int refs;
+  uint8_t as_raw;
+  uint8_t want_reply;
+  uint8_t name[1];
+};
+
+struct tm_io_obj {
+  struct mpsc_queue queue;
+  struct tm_io_cmd *pending;
+  _Atomic handle_t task;
+  handle_t exited;
+  handle_t wake; /* cuts a reconnect wait short on tm_io_stop */
+  atomic_int state;
+  atomic_int enabled;   /* between tm_io_start and tm_io_stop */
+  atomic_int accepting; /* the task still takes commands */
+  atomic_int producers; /* callers inside tm_io_enqueue */
+  atomic_int stop;
+  tm_io_state_cb state_cb;
+  uint8_t *product_id;
+  uint8_t *dev_name;
+  uint8_t *access_key;
+  uint64_t expire_time;
+  uint32_t timeout_ms;
+  uint32_t reconnect_min_ms;
+  uint32_t reconnect_max_ms; /* 0 - the task exits when the connection drops */
+  uint32_t reconnect_jitter;
+};
+
+/*****************************************************************************/
+/* Local Function Prototype                                                  */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Local Variables                                                           */
+/*****************************************************************************/
+static struct tm_io_obj g_tm_io = {
+    .reconnect_min_ms = TM_IO_RECONNECT_MIN_MS,
+    .reconnect_max_ms = TM_IO_RECONNECT_MAX_MS,
+    .reconnect_jitter = TM_IO_RECONNECT_JITTER,
+};
+
+/*****************************************************************************/
+/* Global Variables                                                          */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Function Implementation                                                   */
+/*****************************************************************************/
+static void tm_io_free_data(uint8_t as_raw, void *data) {
+  if (NULL == data) {
+    return;
+  }
+
+  if (as_raw) {
+    osl_free(data);
+  } else {
+    tm_data_delete(data);
+  }
+}
+
+static struct tm_io_cmd *tm_io_cmd_new(const uint8_t *name, uint8_t as_raw,
+                                       void *data, uint32_t timeout_ms) {
+  uint32_t name_len = osl_strlen(name);
+  struct tm_io_cmd *cmd = osl_calloc(1, sizeof(*cmd) + name_len);
+
+  if (NULL == cmd) {
+    return NULL;
+  }
+
+  // 原始数据属于调用者，需要复制一份
+  if (as_raw && data && NULL == (data = osl_strdup(data))) {
+    osl_free(cmd);
+    return NULL;
+  }
+
+  osl_memcpy(cmd->name, name, name_len);
+  cmd->data = data;
+  cmd->as_raw = as_raw;
+  cmd->deadline = deadline_start(timeout_ms);
+  atomic_init(&cmd->refs, 1);
+
+  return cmd;
+}
+
+static void tm_io_cmd_put(struct tm_io_cmd *cmd) {
+  if (1 != atomic_fetch_sub(&cmd->refs, 1)) {
+    return;
+  }
+
+  tm_io_free_data(cmd->as_raw, cmd->data);
+  tm_io_free_data(cmd->as_raw, cmd->reply_data);
+  if (cmd->done) {
+    osl_sem_delete(cmd->done);
+  }
+  osl_free(cmd);
+}
+
+static void tm_io_cmd_complete(struct tm_io_cmd *cmd, int32_t ret) {
+  cmd->ret = ret;
+
+  if (cmd->callback) {
+    cmd->callback(cmd->arg, ret);
+  }
+  if (cmd->done) {
+    osl_sem_give(cmd->done);
+  }
+
+  tm_io_cmd_put(cmd);
+}
+
+static int32_t tm_io_enqueue(struct tm_io_cmd *cmd) {
+  int32_t ret = ERR_OK;
+
+  // producers 与 accepting 配合，保证任务退出前不会漏掉正在入队的命令
+  atomic_fetch_add(&g_tm_io.producers, 1);
+  if (atomic_load(&g_tm_io.accepting)) {
+    mpsc_queue_push(&g_tm_io.queue, &cmd->node);
+  } else {
+    ret = ERR_NETWORK;
+  }
+  atomic_fetch_sub(&g_tm_io.producers, 1);
+
+  return ret;
+}
+
+static void tm_io_send(struct tm_io_cmd *cmd) {
+  void *data = cmd->data;
+  int32_t ret = ERR_TIMEOUT;
+
+  if (deadline_is_expired(cmd->deadline)) {
+    tm_io_cmd_complete(cmd, ERR_TIMEOUT);
+    return;
+  }
+
+  // tm_data 数据在发送时被释放，原始数据由命令持有
+  if (!cmd->as_raw) {
+    cmd->data = NULL;
+  }
+  ret = tm_send_request_nowait(cmd->name, cmd->as_raw, data, &cmd->post_id,
+                               deadline_left(cmd->deadline));
+  if (ERR_OK != ret) {
+    tm_io_cmd_complete(cmd, ret);
+    return;
+  }
+
+  cmd->next = g_tm_io.pending;
+  g_tm_io.pending = cmd;
+}
+
+static void tm_io_drain(void) {
+  struct mpsc_node *node = NULL;
+
+  while (NULL != (node = mpsc_queue_pop(&g_tm_io.queue))) {
+    tm_io_send((struct tm_io_cmd *)node);
+  }
+}
+
+static void tm_io_expire(void) {
+  struct tm_io_cmd **link = &g_tm_io.pending;
+
+  while (*link) {
+    struct tm_io_cmd *cmd = *link;
+
+    if (deadline_is_expired(cmd->deadline)) {
+      *link = cmd->next;
+      tm_io_cmd_complete(cmd, ERR_TIMEOUT);
+    } else {
+      link = &cmd->next;
+    }
+  }
+}
+
+/* Stop taking commands and fail everything not yet answered */
+static void tm_io_fail_all(int32_t ret) {
+  struct mpsc_node *node = NULL;
+
+  atomic_store(&g_tm_io.accepting, 0);
+  while (0 != atomic_load(&g_tm_io.producers)) {
+    time_delay_ms(1);
+  }
+
+  while (g_tm_io.pending) {
+    struct tm_io_cmd *cmd = g_tm_io.pending;
+
+    g_tm_io.pending = cmd->next;
+    tm_io_cmd_complete(cmd, ret);
+  }
+
+  while (NULL != (node = mpsc_queue_pop(&g_tm_io.queue))) {
+    tm_io_cmd_complete((struct tm_io_cmd *)node, ret);
+  }
+}
+
+#if defined(CONFIG_TM_OFFLINE) && CONFIG_TM_OFFLINE == 1
+static void tm_io_offline_done(void *arg, int32_t ret) {
+  tm_offline_commit(ret);
+}
+
+/* Post the next batch of offline samples, tm_offline_pack limits the rate */
+static void tm_io_offline(void) {
+  void *data = tm_offline_pack(g_tm_io.product_id, g_tm_io.dev_name);
+  int32_t ret = ERR_OK;
+
+  if (NULL == data) {
+    return;
+  }
+
+  ret = tm_post_history_data_async(data, tm_io_offline_done, NULL,
+                                   g_tm_io.timeout_ms);
+  if (ERR_OK != ret) {
+    tm_offline_commit(ret);
+  }
+}
+#endif
+
+static void tm_io_notify(int32_t state, int32_t reason) {
+  atomic_store(&g_tm_io.state, state);
+  if (g_tm_io.state_cb) {
+    g_tm_io.state_cb(state, reason);
+  }
+}
+
+/* Delay before reconnect attempt number attempt, counted from 0 */
+static uint32_t tm_io_backoff(uint32_t attempt) {
+  uint32_t delay = g_tm_io.reconnect_min_ms;
+  uint32_t jitter = 0;
+
+  while (attempt-- > 0 && delay < g_tm_io.reconnect_max_ms) {
+    delay = (delay > g_tm_io.reconnect_max_ms / 2) ? g_tm_io.reconnect_max_ms
+                                                   : delay * 2;
+  }
+
+  jitter = (uint32_t)((uint64_t)delay * g_tm_io.reconnect_jitter / 100);
+
+  return delay - (uint32_t)osl_rand(0, (int32_t)jitter);
+}
+
+/* Log in and serve commands until the connection drops or the task is asked
+ * to stop. uptime is how long the connection was up, 0 if login failed */
+static int32_t tm_io_session(uint64_t *uptime) {
+  uint64_t online_at = 0;
+  int32_t ret = ERR_OK;
+
+  ret = tm_login((const char *)g_tm_io.product_id,
+                 (const char *)g_tm_io.dev_name,
+                 (const char *)g_tm_io.access_key, g_tm_io.expire_time,
+                 g_tm_io.timeout_ms);
+  if (ERR_OK != ret) {
+    loge("tm io login failed: %d", ret);
+    tm_io_fail_all(ret);
+    *uptime = 0;
+    return ret;
+  }
+
+  logi("tm io task online");
+  online_at = time_count_ms();
+  tm_io_notify(TM_IO_STATE_CONNECTED, ERR_OK);
+
+  while (!atomic_load(&g_tm_io.stop)) {
+    tm_io_drain();
+#if defined(CONFIG_TM_OFFLINE) && CONFIG_TM_OFFLINE == 1
+    tm_io_offline();
+#endif
+
+    if (0 > (ret = tm_step(TM_IO_STEP_MS))) {
+      loge("tm io step failed: %d", ret);
+      ret = ERR_NETWORK;
+      break;
+    }
+
+    tm_io_expire();
+  }
+
+  tm_io_fail_all(ERR_NETWORK);
+  tm_logout(g_tm_io.timeout_ms);
+  *uptime = time_count_ms() - online_at;
+
+  return ret;
+}
+
+static void tm_io_main(void *arg) {
+  uint32_t attempt = 0;
+  uint32_t delay = 0;
+  uint64_t uptime = 0;
+  int32_t ret = ERR_OK;
+
+  atomic_store(&g_tm_io.task, osl_thread_self());
+
+  while (1) {
+    ret = tm_io_session(&uptime);
+    if (atomic_load(&g_tm_io.stop) || 0 == g_tm_io.reconnect_max_ms) {
+      break;
+    }
+
+    // 稳定运行过的连接断开后立即重连，其余情况退避等待
+    if (uptime >= TM_IO_RESUME_UPTIME_MS) {
+      attempt = 0;
+      delay = 0;
+    } else {
+      delay = tm_io_backoff(attempt++);
+    }
+
+    logw("tm io reconnect in %u ms", (unsigned)delay);
+    tm_io_notify(TM_IO_STATE_CONNECTING, ret);
+    if (0 < delay && 0 == osl_sem_take(g_tm_io.wake, delay)) {
+      break;
+    }
+
+    // 等待期间的请求直接失败，重新登录时再接收
+    atomic_store(&g_tm_io.accepting, 1);
+  }
+
+  atomic_store(&g_tm_io.task, 0);
+  tm_io_notify(TM_IO_STATE_DISCONNECTED, ret);
+  osl_sem_give(g_tm_io.exited);
+}
+
+static void tm_io_release(void) {
+  SAFE_FREE(g_tm_io.product_id);
+  SAFE_FREE(g_tm_io.dev_name);
+  SAFE_FREE(g_tm_io.access_key);
+  if (g_tm_io.exited) {
+    osl_sem_delete(g_tm_io.exited);
+    g_tm_io.exited = 0;
+  }
+  if (g_tm_io.wake) {
+    osl_sem_delete(g_tm_io.wake);
+    g_tm_io.wake = 0;
+  }
+}
+
+int32_t tm_io_active(void) {
+  return atomic_load(&g_tm_io.enabled) &&
+         osl_thread_self() != atomic_load(&g_tm_io.task);
+}
+
+int32_t tm_io_post(const uint8_t *name, uint8_t as_raw, void *data,
+                   void **reply_data, uint32_t timeout_ms) {
+  struct tm_io_cmd *cmd = tm_io_cmd_new(name, as_raw, data, timeout_ms);
+  uint32_t wait_ms = timeout_ms;
+  int32_t ret = ERR_OK;
+
+  if (NULL == cmd) {
+    if (!as_raw) {
+      tm_io_free_data(as_raw, data);
+    }
+    return ERR_ALLOC;
+  }
+
+  if (0 == (cmd->done = osl_sem_create())) {
+    tm_io_cmd_put(cmd);
+    return ERR_ALLOC;
+  }
+
+  cmd->want_reply = (NULL != reply_data);
+  atomic_store(&cmd->refs, 2);
+
+  if (ERR_OK != (ret = tm_io_enqueue(cmd))) {
+    atomic_store(&cmd->refs, 1);
+    tm_io_cmd_put(cmd);
+    return ret;
+  }
+
+  // 任务每个周期都会检查超时，多等待一个周期以拿到任务给出的结果
+  if (wait_ms < OSL_WAIT_FOREVER - 2 * TM_IO_STEP_MS) {
+    wait_ms += 2 * TM_IO_STEP_MS;
+  }
+
+  if (0 == osl_sem_take(cmd->done, wait_ms)) {
+    ret = cmd->ret;
+    if (reply_data) {
+      *reply_data = cmd->reply_data;
+      cmd->reply_data = NULL;
+    }
+  } else {
+    ret = ERR_TIMEOUT;
+  }
+
+  tm_io_cmd_put(cmd);
+
+  return ret;
+}
+
+int32_t tm_io_post_async(const uint8_t *name, void *data, tm_post_cb callback,
+                         void *arg, uint32_t timeout_ms) {
+  struct tm_io_cmd *cmd = tm_io_cmd_new(name, 0, data, timeout_ms);
+  int32_t ret = ERR_OK;
+
+  if (NULL == cmd) {
+    tm_io_free_data(0, data);
+    return ERR_ALLOC;
+  }
+
+  cmd->callback = callback;
+  cmd->arg = arg;
+
+  if (ERR_OK != (ret = tm_io_enqueue(cmd))) {
+    tm_io_cmd_put(cmd);
+  }
+
+  return ret;
+}
+
+int32_t tm_io_reply(uint8_t *payload, uint32_t payload_len) {
+  struct tm_io_cmd **link = &g_tm_io.pending;
+  struct tm_io_cmd *cmd = NULL;
+  uint8_t reply_id[16] = {0};
+  int32_t reply_code = 0;
+  int32_t post_id = 0;
+  void *data = NULL;
+
+  if (NULL == g_tm_io.pending) {
+    return -1;
+  }
+
+  data =
+      tm_onejson_parse_reply(payload, payload_len, reply_id, &reply_code, 0);
+  post_id = osl_atoi(reply_id);
+
+  while (*link && (*link)->post_id != post_id) {
+    link = &(*link)->next;
+  }
+
+  if (NULL == (cmd = *link)) {
+    tm_io_free_data(0, data);
+    return -1;
+  }
+  *link = cmd->next;
+
+  if (cmd->want_reply && 200 == reply_code) {
+    if (cmd->as_raw) {
+      tm_io_free_data(0, data);
+      data = tm_onejson_parse_reply(payload, payload_len, reply_id, &reply_code,
+                                    1);
+    }
+    cmd->reply_data = data;
+    data = NULL;
+  }
+  tm_io_free_data(0, data);
+
+  tm_io_cmd_complete(cmd, (200 == reply_code) ? ERR_OK : ERR_OTHERS);
+
+  return 0;
+}
+
+int32_t tm_io_start(const char *product_id, const char *dev_name,
+                    const char *access_key, uint64_t expire_time,
+                    uint32_t timeout_ms, tm_io_state_cb state_cb) {
+  if (g_tm_io.exited) {
+    // 上一个任务仍在运行
+    if (0 != osl_sem_take(g_tm_io.exited, 0)) {
+      return ERR_REPETITIVE;
+    }
+    tm_io_release();
+  }
+
+  mpsc_queue_init(&g_tm_io.queue);
+  g_tm_io.pending = NULL;
+  g_tm_io.state_cb = state_cb;
+  g_tm_io.expire_time = expire_time;
+  g_tm_io.timeout_ms = timeout_ms;
+  g_tm_io.product_id = osl_strdup((const uint8_t *)product_id);
+  g_tm_io.dev_name = osl_strdup((const uint8_t *)dev_name);
+  g_tm_io.access_key = osl_strdup((const uint8_t *)access_key);
+  g_tm_io.exited = osl_sem_create();
+  g_tm_io.wake = osl_sem_create();
+
+  if (NULL == g_tm_io.product_id || NULL == g_tm_io.dev_name ||
+      NULL == g_tm_io.access_key || 0 == g_tm_io.exited ||
+      0 == g_tm_io.wake) {
+    tm_io_release();
+    return ERR_ALLOC;
+  }
+
+  atomic_store(&g_tm_io.stop, 0);
+  atomic_store(&g_tm_io.task, 0);
+  atomic_store(&g_tm_io.state, TM_IO_STATE_CONNECTING);
+  atomic_store(&g_tm_io.accepting, 1);
+  atomic_store(&g_tm_io.enabled, 1);
+
+  if (0 == osl_thread_create((const uint8_t *)"tm_io", tm_io_main, NULL,
+                             TM_IO_STACK_SIZE, TM_IO_PRIORITY)) {
+    atomic_store(&g_tm_io.enabled, 0);
+    tm_io_fail_all(ERR_SYSTEM_CONTROL);
+    tm_io_release();
+    return ERR_SYSTEM_CONTROL;
+  }
+
+  return ERR_OK;
+}
+
+int32_t tm_io_stop(uint32_t timeout_ms) {
+  if (0 == g_tm_io.exited) {
+    return ERR_OK;
+  }
+
+  atomic_store(&g_tm_io.stop, 1);
+  osl_sem_give(g_tm_io.wake);
+  if (0 != osl_sem_take(g_tm_io.exited, timeout_ms)) {
+    return ERR_TIMEOUT;
+  }
+
+  atomic_store(&g_tm_io.enabled, 0);
+  tm_io_release();
+
+  return ERR_OK;
+}
+
+int32_t tm_io_set_reconnect(uint32_t min_ms, uint32_t max_ms,
+                            uint32_t jitter_pct) {
+  if (jitter_pct > 100 || (0 != max_ms && (0 == min_ms || min_ms > max_ms))) {
+    return ERR_INVALID_PARAM;
+  }
+
+  g_tm_io.reconnect_min_ms = min_ms;
+  g_tm_io.reconnect_max_ms = max_ms;
+  g_tm_io.reconnect_jitter = jitter_pct;
+
+  return ERR_OK;
+}
+
+int32_t tm_io_get_state(void) { return atomic_load(&g_tm_io.state); }
@@ -62,6 +62,8 @@ void tm_mqtt_deinit(void);
  * @param dev_token 设备令牌，用于身份验证。
  * @param timeout_ms 操作超时时间，单位为毫秒。
  * @return 0表示成功，其他值表示失败
+ * @note CONFIG_TM_PERSISTENT_SESSION为1时不清除会话，服务器保留了会话时跳过订阅
+ * @note CONFIG_TM_MQTT_V5为1时使用MQTT 5.0登录(需定义MQTTV5)，否则使用MQTT 3.1.1
  */
 int32_t tm_mqtt_login(const uint8_t *product_id, const uint8_t *dev_name,
                       const uint8_t *dev_token, uint32_t timeout_ms);
@@ -96,10 +98,20 @@ int32_t tm_mqtt_step(uint32_t timeout_ms);
  * @param payload_len 消息负载的长度，单位为字节。
  * @param timeout_ms 操作超时时间，单位为毫秒。
  * @return 0表示成功，其他值表示失败
+ * @note CONFIG_TM_PERSISTENT_SESSION为1时以QoS1发送，未确认的消息保存在发件箱中，重新登录后补发
  */
 int32_t tm_mqtt_send_packet(const uint8_t *topic, uint8_t *payload,
                             uint32_t payload_len, uint32_t timeout_ms);
 
+/**
+ * @brief 获取心跳往返时延
+ *
+ * @param rtt_ms 最近一次心跳的往返时延，单位为毫秒，可为NULL。
+ * @param srtt_ms 平滑后的往返时延，单位为毫秒，可为NULL。
+ * @return 0表示成功，其他值表示未登录或尚未收到心跳响应
+ */
+int32_t tm_mqtt_get_ping_rtt(uint32_t *rtt_ms, uint32_t *srtt_ms);
+
 #ifdef __cplusplus
 }
 #endif
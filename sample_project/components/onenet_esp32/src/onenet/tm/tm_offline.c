@@ -0,0 +1,407 @@
+/**
+ * Copyright (c), 2012~2024 iot.10086.cn All Rights Reserved
+ *
+ * @file tm_offline.c
+ * @brief Thing Model offline buffer, keeps property samples taken while the
+ *        device is offline and uploads them as history data after login
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include "tm_offline.h"
+
+#include <stdatomic.h>
+
+#include "common.h"
+#include "err_def.h"
+#include "log.h"
+#include "plat_osl.h"
+#include "plat_store.h"
+#include "plat_time.h"
+#include "tm_data.h"
+#include "tm_onejson.h"
+
+#if defined(CONFIG_TM_OFFLINE) && CONFIG_TM_OFFLINE == 1
+/*****************************************************************************/
+/* Local Definitions ( Constant and Macro )                                  */
+/*****************************************************************************/
+/* Samples are collected in RAM and written one segment at a time, so a flash
+ * write covers many samples instead of one */
+#ifndef TM_OFFLINE_SEGMENT_SIZE
+#define TM_OFFLINE_SEGMENT_SIZE 1024
+#endif
+
+/* Segments kept in the store, the oldest one is dropped to make room */
+#ifndef TM_OFFLINE_MAX_SEGMENTS
+#define TM_OFFLINE_MAX_SEGMENTS 16
+#endif
+
+/* Drain rate: at most this many segments per history post, and this long
+ * between two posts */
+#ifndef TM_OFFLINE_DRAIN_SEGMENTS
+#define TM_OFFLINE_DRAIN_SEGMENTS 4
+#endif
+
+#ifndef TM_OFFLINE_DRAIN_INTERVAL_MS
+#define TM_OFFLINE_DRAIN_INTERVAL_MS 1000
+#endif
+
+#define TM_OFFLINE_STORE_NAME "tm_offline"
+
+/* Record header: 8 bytes timestamp, 2 bytes json length */
+#define TM_OFFLINE_RECORD_HEAD 10
+
+/* Room left in the payload for the request id and version */
+#define TM_OFFLINE_REQUEST_HEAD 64
+
+#if TM_OFFLINE_SEGMENT_SIZE > 0xFFFF
+#error "TM_OFFLINE_SEGMENT_SIZE must fit the 16 bit record length"
+#endif
+
+/*****************************************************************************/
+/* Structures, Enum and Typedefs                                             */
+/*****************************************************************************/
+struct tm_offline_obj {
+  atomic_flag lock;
+  handle_t store;
+  uint32_t head; /* oldest segment in the store */
+  uint32_t tail; /* key of the segment being filled */
+  uint32_t busy_end; /* end of the batch waiting for a reply */
+  uint8_t busy;
+  deadline_t next_drain;
+  uint32_t seg_len;
+  uint8_t seg[TM_OFFLINE_SEGMENT_SIZE];
+};
+
+/*****************************************************************************/
+/* Local Function Prototype                                                  */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Local Variables                                                           */
+/*****************************************************************************/
+static struct tm_offline_obj g_tm_offline = {.lock = ATOMIC_FLAG_INIT};
+
+/*****************************************************************************/
+/* Global Variables                                                          */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Function Implementation                                                   */
+/*****************************************************************************/
+static void tm_offline_lock(void) {
+  while (atomic_flag_test_and_set(&g_tm_offline.lock)) {
+    time_delay_ms(1);
+  }
+}
+
+static void tm_offline_unlock(void) {
+  atomic_flag_clear(&g_tm_offline.lock);
+}
+
+/* Open the store on first use and find the segments left from last time */
+static int32_t tm_offline_open(void) {
+  uint32_t *keys = NULL;
+  int32_t cnt = 0;
+  int32_t i = 0;
+
+  if (g_tm_offline.store) {
+    return ERR_OK;
+  }
+
+  if (0 == (g_tm_offline.store =
+                plat_store_open((const uint8_t *)TM_OFFLINE_STORE_NAME))) {
+    return ERR_IO;
+  }
+
+  if (NULL == (keys = osl_malloc(TM_OFFLINE_MAX_SEGMENTS * sizeof(*keys)))) {
+    plat_store_close(g_tm_offline.store);
+    g_tm_offline.store = 0;
+    return ERR_ALLOC;
+  }
+
+  g_tm_offline.head = 0;
+  g_tm_offline.tail = 0;
+  cnt = plat_store_keys(g_tm_offline.store, keys, TM_OFFLINE_MAX_SEGMENTS);
+  for (i = 0; i < cnt; i++) {
+    if (0 == i || keys[i] < g_tm_offline.head) {
+      g_tm_offline.head = keys[i];
+    }
+    if (keys[i] >= g_tm_offline.tail) {
+      g_tm_offline.tail = keys[i] + 1;
+    }
+  }
+  osl_free(keys);
+
+  if (0 < cnt) {
+    logi("offline buffer holds %d segments", (int)cnt);
+  }
+
+  return ERR_OK;
+}
+
+static void tm_offline_evict(void) {
+  logw("offline buffer full, drop segment %u", (unsigned)g_tm_offline.head);
+  plat_store_remove(g_tm_offline.store, g_tm_offline.head);
+  g_tm_offline.head++;
+}
+
+/* Write the segment being filled to the store */
+static int32_t tm_offline_save(void) {
+  if (0 == g_tm_offline.seg_len) {
+    return ERR_OK;
+  }
+
+  while (g_tm_offline.tail - g_tm_offline.head >= TM_OFFLINE_MAX_SEGMENTS) {
+    tm_offline_evict();
+  }
+
+  // 存储空间不足时同样丢弃最旧的段再试一次
+  if (0 != plat_store_put(g_tm_offline.store, g_tm_offline.tail,
+                          g_tm_offline.seg, g_tm_offline.seg_len)) {
+    if (g_tm_offline.head == g_tm_offline.tail) {
+      return ERR_IO;
+    }
+    tm_offline_evict();
+    if (0 != plat_store_put(g_tm_offline.store, g_tm_offline.tail,
+                            g_tm_offline.seg, g_tm_offline.seg_len)) {
+      return ERR_IO;
+    }
+  }
+
+  g_tm_offline.tail++;
+  g_tm_offline.seg_len = 0;
+
+  return ERR_OK;
+}
+
+static void tm_offline_remove(uint32_t end) {
+  while (g_tm_offline.head < end) {
+    plat_store_remove(g_tm_offline.store, g_tm_offline.head++);
+  }
+}
+
+/* Merge the records of segments [head, head + cnt) into one properties object
+ * keyed by property name */
+static void *tm_offline_load(uint32_t cnt) {
+  void *props = tm_onejson_create_data();
+  uint8_t *buf = osl_malloc(TM_OFFLINE_SEGMENT_SIZE);
+  uint32_t key = 0;
+
+  if (NULL == props || NULL == buf) {
+    tm_data_delete(props);
+    SAFE_FREE(buf);
+    return NULL;
+  }
+
+  for (key = g_tm_offline.head; key < g_tm_offline.head + cnt; key++) {
+    int32_t len = plat_store_get(g_tm_offline.store, key, buf,
+                                 TM_OFFLINE_SEGMENT_SIZE);
+    uint32_t pos = 0;
+
+    // 缺失或损坏的段跳过，确认后随这批数据一起删除
+    if (len < 0 || len > TM_OFFLINE_SEGMENT_SIZE) {
+      continue;
+    }
+
+    while (pos + TM_OFFLINE_RECORD_HEAD <= (uint32_t)len) {
+      uint64_t ts = 0;
+      uint16_t rec_len = 0;
+      void *rec = NULL;
+
+      osl_memcpy(&ts, buf + pos, sizeof(ts));
+      osl_memcpy(&rec_len, buf + pos + sizeof(ts), sizeof(rec_len));
+      pos += TM_OFFLINE_RECORD_HEAD;
+      if (pos + rec_len > (uint32_t)len) {
+        break;
+      }
+
+      if (NULL != (rec = tm_onejson_parse(buf + pos, rec_len))) {
+        tm_onejson_pack_history(props, rec, (int64_t)ts);
+        tm_data_delete(rec);
+      }
+      pos += rec_len;
+    }
+  }
+
+  osl_free(buf);
+
+  return props;
+}
+
+/* Pack the properties as history data, NULL when they would not fit into one
+ * request payload */
+static void *tm_offline_pack_history(const uint8_t *product_id,
+                                     const uint8_t *dev_name, void *props) {
+  void *data = tm_onejson_pack_props_and_events(NULL, product_id, dev_name,
+                                                props, NULL, 0);
+  uint8_t *str = NULL;
+  uint32_t len = 0;
+
+  if (NULL == data) {
+    tm_data_delete(props);
+    return NULL;
+  }
+
+  if (NULL != (str = tm_onejson_print(data))) {
+    len = osl_strlen(str);
+    osl_free(str);
+  }
+
+  if (NULL == str || len > SDK_PAYLOAD_LEN - TM_OFFLINE_REQUEST_HEAD) {
+    tm_data_delete(data);
+    return NULL;
+  }
+
+  return data;
+}
+
+int32_t tm_offline_append(void *prop_data, uint64_t timestamp_ms) {
+  uint8_t *str = tm_onejson_print(prop_data);
+  uint16_t rec_len = 0;
+  int32_t ret = ERR_OK;
+
+  tm_data_delete(prop_data);
+  if (NULL == str) {
+    return ERR_ALLOC;
+  }
+
+  if (osl_strlen(str) + TM_OFFLINE_RECORD_HEAD > TM_OFFLINE_SEGMENT_SIZE) {
+    osl_free(str);
+    return ERR_OVERFLOW;
+  }
+  rec_len = (uint16_t)osl_strlen(str);
+
+  tm_offline_lock();
+  if (ERR_OK == (ret = tm_offline_open()) &&
+      g_tm_offline.seg_len + TM_OFFLINE_RECORD_HEAD + rec_len >
+          TM_OFFLINE_SEGMENT_SIZE) {
+    ret = tm_offline_save();
+  }
+
+  if (ERR_OK == ret) {
+    uint8_t *pos = g_tm_offline.seg + g_tm_offline.seg_len;
+
+    osl_memcpy(pos, &timestamp_ms, sizeof(timestamp_ms));
+    osl_memcpy(pos + sizeof(timestamp_ms), &rec_len, sizeof(rec_len));
+    osl_memcpy(pos + TM_OFFLINE_RECORD_HEAD, str, rec_len);
+    g_tm_offline.seg_len += TM_OFFLINE_RECORD_HEAD + rec_len;
+  }
+  tm_offline_unlock();
+
+  osl_free(str);
+
+  return ret;
+}
+
+int32_t tm_offline_flush(void) {
+  int32_t ret = ERR_OK;
+
+  tm_offline_lock();
+  if (ERR_OK == (ret = tm_offline_open())) {
+    ret = tm_offline_save();
+  }
+  tm_offline_unlock();
+
+  return ret;
+}
+
+int32_t tm_offline_pending(void) {
+  int32_t ret = 0;
+
+  tm_offline_lock();
+  if (ERR_OK == tm_offline_open()) {
+    ret = (g_tm_offline.head != g_tm_offline.tail) ||
+          (0 != g_tm_offline.seg_len);
+  }
+  tm_offline_unlock();
+
+  return ret;
+}
+
+void *tm_offline_pack(const uint8_t *product_id, const uint8_t *dev_name) {
+  void *data = NULL;
+  void *props = NULL;
+  uint32_t cnt = 0;
+
+  tm_offline_lock();
+  if (g_tm_offline.busy || !deadline_is_expired(g_tm_offline.next_drain) ||
+      ERR_OK != tm_offline_open()) {
+    goto exit;
+  }
+
+  // 存储中的段传完后再上报正在填充的段
+  if (g_tm_offline.head == g_tm_offline.tail && ERR_OK != tm_offline_save()) {
+    goto exit;
+  }
+
+  cnt = g_tm_offline.tail - g_tm_offline.head;
+  if (cnt > TM_OFFLINE_DRAIN_SEGMENTS) {
+    cnt = TM_OFFLINE_DRAIN_SEGMENTS;
+  }
+
+  // 一次请求放不下时减少段数，单个段也放不下则丢弃
+  while (0 < cnt) {
+    if (NULL == (props = tm_offline_load(cnt))) {
+      goto exit;
+    }
+
+    // 段中没有可用的记录，直接删除
+    if (0 == tm_onejson_get_array_size(props)) {
+      tm_data_delete(props);
+      tm_offline_remove(g_tm_offline.head + cnt);
+      goto exit;
+    }
+
+    if (NULL != (data = tm_offline_pack_history(product_id, dev_name, props))) {
+      break;
+    }
+
+    if (1 == cnt) {
+      loge("offline segment %u exceeds payload, dropped",
+           (unsigned)g_tm_offline.head);
+      tm_offline_remove(g_tm_offline.head + 1);
+    }
+    cnt--;
+  }
+
+  if (NULL != data) {
+    g_tm_offline.busy = 1;
+    g_tm_offline.busy_end = g_tm_offline.head + cnt;
+  }
+
+exit:
+  tm_offline_unlock();
+
+  return data;
+}
+
+void tm_offline_commit(int32_t ret) {
+  tm_offline_lock();
+  if (g_tm_offline.busy) {
+    // 上报期间最旧的段可能已被丢弃，只删除仍在存储中的部分
+    if (ERR_OK == ret) {
+      tm_offline_remove(g_tm_offline.busy_end);
+    }
+    g_tm_offline.busy = 0;
+    g_tm_offline.next_drain = deadline_start(TM_OFFLINE_DRAIN_INTERVAL_MS);
+  }
+  tm_offline_unlock();
+}
+
+int32_t tm_offline_drain(const uint8_t *product_id, const uint8_t *dev_name,
+                         uint32_t timeout_ms) {
+  void *data = tm_offline_pack(product_id, dev_name);
+  int32_t ret = ERR_OK;
+
+  if (NULL == data) {
+    return ERR_OK;
+  }
+
+  ret = tm_post_history_data(data, timeout_ms);
+  tm_offline_commit(ret);
+
+  return ret;
+}
+#endif
@@ -15,12 +15,7 @@
 #include "aiot_tm_api.h"
 #include "err_def.h"
 #include "tm_data.h"
-
-typedef enum {
-    ONENET_DISCONNECTED = 0,
-    ONENET_CONNECTED = 1,
-    ONENET_RECONNECTING = 2
-} onenet_state_t;
+#include "tm_offline.h"
 
 typedef enum {
     DATA_IS_FLOAT = 0,
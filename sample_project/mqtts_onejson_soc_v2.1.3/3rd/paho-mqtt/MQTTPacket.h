@@ -88,6 +88,11 @@ typedef struct
 
 int MQTTstrlen(MQTTString mqttstring);
 
+#if defined(MQTTV5)
+#include "MQTTProperties.h"
+#include "MQTTReasonCodes.h"
+#endif
+
 #include "MQTTConnect.h"
 #include "MQTTPublish.h"
 #include "MQTTSubscribe.h"
@@ -96,6 +101,10 @@ int MQTTstrlen(MQTTString mqttstring);
 
 DLLExport int MQTTSerialize_ack(unsigned char* buf, int buflen, unsigned char type, unsigned char dup, unsigned short packetid);
 DLLExport int MQTTDeserialize_ack(unsigned char* packettype, unsigned char* dup, unsigned short* packetid, unsigned char* buf, int buflen);
+#if defined(MQTTV5)
+DLLExport int MQTTV5Deserialize_ack(unsigned char* packettype, unsigned char* dup, unsigned short* packetid,
+		unsigned char* reasonCode, MQTTProperties* properties, unsigned char* buf, int buflen);
+#endif
 
 int MQTTPacket_len(int rem_len);
 DLLExport int MQTTPacket_equals(MQTTString* a, char* b);
@@ -0,0 +1,88 @@
+/**
+ * Copyright (c), 2012~2024 iot.10086.cn All Rights Reserved
+ * @file        mpsc_queue.c
+ * @brief       Lock-free multi-producer single-consumer queue
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include "mpsc_queue.h"
+
+/*****************************************************************************/
+/* Local Definitions ( Constant and Macro )                                  */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Structures, Enum and Typedefs                                             */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Local Function Prototype                                                  */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Local Variables                                                           */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Global Variables                                                          */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Function Implementation                                                   */
+/*****************************************************************************/
+void mpsc_queue_init(struct mpsc_queue *queue)
+{
+    atomic_init(&queue->stub.next, NULL);
+    atomic_init(&queue->head, &queue->stub);
+    queue->tail = &queue->stub;
+}
+
+void mpsc_queue_push(struct mpsc_queue *queue, struct mpsc_node *node)
+{
+    struct mpsc_node *prev = NULL;
+
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    prev = atomic_exchange_explicit(&queue->head, node, memory_order_acq_rel);
+    /* Between the exchange and this store the node is unreachable from tail */
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+struct mpsc_node *mpsc_queue_pop(struct mpsc_queue *queue)
+{
+    struct mpsc_node *tail = queue->tail;
+    struct mpsc_node *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if (tail == &queue->stub)
+    {
+        if (NULL == next)
+            return NULL;
+
+        queue->tail = next;
+        tail        = next;
+        next        = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+
+    if (NULL != next)
+    {
+        queue->tail = next;
+        return tail;
+    }
+
+    /* A producer has swapped head but not linked its node yet */
+    if (tail != atomic_load_explicit(&queue->head, memory_order_acquire))
+        return NULL;
+
+    /* tail is the last node, put the stub behind it so it can be detached */
+    mpsc_queue_push(queue, &queue->stub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if (NULL != next)
+    {
+        queue->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "plat_store.h"
+
+static const char *TAG = "STORE_ESP32";
+
+// 存储对象，每个存储对应一个NVS命名空间
+struct store_esp32 {
+    nvs_handle_t nvs;
+    char name[NVS_NS_NAME_MAX_SIZE];
+};
+
+// 条目键转换为NVS键名
+static void store_key_name(uint32_t key, char *name)
+{
+    snprintf(name, NVS_KEY_NAME_MAX_SIZE, "%08lx", (unsigned long)key);
+}
+
+//打开存储
+handle_t plat_store_open(const uint8_t *name)
+{
+    struct store_esp32 *store = NULL;
+    esp_err_t err = nvs_flash_init();
+
+    // 已经初始化过时同样返回ESP_OK，分区需要擦除的情况交给应用处理
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "NVS init failed: %s", esp_err_to_name(err));
+        return 0;
+    }
+
+    if (NULL == (store = calloc(1, sizeof(*store)))) {
+        return 0;
+    }
+
+    strncpy(store->name, (const char *)name, sizeof(store->name) - 1);
+
+    if ((err = nvs_open(store->name, NVS_READWRITE, &store->nvs)) != ESP_OK) {
+        ESP_LOGE(TAG, "Open %s failed: %s", store->name, esp_err_to_name(err));
+        free(store);
+        return 0;
+    }
+
+    return (handle_t)store;
+}
+
+//保存条目
+int32_t plat_store_put(handle_t handle, uint32_t key, const void *data, uint32_t len)
+{
+    struct store_esp32 *store = (struct store_esp32 *)handle;
+    char key_name[NVS_KEY_NAME_MAX_SIZE];
+    esp_err_t err = ESP_OK;
+
+    store_key_name(key, key_name);
+
+    if ((err = nvs_set_blob(store->nvs, key_name, data, len)) == ESP_OK) {
+        err = nvs_commit(store->nvs);
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Put %s failed: %s", key_name, esp_err_to_name(err));
+        return -1;
+    }
+
+    return 0;
+}
+
+//读取条目
+int32_t plat_store_get(handle_t handle, uint32_t key, void *buf, uint32_t len)
+{
+    struct store_esp32 *store = (struct store_esp32 *)handle;
+    char key_name[NVS_KEY_NAME_MAX_SIZE];
+    size_t size = 0;
+
+    store_key_name(key, key_name);
+
+    // 先取长度，缓冲区放得下才读取内容
+    if (nvs_get_blob(store->nvs, key_name, NULL, &size) != ESP_OK) {
+        return -1;
+    }
+
+    if (buf != NULL && size <= len && nvs_get_blob(store->nvs, key_name, buf, &size) != ESP_OK) {
+        return -1;
+    }
+
+    return (int32_t)size;
+}
+
+//删除条目
+int32_t plat_store_remove(handle_t handle, uint32_t key)
+{
+    struct store_esp32 *store = (struct store_esp32 *)handle;
+    char key_name[NVS_KEY_NAME_MAX_SIZE];
+    esp_err_t err = ESP_OK;
+
+    store_key_name(key, key_name);
+
+    err = nvs_erase_key(store->nvs, key_name);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return 0;
+    }
+
+    if (err == ESP_OK) {
+        err = nvs_commit(store->nvs);
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Remove %s failed: %s", key_name, esp_err_to_name(err));
+        return -1;
+    }
+
+    return 0;
+}
+
+//列出条目键
+int32_t plat_store_keys(handle_t handle, uint32_t *keys, uint32_t max)
+{
+    struct store_esp32 *store = (struct store_esp32 *)handle;
+    nvs_iterator_t it = NULL;
+    nvs_entry_info_t info;
+    uint32_t cnt = 0;
+    esp_err_t err = nvs_entry_find(NVS_DEFAULT_PART_NAME, store->name, NVS_TYPE_BLOB, &it);
+
+    while (err == ESP_OK && cnt < max) {
+        nvs_entry_info(it, &info);
+        keys[cnt++] = (uint32_t)strtoul(info.key, NULL, 16);
+        err = nvs_entry_next(&it);
+    }
+
+    nvs_release_iterator(it);
+
+    // 命名空间中没有条目时返回ESP_ERR_NVS_NOT_FOUND
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGE(TAG, "List %s failed: %s", store->name, esp_err_to_name(err));
+        return -1;
+    }
+
+    return (int32_t)cnt;
+}
+
+//关闭存储
+void plat_store_close(handle_t handle)
+{
+    struct store_esp32 *store = (struct store_esp32 *)handle;
+
+    if (store) {
+        nvs_close(store->nvs);
+        free(store);
+    }
+}
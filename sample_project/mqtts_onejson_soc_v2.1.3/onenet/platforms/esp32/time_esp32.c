@@ -51,7 +51,27 @@ uint64_t time_get_date(int* year, int* month, int* day, int* hour, int* min, int
     return 0;
 }
 
-// 启动倒计时器
+// 启动截止时间
+deadline_t deadline_start(uint32_t ms) {
+    return time_count_ms() + ms;
+}
+
+// 获取截止时间剩余时间
+uint32_t deadline_left(deadline_t deadline) {
+    uint64_t current = time_count_ms();
+
+    if (current >= deadline) {
+        return 0;
+    }
+    return (uint32_t)(deadline - current);
+}
+
+// 检查截止时间是否已到
+uint32_t deadline_is_expired(deadline_t deadline) {
+    return (time_count_ms() >= deadline) ? 1 : 0;
+}
+
+// 启动倒计时器（兼容接口，新代码使用deadline_start）
 handle_t countdown_start(uint32_t ms) {
     struct countdown_tmr_t *tmr = (struct countdown_tmr_t *)malloc(sizeof(struct countdown_tmr_t));
     if (tmr) {
@@ -24,6 +24,12 @@ extern "C" {
 /*****************************************************************************/
 /* External Structures, Enum and Typedefs                                    */
 /*****************************************************************************/
+/**
+ * @brief Deadline，the time_count_ms() value at which it expires
+ *
+ * A plain value kept by the caller，nothing to allocate or release.
+ */
+typedef uint64_t deadline_t;
 
 /*****************************************************************************/
 /* External Variables and Functions                                          */
@@ -63,9 +69,36 @@ void time_delay_ms(uint32_t m_sec);
  */
 void time_delay(uint32_t sec);
 
+/**
+ * @brief Start a deadline
+ *
+ * @param ms Time until the deadline expires，Unit is ms
+ * @return deadline_t Deadline value
+ */
+deadline_t deadline_start(uint32_t ms);
+
+/**
+ * @brief Return the time remaining until the deadline
+ *
+ * @param deadline Deadline value
+ * @return Time remaining，Unit is ms，0 once expired
+ */
+uint32_t deadline_left(deadline_t deadline);
+
+/**
+ * @brief Determine whether the deadline has expired
+ *
+ * @param deadline Deadline value
+ * @return  0 - Not Timed Out
+ *          1 - Timed out
+ */
+uint32_t deadline_is_expired(deadline_t deadline);
+
 /**
  * @brief Start countdown
  *
+ * @note Heap backed，kept for compatibility. New code should use deadline_start()
+ *
  * @param ms Set the countdown time，Unit is ms
  * @retval  0 - Failed
  * @retval Other - Succeed，Return to the countdown timer operation handle
@@ -0,0 +1,351 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "plat_osl.h"
+
+char* g_server_ip = NULL;
+char* g_server_port = NULL;
+
+// 二值信号量，用条件变量实现，多次释放只保留一次
+struct osl_sem {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int available;
+};
+
+struct osl_thread_ctx {
+    osl_thread_entry entry;
+    void *arg;
+};
+
+void *osl_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void *osl_calloc(size_t num, size_t size)
+{
+    return calloc(num, size);
+}
+
+void osl_free(void *ptr)
+{
+    free(ptr);
+}
+
+void *osl_memcpy(void *dst, const void *src, size_t n)
+{
+    return memcpy(dst, src, n);
+}
+
+void *osl_memmove(void *dst, const void *src, size_t n)
+{
+    return memmove(dst, src, n);
+}
+
+void *osl_memset(void *dst, int32_t val, size_t n)
+{
+    return memset(dst, val, n);
+}
+
+uint8_t *osl_strdup(const uint8_t *s)
+{
+    return (uint8_t *)strdup((const char *)s);
+}
+
+uint8_t *osl_strndup(const uint8_t *s, size_t n)
+{
+    return (uint8_t *)strndup((const char *)s, n);
+}
+
+uint8_t *osl_strcpy(uint8_t *s1, const uint8_t *s2)
+{
+    return (uint8_t *)strcpy((char *)s1, (const char *)s2);
+}
+
+uint8_t *osl_strncpy(uint8_t *s1, const uint8_t *s2, size_t n)
+{
+    return (uint8_t *)strncpy((char *)s1, (const char *)s2, n);
+}
+
+uint8_t *osl_strcat(uint8_t *dst, const uint8_t *src)
+{
+    return (uint8_t *)strcat((char *)dst, (const char *)src);
+}
+
+uint8_t *osl_strstr(const uint8_t *s1, const uint8_t *s2)
+{
+    return (uint8_t *)strstr((const char *)s1, (const char *)s2);
+}
+
+uint32_t osl_strlen(const uint8_t *s)
+{
+    return (uint32_t)strlen((const char *)s);
+}
+
+int32_t osl_strcmp(const uint8_t *s1, const uint8_t *s2)
+{
+    return strcmp((const char *)s1, (const char *)s2);
+}
+
+int32_t osl_strncmp(const uint8_t *s1, const uint8_t *s2, size_t n)
+{
+    return strncmp((const char *)s1, (const char *)s2, n);
+}
+
+int32_t osl_sprintf(uint8_t *str, const uint8_t *format, ...)
+{
+    va_list args;
+    int32_t ret = 0;
+
+    va_start(args, format);
+    ret = vsprintf((char *)str, (const char *)format, args);
+    va_end(args);
+
+    return ret;
+}
+
+int32_t osl_sscanf(const uint8_t *str, const uint8_t *format, ...)
+{
+    va_list args;
+    int32_t ret = 0;
+
+    va_start(args, format);
+    ret = vsscanf((const char *)str, (const char *)format, args);
+    va_end(args);
+
+    return ret;
+}
+
+void osl_assert(boolean expression)
+{
+    if (!expression) {
+        abort();
+    }
+}
+
+//从 /dev/urandom 读取随机数，用于 TLS 等需要不可预测数据的场合
+int32_t osl_get_random(unsigned char *buf, size_t len)
+{
+    size_t got = 0;
+    ssize_t ret = 0;
+    int fd = -1;
+
+    if ((fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC)) < 0) {
+        return -1;
+    }
+
+    while (got < len) {
+        ret = read(fd, buf + got, len - got);
+        if (ret > 0) {
+            got += ret;
+        } else if (ret < 0 && errno == EINTR) {
+            continue;
+        } else {
+            break;
+        }
+    }
+    close(fd);
+
+    return (got == len) ? 0 : -1;
+}
+
+int32_t osl_atoi(const uint8_t *nptr)
+{
+    return atoi((const char *)nptr);
+}
+
+// 每个线程独立的随机数状态，第一次使用时用时间和线程号播种
+static uint32_t osl_rand_next(void)
+{
+    static __thread unsigned int seed = 0;
+
+    if (0 == seed) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        seed = (unsigned int)(ts.tv_nsec ^ ts.tv_sec ^ (uintptr_t)pthread_self()) | 1;
+    }
+    return (uint32_t)rand_r(&seed);
+}
+
+int32_t osl_rand(int32_t min, int32_t max)
+{
+    if (min >= max) {
+        return min;
+    }
+    uint32_t range = max - min + 1;
+    return min + (osl_rand_next() % range);
+}
+
+uint8_t *osl_random_string(uint8_t *buf, int len)
+{
+    const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+
+    for (int i = 0; i < len; i++) {
+        buf[i] = charset[osl_rand_next() % (sizeof(charset) - 1)];
+    }
+    buf[len] = '\0';
+    return buf;
+}
+
+static void *osl_thread_main(void *param)
+{
+    struct osl_thread_ctx ctx = *(struct osl_thread_ctx *)param;
+
+    free(param);
+    ctx.entry(ctx.arg);
+    return NULL;
+}
+
+//创建线程，线程分离运行，退出时自动回收，普通用户无法设置实时优先级，优先级参数忽略
+handle_t osl_thread_create(const uint8_t *name, osl_thread_entry entry, void *arg, uint32_t stack_size,
+                           uint32_t priority)
+{
+    struct osl_thread_ctx *ctx = malloc(sizeof(*ctx));
+    pthread_attr_t attr;
+    pthread_t thread;
+    int ret = 0;
+
+    if (NULL == ctx) {
+        return 0;
+    }
+    ctx->entry = entry;
+    ctx->arg = arg;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    // 嵌入式平台的栈大小对 glibc 偏小，只在大于默认值时采用
+    if (stack_size > PTHREAD_STACK_MIN) {
+        pthread_attr_setstacksize(&attr, stack_size);
+    }
+
+    ret = pthread_create(&thread, &attr, osl_thread_main, ctx);
+    pthread_attr_destroy(&attr);
+
+    if (ret != 0) {
+        free(ctx);
+        return 0;
+    }
+
+#ifdef __GLIBC__
+    // 线程名最长15个字符，便于在 top/perf 中区分
+    if (name) {
+        char tname[16];
+
+        snprintf(tname, sizeof(tname), "%s", (const char *)name);
+        pthread_setname_np(thread, tname);
+    }
+#endif
+
+    return (handle_t)thread;
+}
+
+handle_t osl_thread_self(void)
+{
+    return (handle_t)pthread_self();
+}
+
+handle_t osl_sem_create(void)
+{
+    struct osl_sem *sem = calloc(1, sizeof(*sem));
+    pthread_condattr_t attr;
+
+    if (NULL == sem) {
+        return 0;
+    }
+
+    // 等待使用单调时钟，不受系统时间调整影响
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    if (pthread_mutex_init(&sem->lock, NULL) != 0) {
+        pthread_condattr_destroy(&attr);
+        free(sem);
+        return 0;
+    }
+    if (pthread_cond_init(&sem->cond, &attr) != 0) {
+        pthread_condattr_destroy(&attr);
+        pthread_mutex_destroy(&sem->lock);
+        free(sem);
+        return 0;
+    }
+    pthread_condattr_destroy(&attr);
+
+    return (handle_t)sem;
+}
+
+int32_t osl_sem_take(handle_t handle, uint32_t timeout_ms)
+{
+    struct osl_sem *sem = (struct osl_sem *)handle;
+    struct timespec ts;
+    int ret = 0;
+
+    if (OSL_WAIT_FOREVER != timeout_ms) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec += timeout_ms / 1000;
+        ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&sem->lock);
+    while (!sem->available && ret == 0) {
+        if (OSL_WAIT_FOREVER == timeout_ms) {
+            ret = pthread_cond_wait(&sem->cond, &sem->lock);
+        } else {
+            ret = pthread_cond_timedwait(&sem->cond, &sem->lock, &ts);
+        }
+    }
+    // 超时的同时被释放也算取得
+    if (sem->available) {
+        sem->available = 0;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&sem->lock);
+
+    return (ret == 0) ? 0 : -1;
+}
+
+void osl_sem_give(handle_t handle)
+{
+    struct osl_sem *sem = (struct osl_sem *)handle;
+
+    pthread_mutex_lock(&sem->lock);
+    sem->available = 1;
+    pthread_cond_signal(&sem->cond);
+    pthread_mutex_unlock(&sem->lock);
+}
+
+void osl_sem_delete(handle_t handle)
+{
+    struct osl_sem *sem = (struct osl_sem *)handle;
+
+    if (sem) {
+        pthread_cond_destroy(&sem->cond);
+        pthread_mutex_destroy(&sem->lock);
+        free(sem);
+    }
+}
+
+int32_t module_init(void *arg, void* callback)
+{
+    return 0;
+}
+
+int32_t module_deinit(void)
+{
+    return 0;
+}
@@ -0,0 +1,168 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log.h"
+#include "plat_store.h"
+
+// 存储目录所在的位置，每个存储是其中的一个子目录，每个条目是一个文件
+#ifndef PLAT_STORE_DIR
+#define PLAT_STORE_DIR "."
+#endif
+
+struct store_linux {
+    char path[256];
+};
+
+// 条目键转换为文件路径
+static void store_file_path(struct store_linux *store, uint32_t key, char *path, size_t size)
+{
+    snprintf(path, size, "%s/%08lx", store->path, (unsigned long)key);
+}
+
+//打开存储
+handle_t plat_store_open(const uint8_t *name)
+{
+    struct store_linux *store = NULL;
+
+    if (NULL == (store = calloc(1, sizeof(*store)))) {
+        return 0;
+    }
+
+    snprintf(store->path, sizeof(store->path), "%s/%s", PLAT_STORE_DIR, (const char *)name);
+
+    if (mkdir(store->path, 0700) < 0 && errno != EEXIST) {
+        loge("Open store %s failed: errno %d", store->path, errno);
+        free(store);
+        return 0;
+    }
+
+    return (handle_t)store;
+}
+
+//保存条目，先写临时文件再改名，掉电时不会留下半个条目
+int32_t plat_store_put(handle_t handle, uint32_t key, const void *data, uint32_t len)
+{
+    struct store_linux *store = (struct store_linux *)handle;
+    char path[300], tmp_path[304];
+    const uint8_t *ptr = data;
+    uint32_t written = 0;
+    int fd = -1;
+
+    store_file_path(store, key, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    if ((fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0) {
+        loge("Put %s failed: errno %d", path, errno);
+        return -1;
+    }
+
+    while (written < len) {
+        ssize_t rc = write(fd, ptr + written, len - written);
+
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        written += rc;
+    }
+
+    if (written != len || fsync(fd) < 0) {
+        loge("Put %s failed: errno %d", path, errno);
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+
+    if (close(fd) < 0 || rename(tmp_path, path) < 0) {
+        loge("Put %s failed: errno %d", path, errno);
+        unlink(tmp_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+//读取条目
+int32_t plat_store_get(handle_t handle, uint32_t key, void *buf, uint32_t len)
+{
+    struct store_linux *store = (struct store_linux *)handle;
+    char path[300];
+    struct stat st;
+    int32_t rc = -1;
+    int fd = -1;
+
+    store_file_path(store, key, path, sizeof(path));
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return -1;
+    }
+
+    if (fstat(fd, &st) == 0) {
+        rc = (int32_t)st.st_size;
+
+        // 缓冲区放得下才读取内容
+        if (buf != NULL && (uint32_t)rc <= len && read(fd, buf, rc) != rc) {
+            rc = -1;
+        }
+    }
+
+    close(fd);
+
+    return rc;
+}
+
+//删除条目
+int32_t plat_store_remove(handle_t handle, uint32_t key)
+{
+    struct store_linux *store = (struct store_linux *)handle;
+    char path[300];
+
+    store_file_path(store, key, path, sizeof(path));
+
+    if (unlink(path) < 0 && errno != ENOENT) {
+        loge("Remove %s failed: errno %d", path, errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+//列出条目键
+int32_t plat_store_keys(handle_t handle, uint32_t *keys, uint32_t max)
+{
+    struct store_linux *store = (struct store_linux *)handle;
+    struct dirent *entry = NULL;
+    uint32_t cnt = 0;
+    DIR *dir = NULL;
+
+    if (NULL == (dir = opendir(store->path))) {
+        return -1;
+    }
+
+    while (cnt < max && NULL != (entry = readdir(dir))) {
+        char *end = NULL;
+        unsigned long key = strtoul(entry->d_name, &end, 16);
+
+        // 跳过"."、".."和写了一半的临时文件
+        if (strlen(entry->d_name) == 8 && *end == '\0') {
+            keys[cnt++] = (uint32_t)key;
+        }
+    }
+
+    closedir(dir);
+
+    return (int32_t)cnt;
+}
+
+//关闭存储
+void plat_store_close(handle_t handle)
+{
+    free((struct store_linux *)handle);
+}
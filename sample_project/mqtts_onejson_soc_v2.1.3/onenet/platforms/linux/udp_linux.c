@@ -0,0 +1,268 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "log.h"
+#include "plat_dns.h"
+#include "plat_time.h"
+#include "plat_udp.h"
+
+#ifndef PLAT_UDP_DNS_TIMEOUT
+#define PLAT_UDP_DNS_TIMEOUT 5000
+#endif
+
+struct udp_linux {
+    int fd;
+    struct sockaddr_in peer; // plat_udp_send 的目的地址
+};
+
+//等待套接字可读或可写，返回1表示就绪，0表示超时，-1表示出错
+static int32_t udp_wait(int fd, short events, deadline_t deadline)
+{
+    struct pollfd pfd;
+    int ret = 0;
+
+    do {
+        pfd.fd = fd;
+        pfd.events = events;
+        pfd.revents = 0;
+
+        ret = poll(&pfd, 1, (int)deadline_left(deadline));
+    } while (ret < 0 && errno == EINTR && !deadline_is_expired(deadline));
+
+    if (ret < 0) {
+        return (errno == EINTR) ? 0 : -1;
+    }
+    return (ret > 0) ? 1 : 0;
+}
+
+static int udp_addr(const char *host, uint16_t port, struct sockaddr_in *addr)
+{
+    uint32_t ip = 0;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+
+    if (NULL == host || '\0' == host[0]) {
+        addr->sin_addr.s_addr = htonl(INADDR_ANY);
+        return 0;
+    }
+    if (plat_dns_resolve((const uint8_t *)host, &ip, 1, PLAT_UDP_DNS_TIMEOUT) <= 0) {
+        loge("DNS resolution failed for %s", host);
+        return -1;
+    }
+    addr->sin_addr.s_addr = ip;
+    return 0;
+}
+
+static struct udp_linux *udp_open(void)
+{
+    struct udp_linux *udp = calloc(1, sizeof(*udp));
+
+    if (NULL == udp) {
+        return NULL;
+    }
+    if ((udp->fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
+        loge("Unable to create socket: errno %d", errno);
+        free(udp);
+        return NULL;
+    }
+    return udp;
+}
+
+static void udp_close(struct udp_linux *udp)
+{
+    close(udp->fd);
+    free(udp);
+}
+
+//发送数据报，套接字缓冲区满时等待到超时
+static int32_t udp_sendto_addr(struct udp_linux *udp, void *buf, uint32_t len, const struct sockaddr_in *addr,
+                               uint32_t timeout_ms)
+{
+    deadline_t deadline = deadline_start(timeout_ms);
+    int32_t ret = 0;
+
+    for (;;) {
+        ret = sendto(udp->fd, buf, len, MSG_DONTWAIT, (const struct sockaddr *)addr, sizeof(*addr));
+
+        if (ret >= 0) {
+            return ret;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            loge("Send failed: errno %d", errno);
+            return -1;
+        }
+
+        if ((ret = udp_wait(udp->fd, POLLOUT, deadline)) <= 0) {
+            return ret;
+        }
+    }
+}
+
+//接收数据报，from 不为空时只接收来自该地址的数据
+static int32_t udp_recv_from(struct udp_linux *udp, void *buf, uint32_t len, const struct sockaddr_in *from,
+                             uint32_t timeout_ms)
+{
+    deadline_t deadline = deadline_start(timeout_ms);
+    struct sockaddr_in src;
+    socklen_t src_len = 0;
+    int32_t ret = 0;
+
+    for (;;) {
+        src_len = sizeof(src);
+        ret = recvfrom(udp->fd, buf, len, MSG_DONTWAIT, (struct sockaddr *)&src, &src_len);
+
+        if (ret >= 0) {
+            if (NULL == from || (src.sin_addr.s_addr == from->sin_addr.s_addr && src.sin_port == from->sin_port)) {
+                return ret;
+            }
+            continue;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            loge("Receive failed: errno %d", errno);
+            return -1;
+        }
+
+        if ((ret = udp_wait(udp->fd, POLLIN, deadline)) <= 0) {
+            return ret;
+        }
+    }
+}
+
+//建立UDP连接，目的地址是组播地址时加入该组并在同一端口接收组内的数据
+handle_t plat_udp_connect(const uint8_t *host, uint16_t port)
+{
+    struct udp_linux *udp = NULL;
+    struct sockaddr_in local;
+    struct ip_mreq mreq;
+    int on = 1;
+
+    if (NULL == (udp = udp_open())) {
+        return -1;
+    }
+    if (udp_addr((const char *)host, port, &udp->peer) < 0) {
+        udp_close(udp);
+        return -1;
+    }
+
+    if (IN_MULTICAST(ntohl(udp->peer.sin_addr.s_addr))) {
+        setsockopt(udp->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        udp_addr(NULL, port, &local);
+        if (bind(udp->fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+            loge("Bind port %d failed: errno %d", port, errno);
+            udp_close(udp);
+            return -1;
+        }
+
+        mreq.imr_multiaddr = udp->peer.sin_addr;
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (setsockopt(udp->fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+            loge("Join group %s failed: errno %d", host, errno);
+            udp_close(udp);
+            return -1;
+        }
+    } else if (connect(udp->fd, (struct sockaddr *)&udp->peer, sizeof(udp->peer)) < 0) {
+        loge("Connect to %s failed: errno %d", host, errno);
+        udp_close(udp);
+        return -1;
+    }
+
+    return (handle_t)udp;
+}
+
+//UDP发送数据
+int32_t plat_udp_send(handle_t handle, void *buf, uint32_t len, uint32_t timeout_ms)
+{
+    struct udp_linux *udp = (struct udp_linux *)handle;
+
+    if (handle == -1 || NULL == udp || NULL == buf) {
+        return -1;
+    }
+    return udp_sendto_addr(udp, buf, len, &udp->peer, timeout_ms);
+}
+
+//UDP接收数据
+int32_t plat_udp_recv(handle_t handle, void *buf, uint32_t len, uint32_t timeout_ms)
+{
+    struct udp_linux *udp = (struct udp_linux *)handle;
+
+    if (handle == -1 || NULL == udp || NULL == buf || len == 0) {
+        return -1;
+    }
+    return udp_recv_from(udp, buf, len, NULL, timeout_ms);
+}
+
+//绑定本地地址
+handle_t plat_udp_bind(const char *local_host, uint16_t local_port)
+{
+    struct udp_linux *udp = NULL;
+    struct sockaddr_in local;
+    int on = 1;
+
+    if (NULL == (udp = udp_open())) {
+        return -1;
+    }
+
+    setsockopt(udp->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (udp_addr(local_host, local_port, &local) < 0
+        || bind(udp->fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+        loge("Bind port %d failed: errno %d", local_port, errno);
+        udp_close(udp);
+        return -1;
+    }
+
+    return (handle_t)udp;
+}
+
+//向指定地址发送数据
+int32_t plat_udp_sendto(handle_t handle, void *buf, uint32_t len, const char *host, uint16_t port, uint32_t timeout_ms)
+{
+    struct udp_linux *udp = (struct udp_linux *)handle;
+    struct sockaddr_in addr;
+
+    if (handle == -1 || NULL == udp || NULL == buf || NULL == host) {
+        return -1;
+    }
+    if (udp_addr(host, port, &addr) < 0) {
+        return -1;
+    }
+    return udp_sendto_addr(udp, buf, len, &addr, timeout_ms);
+}
+
+//接收指定地址发来的数据，host 为空时接收任意地址的数据
+int32_t plat_udp_recvfrom(handle_t handle, void *buf, uint32_t len, const char *host, uint16_t port, uint32_t timeout_ms)
+{
+    struct udp_linux *udp = (struct udp_linux *)handle;
+    struct sockaddr_in addr;
+
+    if (handle == -1 || NULL == udp || NULL == buf || len == 0) {
+        return -1;
+    }
+    if (NULL == host || '\0' == host[0]) {
+        return udp_recv_from(udp, buf, len, NULL, timeout_ms);
+    }
+    if (udp_addr(host, port, &addr) < 0) {
+        return -1;
+    }
+    return udp_recv_from(udp, buf, len, &addr, timeout_ms);
+}
+
+//关闭UDP连接
+int32_t plat_udp_disconnect(handle_t handle)
+{
+    struct udp_linux *udp = (struct udp_linux *)handle;
+
+    if (handle == -1 || NULL == udp) {
+        return -1;
+    }
+    udp_close(udp);
+    return 0;
+}
@@ -0,0 +1,322 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include "log.h"
+#include "plat_dns.h"
+#include "plat_osl.h"
+#include "plat_store.h"
+#include "plat_time.h"
+
+// 缓存的主机名个数
+#ifndef PLAT_DNS_CACHE_SIZE
+#define PLAT_DNS_CACHE_SIZE 2
+#endif
+
+// 解析结果的有效期，getaddrinfo 不提供记录的TTL，这里取固定值
+#ifndef PLAT_DNS_TTL_MS
+#define PLAT_DNS_TTL_MS 300000
+#endif
+
+#ifndef PLAT_DNS_HOST_LEN
+#define PLAT_DNS_HOST_LEN 64
+#endif
+
+#ifndef PLAT_DNS_STACK_SIZE
+#define PLAT_DNS_STACK_SIZE 4096
+#endif
+
+#define PLAT_DNS_STORE_NAME "plat_dns"
+
+struct dns_entry {
+    char host[PLAT_DNS_HOST_LEN];
+    uint32_t addrs[PLAT_DNS_MAX_ADDRS]; // 按尝试顺序排列
+    uint32_t cnt;
+    uint32_t last_good;                 // 0 - 没有连接成功过
+    uint8_t last_good_failed;           // 之后连接失败过，排到最后尝试
+    uint32_t gen;                       // 每次解析结束加1
+    uint64_t expires_at;
+    uint64_t used_at;
+    uint8_t pending;
+};
+
+static atomic_flag g_dns_lock = ATOMIC_FLAG_INIT;
+static struct dns_entry g_dns_cache[PLAT_DNS_CACHE_SIZE];
+
+static void dns_lock(void)
+{
+    while (atomic_flag_test_and_set(&g_dns_lock)) {
+        time_delay_ms(1);
+    }
+}
+
+static void dns_unlock(void)
+{
+    atomic_flag_clear(&g_dns_lock);
+}
+
+// 主机名转换为存储中的键
+static uint32_t dns_store_key(const char *host)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*host) {
+        hash = (hash ^ (uint8_t)*host++) * 16777619u;
+    }
+    return hash;
+}
+
+//读取保存的上次连接成功的地址
+static uint32_t dns_load_last_good(const char *host)
+{
+    handle_t store = plat_store_open((const uint8_t *)PLAT_DNS_STORE_NAME);
+    uint32_t addr = 0;
+
+    if (store) {
+        if (plat_store_get(store, dns_store_key(host), &addr, sizeof(addr)) != sizeof(addr)) {
+            addr = 0;
+        }
+        plat_store_close(store);
+    }
+    return addr;
+}
+
+//保存上次连接成功的地址
+static void dns_save_last_good(const char *host, uint32_t addr)
+{
+    handle_t store = plat_store_open((const uint8_t *)PLAT_DNS_STORE_NAME);
+
+    if (store) {
+        plat_store_put(store, dns_store_key(host), &addr, sizeof(addr));
+        plat_store_close(store);
+    }
+}
+
+static struct dns_entry *dns_find(const char *host)
+{
+    for (int i = 0; i < PLAT_DNS_CACHE_SIZE; i++) {
+        if (g_dns_cache[i].host[0] && strcmp(g_dns_cache[i].host, host) == 0) {
+            return &g_dns_cache[i];
+        }
+    }
+    return NULL;
+}
+
+// 把地址移到最前或最后，其余地址保持原有顺序
+static void dns_move(struct dns_entry *e, uint32_t addr, int to_front)
+{
+    uint32_t i = 0;
+
+    while (i < e->cnt && e->addrs[i] != addr) {
+        i++;
+    }
+    if (i == e->cnt) {
+        return;
+    }
+
+    if (to_front) {
+        memmove(&e->addrs[1], &e->addrs[0], i * sizeof(addr));
+        e->addrs[0] = addr;
+    } else {
+        memmove(&e->addrs[i], &e->addrs[i + 1], (e->cnt - i - 1) * sizeof(addr));
+        e->addrs[e->cnt - 1] = addr;
+    }
+}
+
+//后台解析线程，结果写入缓存
+static void dns_lookup_main(void *arg)
+{
+    char *host = arg;
+    struct addrinfo hints, *res = NULL, *ai = NULL;
+    uint32_t addrs[PLAT_DNS_MAX_ADDRS];
+    uint32_t cnt = 0;
+    struct dns_entry *e = NULL;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(host, NULL, &hints, &res) == 0) {
+        for (ai = res; ai != NULL && cnt < PLAT_DNS_MAX_ADDRS; ai = ai->ai_next) {
+            uint32_t addr = ((struct sockaddr_in *)ai->ai_addr)->sin_addr.s_addr;
+            uint32_t i = 0;
+
+            while (i < cnt && addrs[i] != addr) {
+                i++;
+            }
+            if (i == cnt) {
+                addrs[cnt++] = addr;
+            }
+        }
+        freeaddrinfo(res);
+    } else {
+        loge("DNS resolution failed for %s", host);
+    }
+
+    dns_lock();
+    // 解析期间条目可能已让给其他主机
+    if (NULL != (e = dns_find(host))) {
+        if (cnt > 0) {
+            memcpy(e->addrs, addrs, cnt * sizeof(addrs[0]));
+            e->cnt = cnt;
+            e->expires_at = time_count_ms() + PLAT_DNS_TTL_MS;
+            // 上次连接成功的地址仍在结果中时排在最前
+            if (!e->last_good_failed) {
+                dns_move(e, e->last_good, 1);
+            }
+        }
+        e->pending = 0;
+        e->gen++;
+    }
+    dns_unlock();
+
+    free(host);
+}
+
+// 找到主机的条目，没有时占用最久未使用的条目，last_good为从存储读出的地址
+static struct dns_entry *dns_entry_get(const char *host, uint32_t last_good)
+{
+    struct dns_entry *e = dns_find(host);
+
+    // 读存储期间其他线程已建好条目时，保留条目中较新的状态
+    if (e) {
+        return e;
+    }
+
+    e = &g_dns_cache[0];
+    for (int i = 1; i < PLAT_DNS_CACHE_SIZE; i++) {
+        if (g_dns_cache[i].used_at < e->used_at) {
+            e = &g_dns_cache[i];
+        }
+    }
+
+    memset(e, 0, sizeof(*e));
+    strncpy(e->host, host, sizeof(e->host) - 1);
+    e->last_good = last_good;
+
+    return e;
+}
+
+// 复制条目中的地址，上次连接成功的地址即使已不在结果中也会返回
+static int32_t dns_copy(struct dns_entry *e, uint32_t *addrs, uint32_t max)
+{
+    uint32_t cnt = 0;
+
+    if (e->last_good && !e->last_good_failed) {
+        addrs[cnt++] = e->last_good;
+    }
+
+    for (uint32_t i = 0; i < e->cnt && cnt < max; i++) {
+        if (e->addrs[i] != e->last_good) {
+            addrs[cnt++] = e->addrs[i];
+        }
+    }
+
+    if (e->last_good && e->last_good_failed && cnt < max) {
+        addrs[cnt++] = e->last_good;
+    }
+
+    return cnt > 0 ? (int32_t)cnt : -1;
+}
+
+//解析主机名
+int32_t plat_dns_resolve(const uint8_t *host, uint32_t *addrs, uint32_t max, uint32_t timeout_ms)
+{
+    deadline_t deadline = deadline_start(timeout_ms);
+    struct in_addr literal;
+    struct dns_entry *e = NULL;
+    int32_t ret = -1;
+    uint32_t gen = 0, last_good = 0;
+    char *arg = NULL;
+
+    if (max == 0 || strlen((const char *)host) >= PLAT_DNS_HOST_LEN) {
+        return -1;
+    }
+
+    // 直接给出的 IP 地址不需要解析
+    if (inet_pton(AF_INET, (const char *)host, &literal) == 1) {
+        addrs[0] = literal.s_addr;
+        return 1;
+    }
+
+    dns_lock();
+    if (NULL == (e = dns_find((const char *)host))) {
+        // 打开存储可能很慢，不能在自旋锁内进行
+        dns_unlock();
+        last_good = dns_load_last_good((const char *)host);
+        dns_lock();
+        e = dns_entry_get((const char *)host, last_good);
+    }
+    e->used_at = time_count_ms();
+
+    if (e->cnt > 0 && e->used_at < e->expires_at) {
+        ret = dns_copy(e, addrs, max);
+        dns_unlock();
+        return ret;
+    }
+
+    // 同一主机只有一个解析在进行
+    if (!e->pending && NULL != (arg = strdup((const char *)host))) {
+        e->pending = 1;
+        if (0 == osl_thread_create((const uint8_t *)"dns", dns_lookup_main, arg, PLAT_DNS_STACK_SIZE, 5)) {
+            e->pending = 0;
+            free(arg);
+        }
+    }
+    gen = e->gen;
+
+    while (e->pending && !deadline_is_expired(deadline)) {
+        dns_unlock();
+        time_delay_ms(10);
+        dns_lock();
+
+        // 等待期间条目被其他主机占用
+        if (NULL == (e = dns_find((const char *)host))) {
+            dns_unlock();
+            return -1;
+        }
+        if (e->gen != gen) {
+            break;
+        }
+    }
+
+    // 解析超时或失败时使用过期的结果
+    ret = dns_copy(e, addrs, max);
+    if (ret > 0 && time_count_ms() >= e->expires_at) {
+        logw("DNS for %s not refreshed, using cached addresses", host);
+    }
+    dns_unlock();
+
+    return ret;
+}
+
+//报告连接结果
+void plat_dns_report(const uint8_t *host, uint32_t addr, int32_t ok)
+{
+    struct dns_entry *e = NULL;
+    int save = 0;
+
+    dns_lock();
+    if (NULL != (e = dns_find((const char *)host))) {
+        if (ok) {
+            dns_move(e, addr, 1);
+            save = (e->last_good != addr);
+            e->last_good = addr;
+            e->last_good_failed = 0;
+        } else {
+            dns_move(e, addr, 0);
+            // 保存的地址不删除，解析不可用时仍可作为最后的选择
+            if (e->last_good == addr) {
+                e->last_good_failed = 1;
+            }
+        }
+    }
+    dns_unlock();
+
+    // 地址变化时才写存储，减少写闪存的次数
+    if (save) {
+        dns_save_last_good((const char *)host, addr);
+    }
+}
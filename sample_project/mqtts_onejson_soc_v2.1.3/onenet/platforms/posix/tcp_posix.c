@@ -0,0 +1,223 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "log.h"
+#include "plat_dns.h"
+#include "plat_tcp.h"
+#include "plat_time.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+//等待套接字可读或可写，返回1表示就绪，0表示超时，-1表示出错
+static int32_t tcp_wait(int fd, short events, uint32_t timeout_ms)
+{
+    deadline_t deadline = deadline_start(timeout_ms);
+    struct pollfd pfd;
+    int ret = 0;
+
+    do {
+        pfd.fd = fd;
+        pfd.events = events;
+        pfd.revents = 0;
+
+        ret = poll(&pfd, 1, (int)deadline_left(deadline));
+    } while (ret < 0 && errno == EINTR && !deadline_is_expired(deadline));
+
+    if (ret < 0) {
+        return (errno == EINTR) ? 0 : -1;
+    } else if (ret == 0) {
+        return 0;
+    }
+
+    // 出错或对端关闭时也视为就绪，由随后的读写取得具体错误
+    return 1;
+}
+
+//非阻塞连接一个已解析的地址
+static int tcp_connect_addr(uint32_t addr, uint16_t port, uint32_t timeout_ms)
+{
+    struct sockaddr_in server_addr;
+    socklen_t len = sizeof(int);
+    int fd = -1;
+    int err = 0;
+    int on = 1;
+
+    if ((fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
+        loge("Unable to create socket: errno %d", errno);
+        return -1;
+    }
+
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) < 0) {
+        loge("Unable to set non-blocking: errno %d", errno);
+        close(fd);
+        return -1;
+    }
+
+    // 报文头和负载分开写入时，Nagle 会让负载等待对端的延迟确认
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    server_addr.sin_addr.s_addr = addr;
+
+    if (connect(fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        if (errno != EINPROGRESS) {
+            err = errno;
+        } else if (tcp_wait(fd, POLLOUT, timeout_ms) <= 0) {
+            err = ETIMEDOUT;
+        } else if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) {
+            err = errno;
+        }
+    }
+
+    if (err) {
+        loge("Connection to %s failed: errno %d", inet_ntoa(server_addr.sin_addr), err);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+//建立TCP连接
+handle_t plat_tcp_connect(const uint8_t *host, uint16_t port, uint32_t timeout_ms)
+{
+    deadline_t deadline = deadline_start(timeout_ms);
+    uint32_t addrs[PLAT_DNS_MAX_ADDRS];
+    int32_t cnt = 0;
+    int fd = -1;
+
+    // DNS 解析最多占用一半的超时时间，留出时间尝试连接
+    if ((cnt = plat_dns_resolve(host, addrs, PLAT_DNS_MAX_ADDRS, timeout_ms / 2)) <= 0) {
+        loge("DNS resolution failed for %s", host);
+        return -1;
+    }
+
+    // 依次尝试解析到的地址，剩余时间平分给未尝试的地址，一个不响应的地址不会用完全部时间
+    for (int32_t i = 0; i < cnt && fd < 0 && !deadline_is_expired(deadline); i++) {
+        fd = tcp_connect_addr(addrs[i], port, deadline_left(deadline) / (cnt - i));
+        plat_dns_report(host, addrs[i], fd >= 0);
+    }
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    logi("TCP connected to %s:%d", host, port);
+    return (handle_t)fd;
+}
+
+//等待连接可读
+int32_t plat_tcp_wait_readable(handle_t handle, uint32_t timeout_ms)
+{
+    if (handle < 0) {
+        return -1;
+    }
+
+    return tcp_wait((int)handle, POLLIN, timeout_ms);
+}
+
+//等待连接可写
+int32_t plat_tcp_wait_writable(handle_t handle, uint32_t timeout_ms)
+{
+    if (handle < 0) {
+        return -1;
+    }
+
+    return tcp_wait((int)handle, POLLOUT, timeout_ms);
+}
+
+//TCP发送数据，部分写入时继续发送剩余数据直到全部发完或超时
+int32_t plat_tcp_send(handle_t handle, void *buf, uint32_t len, uint32_t timeout_ms)
+{
+    deadline_t deadline = deadline_start(timeout_ms);
+    uint32_t sent = 0;
+    int32_t ret = 0;
+
+    if (handle < 0 || buf == NULL || len == 0) {
+        loge("Invalid parameters for send");
+        return -1;
+    }
+
+    while (sent < len) {
+        ret = send((int)handle, (uint8_t *)buf + sent, len - sent, MSG_NOSIGNAL);
+
+        if (ret > 0) {
+            sent += ret;
+        } else if (ret < 0 && errno == EINTR) {
+            continue;
+        } else if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if ((ret = tcp_wait((int)handle, POLLOUT, deadline_left(deadline))) <= 0) {
+                break;
+            }
+        } else {
+            ret = -1;
+            break;
+        }
+    }
+
+    if (ret < 0) {
+        loge("Send failed: errno %d", errno);
+        return -1;
+    }
+
+    return sent;
+}
+
+//TCP接收数据，有数据时直接读取，没有时才等待
+int32_t plat_tcp_recv(handle_t handle, void *buf, uint32_t len, uint32_t timeout_ms)
+{
+    deadline_t deadline = deadline_start(timeout_ms);
+    int32_t ret = 0;
+
+    if (handle < 0 || buf == NULL || len == 0) {
+        loge("Invalid parameters for recv");
+        return -1;
+    }
+
+    for (;;) {
+        ret = recv((int)handle, buf, len, 0);
+
+        if (ret > 0) {
+            return ret;
+        } else if (ret == 0) {
+            logw("Connection closed by peer");
+            return -1;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            loge("Receive failed: errno %d", errno);
+            return -1;
+        }
+
+        if ((ret = tcp_wait((int)handle, POLLIN, deadline_left(deadline))) <= 0) {
+            return ret;
+        }
+    }
+}
+
+//TCP断开连接
+int32_t plat_tcp_disconnect(handle_t handle)
+{
+    if (handle < 0) {
+        loge("Invalid socket handle");
+        return -1;
+    }
+
+    if (close((int)handle) < 0) {
+        loge("Close socket failed: errno %d", errno);
+        return -1;
+    }
+
+    logi("TCP connection closed");
+    return 0;
+}
@@ -51,7 +51,10 @@ enum mqtt_connect_flag_e
     /** Provide username information when connecting. When the flag is not set，MQTT_CONNECT_FLAG_PASSWORD is Invalid*/
     MQTT_CONNECT_FLAG_USERNAME      = 0x08,
     /** Provide user password when connecting，Valid when MQTT_CONNECT_FLAG_USERNAME is set*/
-    MQTT_CONNECT_FLAG_PASSWORD      = 0x10
+    MQTT_CONNECT_FLAG_PASSWORD      = 0x10,
+    /** Log in with MQTT 5.0 and send repeated publish topics as topic aliases，Valid when the SDK is built with MQTTV5，
+        Without it even a MQTTV5 build logs in with MQTT 3.1.1，The thing model sets it when CONFIG_TM_MQTT_V5 is 1*/
+    MQTT_CONNECT_FLAG_PROTOCOL_V5   = 0x20
 };
 
 /**
@@ -97,6 +100,13 @@ struct mqtt_param_t
     uint8_t *recv_buf;
     /** Data receiving buffer length*/
     uint32_t recv_buf_len;
+
+    /** Outbox store name，Optional. When set，QOS1 messages of mqtt_publish_async() are kept in the platform store
+        until acknowledged and replayed in order after the next login，Usually combined with a session that is not
+        cleaned*/
+    const uint8_t *outbox_name;
+    /** Output，Whether the server resumed the session of an earlier login，Subscriptions are still in place then*/
+    uint8_t        session_present;
 };
 
 /**
@@ -125,6 +135,65 @@ struct mqtt_message_t
  */
 typedef void (*mqtt_message_handler)(void * /*arg*/, const uint8_t * /*topic*/, struct mqtt_message_t * /*message*/);
 
+/**
+ * @brief MQTT Delivering message callbacks, topic passed as a view
+ *
+ * topic points into the client receive buffer and is not NUL terminated, it is
+ * only valid for the duration of the call.
+ */
+typedef void (*mqtt_topic_view_handler)(void * /*arg*/, const uint8_t * /*topic*/, uint32_t /*topic_len*/,
+                                        struct mqtt_message_t * /*message*/);
+
+/**
+ * @brief MQTT Delivering message callbacks, payload passed in chunks
+ *
+ * Called once per chunk in payload order，message->payload and payload_len describe
+ * the chunk，offset is where it starts in the payload and total_len is the whole
+ * payload length. A message that fits the receive buffer arrives as one chunk，
+ * Larger ones are read through the receive buffer piece by piece.
+ */
+typedef void (*mqtt_chunk_handler)(void * /*arg*/, const uint8_t * /*topic*/, struct mqtt_message_t * /*message*/,
+                                   uint32_t /*offset*/, uint32_t /*total_len*/);
+
+/**
+ * @brief MQTT Asynchronous publish completion callback
+ *
+ * Called once per message published with mqtt_publish_async(): ret is 0 when the
+ * PUBACK arrived, negative when the message was dropped and will not be sent again.
+ * A message kept in the outbox of a persistent session survives a dropped connection，
+ * its callback waits for the PUBACK of the copy replayed after the reconnect.
+ */
+typedef void (*mqtt_publish_complete_handler)(void * /*arg*/, uint16_t /*packet_id*/, int32_t /*ret*/);
+
+/**
+ * @brief MQTT Publish payload reader callback
+ *
+ * Writes the next at most len bytes of the payload into buf and returns how many
+ * were written，0 or negative aborts the publish.
+ */
+typedef int32_t (*mqtt_payload_reader)(void * /*arg*/, uint8_t * /*buf*/, uint32_t /*len*/);
+
+/**
+ * @brief MQTT Subscription entry for mqtt_subscribe_multi().
+ *
+ */
+struct mqtt_subscription_t
+{
+    /** Targets subscription topic*/
+    const uint8_t *         topic;
+    /** Requested QOS Grade*/
+    enum mqtt_qos_e         qos;
+    /** Message handling callback，Set one of msg_handler，view_handler or chunk_handler*/
+    mqtt_message_handler    msg_handler;
+    mqtt_topic_view_handler view_handler;
+    /** Chunked delivery，for messages that may outgrow the receive buffer*/
+    mqtt_chunk_handler      chunk_handler;
+    /** Message processing callback parameters*/
+    void *                  arg;
+    /** Output，QOS Grade granted by the server，0x80 and above means the topic was rejected*/
+    uint8_t                 granted_qos;
+};
+
 /*****************************************************************************/
 /* External Variables and Functions                                          */
 /*****************************************************************************/
@@ -161,8 +230,97 @@ int32_t mqtt_yield(void *client, uint32_t timeout_ms);
  */
 int32_t mqtt_publish(void *client, const uint8_t *topic, struct mqtt_message_t *message, uint32_t timeout_ms);
 
+/**
+ * @brief MQTT Message push with the payload supplied in chunks.
+ *
+ * The payload is read straight into the free part of the send buffer and written
+ * out piece by piece，So it may be larger than the send buffer. Payloads passed to
+ * mqtt_publish() are written from the caller's buffer without a copy once they reach
+ * MQTT_PUBLISH_STREAM_MIN bytes.
+ *
+ * @param client MQTT Client instance action handle
+ * @param topic Destination of push messages topic
+ * @param message Message settings，payload_len is the total payload length，payload is unused
+ * @param reader Payload reader callback
+ * @param arg Reader callback parameter
+ * @return int32_t Return PUBACK or other errors According to QOS Level
+ */
+int32_t mqtt_publish_stream(void *client, const uint8_t *topic, struct mqtt_message_t *message,
+                            mqtt_payload_reader reader, void *arg, uint32_t timeout_ms);
+
+/**
+ * @brief MQTT Message push without waiting for the acknowledgement.
+ *
+ * QOS1 messages are kept in the in-flight window until their PUBACK is
+ * processed by mqtt_yield(), resent with the DUP flag when unacknowledged for too
+ * long. Blocks only while the window is full. The window keeps its own copy of
+ * each QOS1 packet, so the payload size is bounded by the heap and, with an
+ * outbox, by the largest entry the store takes, not by the send buffer.
+ *
+ * @param client MQTT Client instance action handle
+ * @param topic Destination of push messages topic
+ * @param message Message content that needs to be pushed，message->id returns the packet id
+ * @param complete_cb Completion callback，Can be NULL
+ * @param arg Completion callback parameter
+ * @return int32_t 0 when the message was sent，otherwise error
+ */
+int32_t mqtt_publish_async(void *client, const uint8_t *topic, struct mqtt_message_t *message,
+                           mqtt_publish_complete_handler complete_cb, void *arg, uint32_t timeout_ms);
+
+/**
+ * @brief Write out MQTT packets still held in the outbound queue.
+ *
+ * @param client MQTT Client instance action handle
+ * @return int32_t
+ */
+int32_t mqtt_flush(void *client, uint32_t timeout_ms);
+
+/**
+ * @brief Get the keepalive round-trip time，A link-quality metric
+ *
+ * @param client MQTT Client instance action handle
+ * @param rtt_ms Latest PINGREQ to PINGRESP time in milliseconds，May be NULL
+ * @param srtt_ms Smoothed round-trip time in milliseconds，May be NULL
+ * @return int32_t 0 - Succeed，Other - No PINGRESP received yet
+ */
+int32_t mqtt_get_ping_rtt(void *client, uint32_t *rtt_ms, uint32_t *srtt_ms);
+
 int32_t mqtt_set_default_message_handler(void *client, mqtt_message_handler msg_handler, void *arg);
 
+/**
+ * @brief Set the handler for messages no subscription handler matches, topic passed as a view
+ *
+ * @param client MQTT Client instance action handle
+ * @param view_handler Message handling callback
+ * @param arg Set message processing callback parameters
+ * @return int32_t
+ */
+int32_t mqtt_set_default_topic_view_handler(void *client, mqtt_topic_view_handler view_handler, void *arg);
+
+/**
+ * @brief Set the handler for messages no subscription handler matches, payload passed in chunks
+ *
+ * Messages larger than the receive buffer are only delivered to chunk handlers，
+ * Other handlers never see them and they are acknowledged and dropped.
+ *
+ * @param client MQTT Client instance action handle
+ * @param chunk_handler Message handling callback
+ * @param arg Set message processing callback parameters
+ * @return int32_t
+ */
+int32_t mqtt_set_default_chunk_handler(void *client, mqtt_chunk_handler chunk_handler, void *arg);
+
+/**
+ * @brief Replace the handler of a subscribed topic filter with one that takes the payload in chunks
+ *
+ * @param client MQTT Client instance action handle
+ * @param topic Topic filter passed when subscribing
+ * @param chunk_handler Message handling callback
+ * @param arg Set message processing callback parameters
+ * @return int32_t
+ */
+int32_t mqtt_set_chunk_handler(void *client, const uint8_t *topic, mqtt_chunk_handler chunk_handler, void *arg);
+
 /**
  * @brief Subscribe designated topic
  *
@@ -176,6 +334,32 @@ int32_t mqtt_set_default_message_handler(void *client, mqtt_message_handler msg_
 int32_t mqtt_subscribe(void *client, const uint8_t *topic, enum mqtt_qos_e qos, mqtt_message_handler msg_handler,
                        void *arg, uint32_t timeout_ms);
 
+/**
+ * @brief Subscribe designated topic, the handler gets the topic as a view into the receive buffer
+ *
+ * @param client MQTT Client instance action handle
+ * @param topic Targets subscription topic
+ * @param qos Specify the target subscription topic QOS Grade
+ * @param view_handler Assign Message handling callbacks for topic
+ * @param arg Set message processing callback parameters
+ * @return int32_t
+ */
+int32_t mqtt_subscribe_view(void *client, const uint8_t *topic, enum mqtt_qos_e qos,
+                            mqtt_topic_view_handler view_handler, void *arg, uint32_t timeout_ms);
+
+/**
+ * @brief Subscribe several topics with a single SUBSCRIBE packet.
+ *
+ * Waits for one SUBACK carrying the granted QOS of every topic. Handlers of
+ * accepted topics are registered together once the SUBACK has been parsed.
+ *
+ * @param client MQTT Client instance action handle
+ * @param subs Subscription entries，granted_qos is filled in on return
+ * @param count Number of entries
+ * @return int32_t 0 when every topic was accepted，otherwise error
+ */
+int32_t mqtt_subscribe_multi(void *client, struct mqtt_subscription_t *subs, uint32_t count, uint32_t timeout_ms);
+
 /**
  * @brief Cancel topic Subscribe.
  *
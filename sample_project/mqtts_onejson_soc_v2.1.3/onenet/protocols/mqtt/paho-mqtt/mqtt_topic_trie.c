@@ -0,0 +1,349 @@
+/**
+ * Copyright (c), 2012~2019 iot.10086.cn All Rights Reserved
+ *
+ * @file mqtt_topic_trie.c
+ * @brief Subscription table segmented by topic level
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include "mqtt_topic_trie.h"
+
+#include <string.h>
+
+#include "plat_osl.h"
+
+/*****************************************************************************/
+/* Local Definitions ( Constant and Macro )                                  */
+/*****************************************************************************/
+#define TOPIC_TRIE_CHILD_STEP 4
+
+#define HAS_HANDLER(node)                                          \
+  (NULL != (node)->handler.fp || NULL != (node)->handler.view_fp || \
+   NULL != (node)->handler.chunk_fp)
+
+/*****************************************************************************/
+/* Local Function Prototype                                                  */
+/*****************************************************************************/
+static struct topic_node *matchLevel(struct topic_node *node, const char *s,
+                                     const char *end);
+
+/*****************************************************************************/
+/* Local Functions                                                           */
+/*****************************************************************************/
+static int compareLevel(const struct topic_node *node, const char *s,
+                        size_t len) {
+  if (node->len != len) {
+    return (node->len < len) ? -1 : 1;
+  }
+
+  return memcmp(node->level, s, len);
+}
+
+/* Binary search over the ordered literal children. Returns the index of the
+ * match, or -1 with *pos set to where the level would be inserted. */
+static int findChild(const struct topic_node *node, const char *s, size_t len,
+                     int *pos) {
+  int lo = 0, hi = (int)node->child_cnt - 1;
+
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    int cmp = compareLevel(node->children[mid], s, len);
+
+    if (cmp == 0) {
+      return mid;
+    } else if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+
+  if (pos) {
+    *pos = lo;
+  }
+
+  return -1;
+}
+
+static struct topic_node *newNode(struct topic_node *parent, const char *s,
+                                  size_t len) {
+  struct topic_node *node = osl_calloc(1, sizeof(struct topic_node) + len);
+
+  if (node) {
+    node->parent = parent;
+    node->len = (uint16_t)len;
+    osl_memcpy(node->level, s, len);
+  }
+
+  return node;
+}
+
+static struct topic_node *addChild(struct topic_node *node, const char *s,
+                                   size_t len) {
+  struct topic_node *child = NULL;
+  int pos = 0;
+  int i = findChild(node, s, len, &pos);
+
+  if (i >= 0) {
+    return node->children[i];
+  }
+
+  if (node->child_cnt == node->child_cap) {
+    struct topic_node **children =
+        osl_malloc((node->child_cap + TOPIC_TRIE_CHILD_STEP) *
+                   sizeof(struct topic_node *));
+
+    if (NULL == children) {
+      return NULL;
+    }
+
+    if (node->children) {
+      osl_memcpy(children, node->children,
+                 node->child_cnt * sizeof(struct topic_node *));
+      osl_free(node->children);
+    }
+
+    node->children = children;
+    node->child_cap += TOPIC_TRIE_CHILD_STEP;
+  }
+
+  if (NULL == (child = newNode(node, s, len))) {
+    return NULL;
+  }
+
+  osl_memmove(&node->children[pos + 1], &node->children[pos],
+              (node->child_cnt - pos) * sizeof(struct topic_node *));
+  node->children[pos] = child;
+  node->child_cnt++;
+
+  return child;
+}
+
+static struct topic_node *getChild(struct topic_node *node, const char *s,
+                                   size_t len, int create) {
+  struct topic_node **wild = NULL;
+  int i = 0;
+
+  if (len == 1 && (*s == '+' || *s == '#')) {
+    wild = (*s == '+') ? &node->plus : &node->hash;
+
+    if (NULL == *wild && create) {
+      *wild = newNode(node, s, len);
+    }
+
+    return *wild;
+  }
+
+  if (create) {
+    return addChild(node, s, len);
+  }
+
+  i = findChild(node, s, len, NULL);
+
+  return (i >= 0) ? node->children[i] : NULL;
+}
+
+static void freeNode(struct topic_node *node) {
+  uint16_t i = 0;
+
+  for (i = 0; i < node->child_cnt; i++) {
+    freeNode(node->children[i]);
+  }
+
+  if (node->plus) {
+    freeNode(node->plus);
+  }
+
+  if (node->hash) {
+    freeNode(node->hash);
+  }
+
+  if (node->children) {
+    osl_free(node->children);
+  }
+
+  if (node->parent) {
+    osl_free(node);
+  }
+}
+
+/* Release nodes that no longer lead to any handler, walking up from node */
+static void pruneNode(struct topic_node *node) {
+  while (node->parent && !HAS_HANDLER(node) && 0 == node->child_cnt &&
+         NULL == node->plus && NULL == node->hash) {
+    struct topic_node *parent = node->parent;
+
+    if (parent->plus == node) {
+      parent->plus = NULL;
+    } else if (parent->hash == node) {
+      parent->hash = NULL;
+    } else {
+      int i = findChild(parent, node->level, node->len, NULL);
+
+      parent->child_cnt--;
+      osl_memmove(&parent->children[i], &parent->children[i + 1],
+                  (parent->child_cnt - i) * sizeof(struct topic_node *));
+
+      if (0 == parent->child_cnt) {
+        osl_free(parent->children);
+        parent->children = NULL;
+        parent->child_cap = 0;
+      }
+    }
+
+    osl_free(node);
+    node = parent;
+  }
+}
+
+/* Walk the levels of a topic filter, "+" and "#" must fill a whole level and
+ * "#" must be the last one */
+static struct topic_node *walkFilter(struct topic_trie *trie,
+                                     const char *topic_filter, int create) {
+  struct topic_node *node = &trie->root;
+  const char *s = topic_filter;
+
+  if (NULL == s || '\0' == *s) {
+    return NULL;
+  }
+
+  for (;;) {
+    const char *e = strchr(s, '/');
+    size_t len = e ? (size_t)(e - s) : strlen(s);
+    struct topic_node *child = NULL;
+
+    if ((memchr(s, '+', len) || memchr(s, '#', len)) &&
+        (len != 1 || (*s == '#' && e))) {
+      break;
+    }
+
+    if (NULL == (child = getChild(node, s, len, create))) {
+      break;
+    }
+
+    node = child;
+
+    if (NULL == e) {
+      return node;
+    }
+
+    s = e + 1;
+  }
+
+  /* drop whatever this call created before it failed */
+  if (create) {
+    pruneNode(node);
+  }
+
+  return NULL;
+}
+
+/* Continue matching below node, e is the end of the level node matched */
+static struct topic_node *matchNext(struct topic_node *node, const char *e,
+                                    const char *end) {
+  if (e < end) {
+    return matchLevel(node, e + 1, end);
+  }
+
+  if (HAS_HANDLER(node)) {
+    return node;
+  }
+
+  /* "a/#" also matches "a" itself */
+  return (node->hash && HAS_HANDLER(node->hash)) ? node->hash : NULL;
+}
+
+static struct topic_node *matchLevel(struct topic_node *node, const char *s,
+                                     const char *end) {
+  struct topic_node *found = NULL;
+  const char *e = memchr(s, '/', end - s);
+  int i = 0;
+
+  if (NULL == e) {
+    e = end;
+  }
+
+  if (node->child_cnt > 0 && (i = findChild(node, s, e - s, NULL)) >= 0 &&
+      NULL != (found = matchNext(node->children[i], e, end))) {
+    return found;
+  }
+
+  if (node->plus && NULL != (found = matchNext(node->plus, e, end))) {
+    return found;
+  }
+
+  return (node->hash && HAS_HANDLER(node->hash)) ? node->hash : NULL;
+}
+
+/*****************************************************************************/
+/* External Functions                                                        */
+/*****************************************************************************/
+void topic_trie_init(struct topic_trie *trie) {
+  osl_memset(trie, 0, sizeof(*trie));
+}
+
+int32_t topic_trie_insert(struct topic_trie *trie, const char *topic_filter,
+                          const struct topic_trie_handler *handler) {
+  struct topic_node *node = NULL;
+
+  if (NULL == handler || (NULL == handler->fp && NULL == handler->view_fp &&
+                          NULL == handler->chunk_fp)) {
+    return -1;
+  }
+
+  if (NULL == (node = walkFilter(trie, topic_filter, 1))) {
+    return -1;
+  }
+
+  if (!HAS_HANDLER(node)) {
+    trie->count++;
+  }
+
+  node->handler = *handler;
+
+  return 0;
+}
+
+int32_t topic_trie_remove(struct topic_trie *trie, const char *topic_filter) {
+  struct topic_node *node = walkFilter(trie, topic_filter, 0);
+
+  if (NULL == node || !HAS_HANDLER(node)) {
+    return -1;
+  }
+
+  osl_memset(&node->handler, 0, sizeof(node->handler));
+  trie->count--;
+  pruneNode(node);
+
+  return 0;
+}
+
+const struct topic_trie_handler *topic_trie_find(struct topic_trie *trie,
+                                                 const char *topic_filter) {
+  struct topic_node *node = walkFilter(trie, topic_filter, 0);
+
+  return (node && HAS_HANDLER(node)) ? &node->handler : NULL;
+}
+
+const struct topic_trie_handler *topic_trie_match(struct topic_trie *trie,
+                                                  const char *topic,
+                                                  size_t topic_len) {
+  struct topic_node *node = NULL;
+
+  if (0 == trie->count || NULL == topic) {
+    return NULL;
+  }
+
+  if (NULL == (node = matchLevel(&trie->root, topic, topic + topic_len))) {
+    return NULL;
+  }
+
+  return &node->handler;
+}
+
+void topic_trie_clear(struct topic_trie *trie) {
+  freeNode(&trie->root);
+  topic_trie_init(trie);
+}
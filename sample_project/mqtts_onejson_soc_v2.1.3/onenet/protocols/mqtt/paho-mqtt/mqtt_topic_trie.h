@@ -0,0 +1,118 @@
+/**
+ * 版权所有 (c), 2012~2019 iot.10086.cn 保留所有权利
+ *
+ * @file mqtt_topic_trie.h
+ * @brief 按主题层级组织的订阅表，用于下行消息的处理器查找
+ */
+
+#ifndef __MQTT_TOPIC_TRIE_H__
+#define __MQTT_TOPIC_TRIE_H__
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include "data_types.h"
+#include "mqtt_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+/* External Definition（Constant and Macro )                                 */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* External Structures, Enum and Typedefs                                    */
+/*****************************************************************************/
+/**
+ * 订阅终点保存的处理器，fp、view_fp与chunk_fp三选一
+ */
+struct topic_trie_handler
+{
+    mqtt_message_handler    fp;       /* 以'\0'结尾的主题 */
+    mqtt_topic_view_handler view_fp;  /* 指向接收缓冲区的主题视图 */
+    void                   *arg;
+    mqtt_chunk_handler      chunk_fp; /* 负载分块交付，可超过接收缓冲区 */
+};
+
+/**
+ * 树的每个节点对应主题过滤器中的一个层级，普通层级按名称有序存放，
+ * "+"和"#"层级单独存放，匹配时无需逐个比较通配节点。
+ */
+struct topic_node
+{
+    struct topic_node  *parent;
+    struct topic_node **children; /* 普通层级，按(长度, 内容)排序 */
+    uint16_t            child_cnt;
+    uint16_t            child_cap;
+    struct topic_node  *plus;
+    struct topic_node  *hash;
+
+    struct topic_trie_handler handler; /* 全为NULL表示该节点不是订阅终点 */
+
+    uint16_t len;
+    char     level[1];
+};
+
+struct topic_trie
+{
+    struct topic_node root;
+    uint32_t          count;
+};
+
+/*****************************************************************************/
+/* External Variables and Functions                                          */
+/*****************************************************************************/
+/**
+ * @brief 初始化订阅表
+ * @param trie 订阅表指针
+ */
+void topic_trie_init(struct topic_trie *trie);
+
+/**
+ * @brief 添加或更新主题过滤器对应的处理器
+ * @param trie 订阅表指针
+ * @param topic_filter 主题过滤器，内容会被复制
+ * @param handler 处理器，内容会被复制
+ * @return 成功返回0，过滤器格式错误或内存不足返回-1
+ */
+int32_t topic_trie_insert(struct topic_trie *trie, const char *topic_filter, const struct topic_trie_handler *handler);
+
+/**
+ * @brief 移除主题过滤器，并释放不再使用的节点
+ * @param trie 订阅表指针
+ * @param topic_filter 主题过滤器
+ * @return 成功返回0，过滤器不存在返回-1
+ */
+int32_t topic_trie_remove(struct topic_trie *trie, const char *topic_filter);
+
+/**
+ * @brief 查找主题过滤器本身登记的处理器，通配层级按字面比较
+ * @param trie 订阅表指针
+ * @param topic_filter 主题过滤器
+ * @return 返回该过滤器的处理器，未登记返回NULL
+ */
+const struct topic_trie_handler *topic_trie_find(struct topic_trie *trie, const char *topic_filter);
+
+/**
+ * @brief 查找与主题匹配的处理器
+ * @param trie 订阅表指针
+ * @param topic 主题，无需以'\0'结尾
+ * @param topic_len 主题长度
+ * @return 返回匹配的处理器，无匹配返回NULL
+ * @note 多个过滤器同时匹配时，逐层优先普通层级，其次"+"，最后"#"
+ */
+const struct topic_trie_handler *topic_trie_match(struct topic_trie *trie, const char *topic, size_t topic_len);
+
+/**
+ * @brief 移除全部主题过滤器
+ * @param trie 订阅表指针
+ */
+void topic_trie_clear(struct topic_trie *trie);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -26,11 +26,13 @@
 #define WOLFSSL_RIPEMD
 #define USE_WOLFSSL_IO
 #define WOLFSSL_STATIC_RSA
+#define WOLFSSL_STATIC_PSK
+#define HAVE_AESGCM
+#define GCM_SMALL
 #define NO_DH
 #define NO_MD4
 #define NO_DES3
 #define NO_DSA
-#define NO_PSK
 #define NO_PWDBASED
 #define NO_RC4
 #define NO_RABBIT
@@ -40,7 +42,11 @@
 
 #define WOLFSSL_SMALL_STACK
 
-#define NO_SESSION_CACHE
+/* one cached session is all the client needs to resume, see tls.c */
+#define SMALL_SESSION_CACHE
+#define NO_CLIENT_CACHE
+#define HAVE_TLS_EXTENSIONS
+#define HAVE_SESSION_TICKET
 #define NO_WOLFSSL_SERVER
 #define NO_ERROR_STRINGS
 #define SINGLE_THREADED
@@ -147,6 +147,31 @@ struct tm_downlink_tbl_t {
   uint16_t svc_tbl_size;          /**< 服务表的大小 */
 };
 
+/**
+ * @brief I/O任务连接状态
+ */
+enum tm_io_state_e {
+  TM_IO_STATE_DISCONNECTED = 0, /**< I/O任务已退出 */
+  TM_IO_STATE_CONNECTED = 1,    /**< 登录成功 */
+  TM_IO_STATE_CONNECTING = 2,   /**< 登录失败或连接断开，等待重连 */
+};
+
+/**
+ * @brief I/O任务连接状态回调函数类型，在I/O任务中调用
+ *
+ * @param state 新状态，取值见 tm_io_state_e。
+ * @param reason 状态变化的原因，0表示正常，其他值为错误码。
+ */
+typedef void (*tm_io_state_cb)(int32_t state, int32_t reason);
+
+/**
+ * @brief 异步上报结果回调函数类型，在I/O任务中调用，不能阻塞
+ *
+ * @param arg 上报时传入的参数。
+ * @param ret 0表示平台已确认，其他值为错误码。
+ */
+typedef void (*tm_post_cb)(void *arg, int32_t ret);
+
 /*****************************************************************************/
 /* External Variables and Functions                                          */
 /*****************************************************************************/
@@ -377,6 +402,108 @@ int32_t tm_send_response(const uint8_t *name, uint8_t *msg_id, int32_t msg_code,
  */
 int32_t tm_step(uint32_t timeout_ms);
 
+#if defined(SDK_USE_MQTTS)
+/**
+ * @brief 启动I/O任务（多线程模式）
+ *
+ * I/O任务独占MQTT连接：登录、接收下行数据并发送其他线程提交的请求。
+ * 启动后 tm_post_property 等接口可在任意线程并发调用，无需外部加锁，
+ * 也不应再调用 tm_login、tm_logout 和 tm_step。
+ *
+ * @param product_id 产品 ID。
+ * @param dev_name 设备名称。
+ * @param access_key 产品密钥或设备密钥。
+ * @param expire_time 登录令牌的过期时间。
+ * @param timeout_ms 登录超时时间（毫秒）。
+ * @param state_cb 连接状态回调，可为NULL。
+ * @return 0表示任务已启动，登录结果通过 state_cb 通知
+ * @note 登录失败或连接断开后任务按 tm_io_set_reconnect 的设置自动重连，
+ *       等待重连期间提交的请求直接返回 ERR_NETWORK。关闭重连时任务退出，
+ *       可再次调用本函数重新启动。
+ */
+int32_t tm_io_start(const char *product_id, const char *dev_name,
+                    const char *access_key, uint64_t expire_time,
+                    uint32_t timeout_ms, tm_io_state_cb state_cb);
+
+/**
+ * @brief 停止I/O任务并登出
+ *
+ * 未完成的请求以错误码结束。
+ *
+ * @param timeout_ms 等待任务退出的超时时间（毫秒）。
+ * @return 0表示成功，ERR_TIMEOUT表示任务未在超时时间内退出
+ */
+int32_t tm_io_stop(uint32_t timeout_ms);
+
+/**
+ * @brief 设置I/O任务的重连策略，在 tm_io_start 之前调用
+ *
+ * 每次重连失败后等待时间加倍，直到最大值，再随机减去一部分，避免大量设备
+ * 同时断线后同时重连。稳定运行过的连接断开后立即重连一次。
+ *
+ * @param min_ms 首次重连前的等待时间（毫秒）。
+ * @param max_ms 等待时间的上限（毫秒），0表示关闭重连，连接断开后任务退出。
+ * @param jitter_pct 随机减去的比例上限，取值0~100。
+ * @return 0表示成功，ERR_INVALID_PARAM表示参数无效
+ */
+int32_t tm_io_set_reconnect(uint32_t min_ms, uint32_t max_ms,
+                            uint32_t jitter_pct);
+
+/**
+ * @brief 获取I/O任务的连接状态
+ *
+ * @return 取值见 tm_io_state_e，与最近一次 state_cb 通知的状态一致
+ */
+int32_t tm_io_get_state(void);
+
+/**
+ * @brief 异步上报设备属性，需先调用 tm_io_start
+ *
+ * @param prop_data 设备属性数据，由SDK释放。
+ * @param callback 结果回调，可为NULL。
+ * @param arg 回调参数。
+ * @param timeout_ms 等待平台回复的超时时间（毫秒）。
+ * @return 0表示已入队，其他值表示失败且不会调用回调
+ */
+int32_t tm_post_property_async(void *prop_data, tm_post_cb callback, void *arg,
+                               uint32_t timeout_ms);
+
+/**
+ * @brief 异步上报设备事件，需先调用 tm_io_start
+ *
+ * @param event_data 设备事件数据，由SDK释放。
+ * @param callback 结果回调，可为NULL。
+ * @param arg 回调参数。
+ * @param timeout_ms 等待平台回复的超时时间（毫秒）。
+ * @return 0表示已入队，其他值表示失败且不会调用回调
+ */
+int32_t tm_post_event_async(void *event_data, tm_post_cb callback, void *arg,
+                            uint32_t timeout_ms);
+
+/**
+ * @brief 异步上报设备历史数据，需先调用 tm_io_start
+ *
+ * @param history_data 设备历史数据，由SDK释放。
+ * @param callback 结果回调，可为NULL。
+ * @param arg 回调参数。
+ * @param timeout_ms 等待平台回复的超时时间（毫秒）。
+ * @return 0表示已入队，其他值表示失败且不会调用回调
+ */
+int32_t tm_post_history_data_async(void *history_data, tm_post_cb callback,
+                                   void *arg, uint32_t timeout_ms);
+
+/**
+ * @brief 获取心跳往返时延，可作为链路质量指标
+ *
+ * 链路空闲时才会发送心跳，持续有数据发送时样本可能较旧。
+ *
+ * @param rtt_ms 最近一次心跳的往返时延（毫秒），可为NULL。
+ * @param srtt_ms 平滑后的往返时延（毫秒），可为NULL。
+ * @return 0表示成功，其他值表示未登录或尚未收到心跳响应
+ */
+int32_t tm_get_ping_rtt(uint32_t *rtt_ms, uint32_t *srtt_ms);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
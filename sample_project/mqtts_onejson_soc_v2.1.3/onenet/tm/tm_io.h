@@ -0,0 +1,92 @@
+/**
+ * Copyright (c), 2012~2024 iot.10086.cn All Rights Reserved
+ *
+ * @file tm_io.h
+ * @brief Thing Model I/O task, serializes requests from any thread onto the
+ *        task that owns the MQTT connection
+ */
+
+#ifndef __TM_IO_H__
+#define __TM_IO_H__
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include "aiot_tm_api.h"
+#include "data_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+/* External Definition ( Constant and Macro )                                */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* External Structures, Enum and Typedefs                                    */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* External Variables and Functions                                          */
+/*****************************************************************************/
+/**
+ * @brief 判断当前线程的请求是否需要交给I/O任务处理
+ *
+ * @return 非0表示I/O任务正在运行且调用者不是I/O任务本身
+ */
+int32_t tm_io_active(void);
+
+/**
+ * @brief 将请求放入I/O任务的命令队列并等待平台回复
+ *
+ * @param name 请求主题后缀。
+ * @param as_raw 数据是否为原始 json 字符串，原始数据会被复制。
+ * @param data 请求数据，tm_data 数据无论成功与否都由本函数释放。
+ * @param reply_data 用于接收回复数据，可为NULL。
+ * @param timeout_ms 从入队开始计算的超时时间（毫秒）。
+ * @return 0表示成功，其他值表示失败
+ */
+int32_t tm_io_post(const uint8_t *name, uint8_t as_raw, void *data,
+                   void **reply_data, uint32_t timeout_ms);
+
+/**
+ * @brief 将请求放入I/O任务的命令队列后立即返回
+ *
+ * @param name 请求主题后缀。
+ * @param data tm_data 请求数据，无论成功与否都由本函数释放。
+ * @param callback 结果回调，在I/O任务中调用，可为NULL。
+ * @param arg 回调参数。
+ * @param timeout_ms 从入队开始计算的超时时间（毫秒）。
+ * @return 0表示已入队，其他值表示失败且不会调用回调
+ */
+int32_t tm_io_post_async(const uint8_t *name, void *data, tm_post_cb callback,
+                         void *arg, uint32_t timeout_ms);
+
+/**
+ * @brief 将平台回复交给等待中的队列请求，只在I/O任务中调用
+ *
+ * @param payload 回复报文。
+ * @param payload_len 回复报文长度。
+ * @return 0表示回复属于队列请求并已处理，-1表示不属于
+ */
+int32_t tm_io_reply(uint8_t *payload, uint32_t payload_len);
+
+/**
+ * @brief 发布请求但不等待回复，由 aiot_tm_api.c 实现
+ *
+ * @param name 请求主题后缀。
+ * @param as_raw 数据是否为原始 json 字符串。
+ * @param data 请求数据，tm_data 数据无论成功与否都会被释放。
+ * @param post_id 返回请求使用的消息ID。
+ * @param timeout_ms 发送超时时间（毫秒）。
+ * @return 0表示成功，其他值表示失败
+ */
+int32_t tm_send_request_nowait(const uint8_t *name, uint8_t as_raw, void *data,
+                               int32_t *post_id, uint32_t timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -20,51 +20,92 @@
 #include "mqtt_api.h"
 #include "plat_osl.h"
 #include "plat_time.h"
+#if defined(CONFIG_NETWORK_TLS) && CONFIG_NETWORK_TLS == 1
+#include "tls.h"
+#endif
 
 /*****************************************************************************/
 /* Local Definitions ( Constant and Macro )                                  */
 /*****************************************************************************/
+#if defined(CONFIG_TM_MQTT_V5) && CONFIG_TM_MQTT_V5 == 1 && !defined(MQTTV5)
+#error "CONFIG_TM_MQTT_V5 needs the MQTT client built with MQTTV5"
+#endif
 
 #if defined(CONFIG_NETWORK_TLS) && CONFIG_NETWORK_TLS == 1
 
-static const uint8_t *g_tm_cert =
-    (const uint8_t *)"-----BEGIN CERTIFICATE-----\r\n"
-                     "MIIDOzCCAiOgAwIBAgIJAPCCNfxANtVEMA0GCSqGSIb3DQEBCwUAMDQxC"
-                     "zAJBgNV\r\n"
-                     "BAYTAkNOMQ4wDAYDVQQKDAVDTUlPVDEVMBMGA1UEAwwMT25lTkVUIE1RV"
-                     "FRTMB4X\r\n"
-                     "DTE5MDUyOTAxMDkyOFoXDTQ5MDUyMTAxMDkyOFowNDELMAkGA1UEBhMCQ"
-                     "04xDjAM\r\n"
-                     "BgNVBAoMBUNNSU9UMRUwEwYDVQQDDAxPbmVORVQgTVFUVFMwggEiMA0GC"
-                     "SqGSIb3\r\n"
-                     "DQEBAQUAA4IBDwAwggEKAoIBAQC/"
-                     "VvJ6lGWfy9PKdXKBdzY83OERB35AJhu+9jkx\r\n"
-                     "5d4SOtZScTe93Xw9TSVRKrFwu5muGgPusyAlbQnFlZoTJBZY/"
-                     "745MG6aeli6plpR\r\n"
-                     "r93G6qVN5VLoXAkvqKslLZlj6wXy70/"
-                     "e0GC0oMFzqSP0AY74icANk8dUFB2Q8usS\r\n"
-                     "UseRafNBcYfqACzF/Wa+Fu/"
-                     "upBGwtl7wDLYZdCm3KNjZZZstvVB5DWGnqNX9HkTl\r\n"
-                     "U9NBMS/7yph3XYU3mJqUZxryb8pHLVHazarNRppx1aoNroi+5/t3Fx/"
-                     "gEa6a5PoP\r\n"
-                     "ouH35DbykmzvVE67GUGpAfZZtEFE1e0E/"
-                     "6IB84PE00llvy3pAgMBAAGjUDBOMB0G\r\n"
-                     "A1UdDgQWBBTTi/"
-                     "q1F2iabqlS7yEoX1rbOsz5GDAfBgNVHSMEGDAWgBTTi/q1F2ia\r\n"
-                     "bqlS7yEoX1rbOsz5GDAMBgNVHRMEBTADAQH/"
-                     "MA0GCSqGSIb3DQEBCwUAA4IBAQAL\r\n"
-                     "aqJ2FgcKLBBHJ8VeNSuGV2cxVYH1JIaHnzL6SlE5q7MYVg+"
-                     "Ofbs2PRlTiWGMazC7\r\n"
-                     "q5RKVj9zj0z/8i3ScWrWXFmyp85ZHfuo/"
-                     "DeK6HcbEXJEOfPDvyMPuhVBTzuBIRJb\r\n"
-                     "41M27NdIVCdxP6562n6Vp0gbE8kN10q+ksw8YBoLFP0D1da7D5WnSV+"
-                     "nwEIP+F4a\r\n"
-                     "3ZX80bNt6tRj9XY0gM68mI60WXrF/"
-                     "qYL+NUz+D3Lw9bgDSXxpSN8JGYBR85BxBvR\r\n"
-                     "NNAhsJJ3yoAvbPUQ4m8J/"
-                     "CoVKKgcWymS1pvEHmF47pgzbbjm5bdthlIx+swdiGFa\r\n"
-                     "WzdhzTYwVkxBaU+xf/2w\r\n"
-                     "-----END CERTIFICATE-----";
+/* OneNET MQTTS CA (C=CN, O=CMIOT, CN=OneNET MQTTS) in DER, parsed once by
+ * tls_init(), regenerate with openssl x509 -outform der | xxd -i */
+static const uint8_t g_tm_cert[] = {
+    0x30, 0x82, 0x03, 0x3b, 0x30, 0x82, 0x02, 0x23, 0xa0, 0x03, 0x02, 0x01,
+    0x02, 0x02, 0x09, 0x00, 0xf0, 0x82, 0x35, 0xfc, 0x40, 0x36, 0xd5, 0x44,
+    0x30, 0x0d, 0x06, 0x09, 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01,
+    0x0b, 0x05, 0x00, 0x30, 0x34, 0x31, 0x0b, 0x30, 0x09, 0x06, 0x03, 0x55,
+    0x04, 0x06, 0x13, 0x02, 0x43, 0x4e, 0x31, 0x0e, 0x30, 0x0c, 0x06, 0x03,
+    0x55, 0x04, 0x0a, 0x0c, 0x05, 0x43, 0x4d, 0x49, 0x4f, 0x54, 0x31, 0x15,
+    0x30, 0x13, 0x06, 0x03, 0x55, 0x04, 0x03, 0x0c, 0x0c, 0x4f, 0x6e, 0x65,
+    0x4e, 0x45, 0x54, 0x20, 0x4d, 0x51, 0x54, 0x54, 0x53, 0x30, 0x1e, 0x17,
+    0x0d, 0x31, 0x39, 0x30, 0x35, 0x32, 0x39, 0x30, 0x31, 0x30, 0x39, 0x32,
+    0x38, 0x5a, 0x17, 0x0d, 0x34, 0x39, 0x30, 0x35, 0x32, 0x31, 0x30, 0x31,
+    0x30, 0x39, 0x32, 0x38, 0x5a, 0x30, 0x34, 0x31, 0x0b, 0x30, 0x09, 0x06,
+    0x03, 0x55, 0x04, 0x06, 0x13, 0x02, 0x43, 0x4e, 0x31, 0x0e, 0x30, 0x0c,
+    0x06, 0x03, 0x55, 0x04, 0x0a, 0x0c, 0x05, 0x43, 0x4d, 0x49, 0x4f, 0x54,
+    0x31, 0x15, 0x30, 0x13, 0x06, 0x03, 0x55, 0x04, 0x03, 0x0c, 0x0c, 0x4f,
+    0x6e, 0x65, 0x4e, 0x45, 0x54, 0x20, 0x4d, 0x51, 0x54, 0x54, 0x53, 0x30,
+    0x82, 0x01, 0x22, 0x30, 0x0d, 0x06, 0x09, 0x2a, 0x86, 0x48, 0x86, 0xf7,
+    0x0d, 0x01, 0x01, 0x01, 0x05, 0x00, 0x03, 0x82, 0x01, 0x0f, 0x00, 0x30,
+    0x82, 0x01, 0x0a, 0x02, 0x82, 0x01, 0x01, 0x00, 0xbf, 0x56, 0xf2, 0x7a,
+    0x94, 0x65, 0x9f, 0xcb, 0xd3, 0xca, 0x75, 0x72, 0x81, 0x77, 0x36, 0x3c,
+    0xdc, 0xe1, 0x11, 0x07, 0x7e, 0x40, 0x26, 0x1b, 0xbe, 0xf6, 0x39, 0x31,
+    0xe5, 0xde, 0x12, 0x3a, 0xd6, 0x52, 0x71, 0x37, 0xbd, 0xdd, 0x7c, 0x3d,
+    0x4d, 0x25, 0x51, 0x2a, 0xb1, 0x70, 0xbb, 0x99, 0xae, 0x1a, 0x03, 0xee,
+    0xb3, 0x20, 0x25, 0x6d, 0x09, 0xc5, 0x95, 0x9a, 0x13, 0x24, 0x16, 0x58,
+    0xff, 0xbe, 0x39, 0x30, 0x6e, 0x9a, 0x7a, 0x58, 0xba, 0xa6, 0x5a, 0x51,
+    0xaf, 0xdd, 0xc6, 0xea, 0xa5, 0x4d, 0xe5, 0x52, 0xe8, 0x5c, 0x09, 0x2f,
+    0xa8, 0xab, 0x25, 0x2d, 0x99, 0x63, 0xeb, 0x05, 0xf2, 0xef, 0x4f, 0xde,
+    0xd0, 0x60, 0xb4, 0xa0, 0xc1, 0x73, 0xa9, 0x23, 0xf4, 0x01, 0x8e, 0xf8,
+    0x89, 0xc0, 0x0d, 0x93, 0xc7, 0x54, 0x14, 0x1d, 0x90, 0xf2, 0xeb, 0x12,
+    0x52, 0xc7, 0x91, 0x69, 0xf3, 0x41, 0x71, 0x87, 0xea, 0x00, 0x2c, 0xc5,
+    0xfd, 0x66, 0xbe, 0x16, 0xef, 0xee, 0xa4, 0x11, 0xb0, 0xb6, 0x5e, 0xf0,
+    0x0c, 0xb6, 0x19, 0x74, 0x29, 0xb7, 0x28, 0xd8, 0xd9, 0x65, 0x9b, 0x2d,
+    0xbd, 0x50, 0x79, 0x0d, 0x61, 0xa7, 0xa8, 0xd5, 0xfd, 0x1e, 0x44, 0xe5,
+    0x53, 0xd3, 0x41, 0x31, 0x2f, 0xfb, 0xca, 0x98, 0x77, 0x5d, 0x85, 0x37,
+    0x98, 0x9a, 0x94, 0x67, 0x1a, 0xf2, 0x6f, 0xca, 0x47, 0x2d, 0x51, 0xda,
+    0xcd, 0xaa, 0xcd, 0x46, 0x9a, 0x71, 0xd5, 0xaa, 0x0d, 0xae, 0x88, 0xbe,
+    0xe7, 0xfb, 0x77, 0x17, 0x1f, 0xe0, 0x11, 0xae, 0x9a, 0xe4, 0xfa, 0x0f,
+    0xa2, 0xe1, 0xf7, 0xe4, 0x36, 0xf2, 0x92, 0x6c, 0xef, 0x54, 0x4e, 0xbb,
+    0x19, 0x41, 0xa9, 0x01, 0xf6, 0x59, 0xb4, 0x41, 0x44, 0xd5, 0xed, 0x04,
+    0xff, 0xa2, 0x01, 0xf3, 0x83, 0xc4, 0xd3, 0x49, 0x65, 0xbf, 0x2d, 0xe9,
+    0x02, 0x03, 0x01, 0x00, 0x01, 0xa3, 0x50, 0x30, 0x4e, 0x30, 0x1d, 0x06,
+    0x03, 0x55, 0x1d, 0x0e, 0x04, 0x16, 0x04, 0x14, 0xd3, 0x8b, 0xfa, 0xb5,
+    0x17, 0x68, 0x9a, 0x6e, 0xa9, 0x52, 0xef, 0x21, 0x28, 0x5f, 0x5a, 0xdb,
+    0x3a, 0xcc, 0xf9, 0x18, 0x30, 0x1f, 0x06, 0x03, 0x55, 0x1d, 0x23, 0x04,
+    0x18, 0x30, 0x16, 0x80, 0x14, 0xd3, 0x8b, 0xfa, 0xb5, 0x17, 0x68, 0x9a,
+    0x6e, 0xa9, 0x52, 0xef, 0x21, 0x28, 0x5f, 0x5a, 0xdb, 0x3a, 0xcc, 0xf9,
+    0x18, 0x30, 0x0c, 0x06, 0x03, 0x55, 0x1d, 0x13, 0x04, 0x05, 0x30, 0x03,
+    0x01, 0x01, 0xff, 0x30, 0x0d, 0x06, 0x09, 0x2a, 0x86, 0x48, 0x86, 0xf7,
+    0x0d, 0x01, 0x01, 0x0b, 0x05, 0x00, 0x03, 0x82, 0x01, 0x01, 0x00, 0x0b,
+    0x6a, 0xa2, 0x76, 0x16, 0x07, 0x0a, 0x2c, 0x10, 0x47, 0x27, 0xc5, 0x5e,
+    0x35, 0x2b, 0x86, 0x57, 0x67, 0x31, 0x55, 0x81, 0xf5, 0x24, 0x86, 0x87,
+    0x9f, 0x32, 0xfa, 0x4a, 0x51, 0x39, 0xab, 0xb3, 0x18, 0x56, 0x0f, 0x8e,
+    0x7d, 0xbb, 0x36, 0x3d, 0x19, 0x53, 0x89, 0x61, 0x8c, 0x6b, 0x30, 0xbb,
+    0xab, 0x94, 0x4a, 0x56, 0x3f, 0x73, 0x8f, 0x4c, 0xff, 0xf2, 0x2d, 0xd2,
+    0x71, 0x6a, 0xd6, 0x5c, 0x59, 0xb2, 0xa7, 0xce, 0x59, 0x1d, 0xfb, 0xa8,
+    0xfc, 0x37, 0x8a, 0xe8, 0x77, 0x1b, 0x11, 0x72, 0x44, 0x39, 0xf3, 0xc3,
+    0xbf, 0x23, 0x0f, 0xba, 0x15, 0x41, 0x4f, 0x3b, 0x81, 0x21, 0x12, 0x5b,
+    0xe3, 0x53, 0x36, 0xec, 0xd7, 0x48, 0x54, 0x27, 0x71, 0x3f, 0xae, 0x7a,
+    0xda, 0x7e, 0x95, 0xa7, 0x48, 0x1b, 0x13, 0xc9, 0x0d, 0xd7, 0x4a, 0xbe,
+    0x92, 0xcc, 0x3c, 0x60, 0x1a, 0x0b, 0x14, 0xfd, 0x03, 0xd5, 0xd6, 0xbb,
+    0x0f, 0x95, 0xa7, 0x49, 0x5f, 0xa7, 0xc0, 0x42, 0x0f, 0xf8, 0x5e, 0x1a,
+    0xdd, 0x95, 0xfc, 0xd1, 0xb3, 0x6d, 0xea, 0xd4, 0x63, 0xf5, 0x76, 0x34,
+    0x80, 0xce, 0xbc, 0x98, 0x8e, 0xb4, 0x59, 0x7a, 0xc5, 0xfe, 0xa6, 0x0b,
+    0xf8, 0xd5, 0x33, 0xf8, 0x3d, 0xcb, 0xc3, 0xd6, 0xe0, 0x0d, 0x25, 0xf1,
+    0xa5, 0x23, 0x7c, 0x24, 0x66, 0x01, 0x47, 0xce, 0x41, 0xc4, 0x1b, 0xd1,
+    0x34, 0xd0, 0x21, 0xb0, 0x92, 0x77, 0xca, 0x80, 0x2f, 0x6c, 0xf5, 0x10,
+    0xe2, 0x6f, 0x09, 0xfc, 0x2a, 0x15, 0x28, 0xa8, 0x1c, 0x5b, 0x29, 0x92,
+    0xd6, 0x9b, 0xc4, 0x1e, 0x61, 0x78, 0xee, 0x98, 0x33, 0x6d, 0xb8, 0xe6,
+    0xe5, 0xb7, 0x6d, 0x86, 0x52, 0x31, 0xfa, 0xcc, 0x1d, 0x88, 0x61, 0x5a,
+    0x5b, 0x37, 0x61, 0xcd, 0x36, 0x30, 0x56, 0x4c, 0x41, 0x69, 0x4f, 0xb1,
+    0x7f, 0xfd, 0xb0};
 
 #else
 
@@ -72,6 +113,17 @@ static const uint8_t *g_tm_cert = NULL;
 #endif
 
 #define THING_MODEL_SUBED_TOPIC "$sys/%s/%s/thing/#"
+
+/* Largest inbound message put back together when it arrives in pieces because
+ * it does not fit the receive buffer, larger ones are dropped */
+#ifndef TM_MQTT_RECV_MAX
+#define TM_MQTT_RECV_MAX SDK_PAYLOAD_LEN
+#endif
+
+#if defined(CONFIG_TM_PERSISTENT_SESSION) && CONFIG_TM_PERSISTENT_SESSION == 1
+/* Platform store holding the QoS1 messages the broker has not acknowledged */
+#define THING_MODEL_OUTBOX_NAME "tm_outbox"
+#endif
 /*****************************************************************************/
 /* Structures, Enum and Typedefs                                             */
 /*****************************************************************************/
@@ -82,6 +134,7 @@ typedef struct tm_mqtt_obj_s {
   uint8_t *subed_topic;
   uint8_t *cmp_topic;
   tm_mqtt_message_cb recv_cb;
+  uint8_t *recv_buf; /* message being reassembled from chunks */
 } tm_mqtt_obj_t;
 
 /*****************************************************************************/
@@ -93,6 +146,11 @@ typedef struct tm_mqtt_obj_s {
 /*****************************************************************************/
 tm_mqtt_obj_t *g_mqtt_obj = NULL;
 
+/* Copied out of the client after every step, so other threads can read them
+ * without touching a client that may be torn down meanwhile */
+static uint32_t g_ping_rtt_ms = 0;
+static uint32_t g_ping_srtt_ms = 0;
+
 /*****************************************************************************/
 /* Global Variables                                                          */
 /*****************************************************************************/
@@ -101,9 +159,36 @@ tm_mqtt_obj_t *g_mqtt_obj = NULL;
 /* Function Implementation                                                   */
 /*****************************************************************************/
 
-static void tm_mqtt_message_arrived(void *arg, const uint8_t *topic,
-                                    struct mqtt_message_t *message) {
-  g_mqtt_obj->recv_cb(topic, message->payload, message->payload_len);
+static void tm_mqtt_chunk_arrived(void *arg, const uint8_t *topic,
+                                  struct mqtt_message_t *message,
+                                  uint32_t offset, uint32_t total_len) {
+  /* a message that fits the receive buffer comes in one piece */
+  if (offset == 0 && message->payload_len == total_len) {
+    g_mqtt_obj->recv_cb(topic, message->payload, message->payload_len);
+    return;
+  }
+
+  if (offset == 0) {
+    SAFE_FREE(g_mqtt_obj->recv_buf);
+
+    if (total_len > TM_MQTT_RECV_MAX ||
+        NULL == (g_mqtt_obj->recv_buf = osl_malloc(total_len))) {
+      loge("message of %u bytes on %s dropped", (unsigned)total_len, topic);
+      return;
+    }
+  }
+
+  if (NULL == g_mqtt_obj->recv_buf) {
+    return;
+  }
+
+  osl_memcpy(g_mqtt_obj->recv_buf + offset, message->payload,
+             message->payload_len);
+
+  if (offset + message->payload_len == total_len) {
+    g_mqtt_obj->recv_cb(topic, g_mqtt_obj->recv_buf, total_len);
+    SAFE_FREE(g_mqtt_obj->recv_buf);
+  }
 }
 
 static uint8_t *tm_topic_construct(const uint8_t *format, const uint8_t *pid,
@@ -133,9 +218,17 @@ void tm_mqtt_init(tm_mqtt_message_cb msg_cb) {
              g_mqtt_obj->mqtt_param.recv_buf_len);
 
   g_mqtt_obj->recv_cb = msg_cb;
+
+#if defined(CONFIG_NETWORK_TLS) && CONFIG_NETWORK_TLS == 1
+  /* every reconnect reuses the context and the CA parsed here */
+  tls_init(g_tm_cert, sizeof(g_tm_cert));
+#endif
 }
 
 void tm_mqtt_deinit(void) {
+#if defined(CONFIG_NETWORK_TLS) && CONFIG_NETWORK_TLS == 1
+  tls_deinit();
+#endif
   if (g_mqtt_obj) {
     SAFE_FREE(g_mqtt_obj->mqtt_param.send_buf);
     SAFE_FREE(g_mqtt_obj->mqtt_param.recv_buf);
@@ -146,15 +239,13 @@ void tm_mqtt_deinit(void) {
 
 int32_t tm_mqtt_login(const uint8_t *product_id, const uint8_t *dev_name,
                       const uint8_t *dev_token, uint32_t timeout_ms) {
-  handle_t cd_hdl = 0;
+  deadline_t deadline = deadline_start(timeout_ms);
   int32_t ret = ERR_OK;
 
   char clientid_buf[128] = {0};
   uint32_t offset = 0;
 
-  if (0 == (cd_hdl = countdown_start(timeout_ms))) {
-    return -1;
-  }
+  g_ping_rtt_ms = g_ping_srtt_ms = 0;
 
   offset += snprintf(clientid_buf + offset, sizeof(clientid_buf) - offset, "%s",
                      dev_name);
@@ -169,9 +260,19 @@ int32_t tm_mqtt_login(const uint8_t *product_id, const uint8_t *dev_name,
   g_mqtt_obj->mqtt_param.username = product_id;
   g_mqtt_obj->mqtt_param.password = dev_token;
 
-  g_mqtt_obj->mqtt_param.connect_flag = MQTT_CONNECT_FLAG_CLEAN_SESSION |
-                                        MQTT_CONNECT_FLAG_USERNAME |
-                                        MQTT_CONNECT_FLAG_PASSWORD;
+  g_mqtt_obj->mqtt_param.connect_flag =
+      MQTT_CONNECT_FLAG_USERNAME | MQTT_CONNECT_FLAG_PASSWORD;
+#if defined(CONFIG_TM_PERSISTENT_SESSION) && CONFIG_TM_PERSISTENT_SESSION == 1
+  /* the broker keeps the subscriptions while we are away, the outbox keeps
+   * whatever it has not acknowledged yet */
+  g_mqtt_obj->mqtt_param.outbox_name = (const uint8_t *)THING_MODEL_OUTBOX_NAME;
+#else
+  g_mqtt_obj->mqtt_param.connect_flag |= MQTT_CONNECT_FLAG_CLEAN_SESSION;
+#endif
+#if defined(CONFIG_TM_MQTT_V5) && CONFIG_TM_MQTT_V5 == 1
+  /* property posts reuse a handful of topics, aliases keep them off the wire */
+  g_mqtt_obj->mqtt_param.connect_flag |= MQTT_CONNECT_FLAG_PROTOCOL_V5;
+#endif
 
   g_mqtt_obj->subed_topic = tm_topic_construct(
       (const uint8_t *)THING_MODEL_SUBED_TOPIC, product_id, dev_name);
@@ -179,44 +280,61 @@ int32_t tm_mqtt_login(const uint8_t *product_id, const uint8_t *dev_name,
 #if defined(CONFIG_NETWORK_TLS) && CONFIG_NETWORK_TLS == 1
   g_mqtt_obj->client =
       mqtt_connect((const uint8_t *)IOT_MQTT_SERVER_ADDR_TLS,
-                   IOT_MQTT_SERVER_PORT_TLS, g_tm_cert, osl_strlen(g_tm_cert),
-                   &(g_mqtt_obj->mqtt_param), countdown_left(cd_hdl));
+                   IOT_MQTT_SERVER_PORT_TLS, g_tm_cert, sizeof(g_tm_cert),
+                   &(g_mqtt_obj->mqtt_param), deadline_left(deadline));
 
 #else
   g_mqtt_obj->client =
       mqtt_connect((const uint8_t *)IOT_MQTT_SERVER_ADDR, IOT_MQTT_SERVER_PORT,
-                   NULL, 0, &(g_mqtt_obj->mqtt_param), countdown_left(cd_hdl));
+                   NULL, 0, &(g_mqtt_obj->mqtt_param), deadline_left(deadline));
 #endif
 
   CHECK_EXPR_GOTO(NULL == g_mqtt_obj->client, exit, "mqtt connect failed!");
 
-  ret = mqtt_subscribe(g_mqtt_obj->client, g_mqtt_obj->subed_topic, MQTT_QOS0,
-                       tm_mqtt_message_arrived, NULL, countdown_left(cd_hdl));
+#if ENABLE_CARDMGR(CARDMGR_MSG_MODE_TOPIC)
+  if (NULL == g_mqtt_obj->cmp_topic) {
+    SAFE_ALLOC(g_mqtt_obj->cmp_topic, 64);
+  }
+  snprintf(g_mqtt_obj->cmp_topic, 64, "$sys/%s/%s/cmp/#", product_id,
+           dev_name);
+#endif
 
-  CHECK_EXPR_GOTO(ret != ERR_OK, exit, "mqtt subscribe failed!");
-  logd("subscribe %s success!", g_mqtt_obj->subed_topic);
+  /* a resumed session still holds the subscriptions, the messages only need
+   * somewhere to go */
+  if (g_mqtt_obj->mqtt_param.session_present) {
+    mqtt_set_default_chunk_handler(g_mqtt_obj->client, tm_mqtt_chunk_arrived,
+                                   NULL);
+    logd("session resumed, subscribe skipped");
 
-#if ENABLE_CARDMGR(CARDMGR_MSG_MODE_TOPIC)
+    return 0;
+  }
+
+  /* every topic goes out in one SUBSCRIBE and comes back in one SUBACK.
+   * Service calls and desired properties may outgrow the receive buffer, so
+   * the messages arrive in chunks */
   {
-    // 订阅
+    struct mqtt_subscription_t subs[] = {
+        {.topic = g_mqtt_obj->subed_topic,
+         .qos = MQTT_QOS0,
+         .chunk_handler = tm_mqtt_chunk_arrived},
+#if ENABLE_CARDMGR(CARDMGR_MSG_MODE_TOPIC)
+        {.topic = g_mqtt_obj->cmp_topic,
+         .qos = MQTT_QOS0,
+         .chunk_handler = tm_mqtt_chunk_arrived},
+#endif
+    };
 
-    SAFE_ALLOC(g_mqtt_obj->cmp_topic, 64);
-    snprintf(g_mqtt_obj->cmp_topic, 64, "$sys/%s/%s/cmp/#", product_id,
-             dev_name);
-    int ret =
-        mqtt_subscribe(g_mqtt_obj->client, g_mqtt_obj->cmp_topic, MQTT_QOS0,
-                       tm_mqtt_message_arrived, NULL, timeout_ms);
-    CHECK_EXPR_GOTO(ret != ERR_OK, exit, "mqtt subscribe %s failed!",
-                    g_mqtt_obj->cmp_topic);
-    logd("subscribe %s success!", g_mqtt_obj->cmp_topic);
+    ret = mqtt_subscribe_multi(g_mqtt_obj->client, subs,
+                               sizeof(subs) / sizeof(subs[0]),
+                               deadline_left(deadline));
+
+    CHECK_EXPR_GOTO(ret != ERR_OK, exit, "mqtt subscribe failed!");
+    logd("subscribe %s success!", g_mqtt_obj->subed_topic);
   }
 
-#endif
-  countdown_stop(cd_hdl);
   return 0;
 
 exit:
-  countdown_stop(cd_hdl);
   tm_mqtt_logout(timeout_ms);
   return -1;
 }
@@ -230,6 +348,8 @@ int32_t tm_mqtt_logout(uint32_t timeout_ms) {
     osl_free(g_mqtt_obj->subed_topic);
     g_mqtt_obj->subed_topic = NULL;
   }
+  SAFE_FREE(g_mqtt_obj->cmp_topic);
+  SAFE_FREE(g_mqtt_obj->recv_buf);
 
   return 0;
 }
@@ -239,13 +359,41 @@ int32_t tm_mqtt_send_packet(const uint8_t *topic, uint8_t *payload,
   struct mqtt_message_t msg;
 
   osl_memset(&msg, 0, sizeof(struct mqtt_message_t));
-  msg.qos = MQTT_QOS0;
   msg.payload = payload;
   msg.payload_len = payload_len;
 
+#if defined(CONFIG_TM_PERSISTENT_SESSION) && CONFIG_TM_PERSISTENT_SESSION == 1
+  /* stays in the outbox until acknowledged, replayed after a reconnect */
+  msg.qos = MQTT_QOS1;
+
+  return mqtt_publish_async(g_mqtt_obj->client, topic, &msg, NULL, NULL,
+                            timeout_ms);
+#else
+  msg.qos = MQTT_QOS0;
+
   return mqtt_publish(g_mqtt_obj->client, topic, &msg, timeout_ms);
+#endif
 }
 
 int32_t tm_mqtt_step(uint32_t timeout_ms) {
-  return mqtt_yield(g_mqtt_obj->client, timeout_ms);
+  int32_t ret = mqtt_yield(g_mqtt_obj->client, timeout_ms);
+
+  mqtt_get_ping_rtt(g_mqtt_obj->client, &g_ping_rtt_ms, &g_ping_srtt_ms);
+
+  return ret;
+}
+
+int32_t tm_mqtt_get_ping_rtt(uint32_t *rtt_ms, uint32_t *srtt_ms) {
+  if (0 == g_ping_srtt_ms) {
+    return ERR_UNINITIALIZED;
+  }
+
+  if (rtt_ms) {
+    *rtt_ms = g_ping_rtt_ms;
+  }
+  if (srtt_ms) {
+    *srtt_ms = g_ping_srtt_ms;
+  }
+
+  return ERR_OK;
 }
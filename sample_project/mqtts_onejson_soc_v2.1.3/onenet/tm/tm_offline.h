@@ -0,0 +1,94 @@
+/**
+ * Copyright (c), 2012~2024 iot.10086.cn All Rights Reserved
+ *
+ * @file tm_offline.h
+ * @brief Thing Model offline buffer, keeps property samples taken while the
+ *        device is offline and uploads them as history data after login
+ */
+
+#ifndef __TM_OFFLINE_H__
+#define __TM_OFFLINE_H__
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include "aiot_tm_api.h"
+#include "data_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+/* External Definition ( Constant and Macro )                                */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* External Structures, Enum and Typedefs                                    */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* External Variables and Functions                                          */
+/*****************************************************************************/
+/**
+ * @brief 缓存一组离线属性数据
+ *
+ * 数据先追加到内存中的当前段，段满后整段写入存储，存储满时丢弃最旧的段。
+ * I/O任务登录成功后会自动以历史数据的形式分批上报。
+ *
+ * @param prop_data 设备属性数据，无论成功与否都由本函数释放。
+ * @param timestamp_ms 采样时间（UTC 毫秒），属性自带时间戳时以属性的为准。
+ * @return 0表示成功，其他值表示失败
+ * @note 掉电时最多丢失当前段中尚未写入存储的数据，可调用 tm_offline_flush
+ *       提前写入。
+ */
+int32_t tm_offline_append(void *prop_data, uint64_t timestamp_ms);
+
+/**
+ * @brief 将当前段写入存储
+ *
+ * @return 0表示成功，其他值表示失败
+ */
+int32_t tm_offline_flush(void);
+
+/**
+ * @brief 查询缓存中是否还有未上报的数据
+ *
+ * @return 非0表示有数据
+ */
+int32_t tm_offline_pending(void);
+
+/**
+ * @brief 上报一批离线数据并等待平台回复，用于未启动I/O任务的场景
+ *
+ * @param product_id 产品 ID。
+ * @param dev_name 设备名称。
+ * @param timeout_ms 等待平台回复的超时时间（毫秒）。
+ * @return 0表示已上报一批或没有数据，其他值表示失败，数据保留到下次上报
+ */
+int32_t tm_offline_drain(const uint8_t *product_id, const uint8_t *dev_name,
+                         uint32_t timeout_ms);
+
+/**
+ * @brief 取出一批离线数据打包为历史数据，由I/O任务调用
+ *
+ * 同一时间只有一批数据在上报，上一批确认前返回NULL。
+ *
+ * @param product_id 产品 ID。
+ * @param dev_name 设备名称。
+ * @return 历史数据，没有数据或上一批尚未确认时返回NULL
+ */
+void *tm_offline_pack(const uint8_t *product_id, const uint8_t *dev_name);
+
+/**
+ * @brief 确认 tm_offline_pack 取出的一批数据的上报结果
+ *
+ * @param ret 0表示平台已确认，这批数据从存储中删除，其他值表示保留重传。
+ */
+void tm_offline_commit(int32_t ret);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -170,6 +170,49 @@ int32_t tm_onejson_pack_struct(void *data, const int8_t *name, void *val) {
   return set_value((cJSON *)data, name, (cJSON *)val);
 }
 
+int32_t tm_onejson_pack_history(void *history, void *props, int64_t ts_in_ms) {
+  cJSON *prop = NULL;
+
+  if (!cJSON_IsObject((cJSON *)history) || !cJSON_IsObject((cJSON *)props)) {
+    return ERR_INVALID_DATA;
+  }
+
+  // {"name":{"value":v,"time":t}} 追加为 {"name":[...,{"value":v,"time":t}]}
+  while (NULL != (prop = ((cJSON *)props)->child)) {
+    cJSON *samples = cJSON_GetObjectItem((cJSON *)history, prop->string);
+    cJSON *value = cJSON_DetachItemFromObject(prop, "value");
+    cJSON *time_item = cJSON_GetObjectItem(prop, "time");
+    cJSON *sample = NULL;
+
+    cJSON_DetachItemViaPointer((cJSON *)props, prop);
+
+    if (NULL != value) {
+      sample = cJSON_CreateObject();
+      cJSON_AddItemToObject(sample, "value", value);
+      cJSON_AddNumberToObject(
+          sample, "time",
+          cJSON_IsNumber(time_item) ? time_item->valuedouble : ts_in_ms);
+
+      if (NULL == samples) {
+        samples = cJSON_AddArrayToObject((cJSON *)history, prop->string);
+      }
+      cJSON_AddItemToArray(samples, sample);
+    }
+
+    cJSON_Delete(prop);
+  }
+
+  return ERR_OK;
+}
+
+uint8_t *tm_onejson_print(void *data) {
+  return (uint8_t *)cJSON_PrintUnformatted((cJSON *)data);
+}
+
+void *tm_onejson_parse(const uint8_t *str, uint32_t len) {
+  return (void *)cJSON_ParseWithLength((const char *)str, len);
+}
+
 int32_t tm_onejson_get_array_size(void *array) {
   return cJSON_GetArraySize((cJSON *)array);
 }
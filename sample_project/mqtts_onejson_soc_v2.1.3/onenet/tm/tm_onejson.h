@@ -48,6 +48,10 @@ int32_t tm_onejson_pack_float32(void *data, const int8_t *name, float32_t val);
 int32_t tm_onejson_pack_string(void *data, const int8_t *name, int8_t *val);
 int32_t tm_onejson_pack_struct(void *data, const int8_t *name, void *val);
 
+int32_t tm_onejson_pack_history(void *history, void *props, int64_t ts_in_ms);
+uint8_t *tm_onejson_print(void *data);
+void *   tm_onejson_parse(const uint8_t *str, uint32_t len);
+
 int32_t tm_onejson_get_array_size(void *array);
 void *  tm_onejson_get_array_element_by_index(void *data, uint32_t index);
 void *  tm_onejson_get_data_by_name(void *data, const int8_t *name);
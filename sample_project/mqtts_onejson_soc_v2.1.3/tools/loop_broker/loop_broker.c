@@ -0,0 +1,1195 @@
+/**
+ * Copyright (c), 2012~2024 iot.10086.cn All Rights Reserved
+ *
+ * @file loop_broker.c
+ * @brief Loopback MQTT 3.1.1 and 5.0 broker standing in for the OneNET platform
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include "loop_broker.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+/*****************************************************************************/
+/* Local Definitions ( Constant and Macro )                                  */
+/*****************************************************************************/
+#ifndef LOOP_BROKER_MAX_CLIENTS
+#define LOOP_BROKER_MAX_CLIENTS 8
+#endif
+
+#ifndef LOOP_BROKER_MAX_SUBS
+#define LOOP_BROKER_MAX_SUBS 16
+#endif
+
+/* Larger packets close the connection */
+#ifndef LOOP_BROKER_MAX_PACKET
+#define LOOP_BROKER_MAX_PACKET (1024 * 1024)
+#endif
+
+/* Longest time a send to a slow client may block the broker thread */
+#define LOOP_BROKER_SEND_TIMEOUT 1000
+
+#define MQTT_CONNECT 1
+#define MQTT_CONNACK 2
+#define MQTT_PUBLISH 3
+#define MQTT_PUBACK 4
+#define MQTT_PUBREC 5
+#define MQTT_PUBREL 6
+#define MQTT_PUBCOMP 7
+#define MQTT_SUBSCRIBE 8
+#define MQTT_SUBACK 9
+#define MQTT_UNSUBSCRIBE 10
+#define MQTT_UNSUBACK 11
+#define MQTT_PINGREQ 12
+#define MQTT_PINGRESP 13
+#define MQTT_DISCONNECT 14
+
+#define MQTT_PROPERTY_RECEIVE_MAXIMUM 0x21
+#define MQTT_PROPERTY_TOPIC_ALIAS_MAXIMUM 0x22
+#define MQTT_PROPERTY_TOPIC_ALIAS 0x23
+
+#define MQTT_REASON_NO_SUBSCRIPTION_EXISTED 0x11
+#define MQTT_REASON_PROTOCOL_ERROR 0x82
+#define MQTT_REASON_UNSUPPORTED_PROTOCOL_VERSION 0x84
+#define MQTT_REASON_TOPIC_ALIAS_INVALID 0x94
+
+#define SYS_PREFIX "$sys/"
+
+/*****************************************************************************/
+/* Structures, Enum and Typedefs                                             */
+/*****************************************************************************/
+struct lb_sub {
+  char *filter;
+  uint8_t qos;
+};
+
+struct lb_client {
+  int fd;
+  uint8_t connected; /* CONNECT accepted */
+  uint8_t closing;
+  uint8_t version; /* protocol level of the CONNECT, 4 or 5 */
+  uint16_t alias_max; /* Topic Alias Maximum announced to the client */
+  char *aliases[LOOP_BROKER_TOPIC_ALIAS_MAX]; /* entry i holds alias i + 1 */
+  uint8_t *rx_buf;
+  uint32_t rx_len;
+  uint32_t rx_size;
+  struct lb_sub subs[LOOP_BROKER_MAX_SUBS];
+  uint16_t next_id;
+  uint32_t publish_cnt;
+};
+
+/* Message waiting for its delivery time */
+struct lb_msg {
+  struct lb_msg *next;
+  uint64_t due_ms;
+  char *topic;
+  uint8_t *payload;
+  uint32_t payload_len;
+  uint8_t qos;
+};
+
+struct loop_broker {
+  struct loop_broker_config_t config;
+  uint16_t port;
+  int listen_fd;
+  int wake_fd[2];
+  pthread_t thread;
+  volatile int running;
+
+  /* touched by the broker thread only */
+  struct lb_client clients[LOOP_BROKER_MAX_CLIENTS];
+  uint32_t rand_state;
+
+  /* shared with the API, protected by lock */
+  pthread_mutex_t lock;
+  struct lb_msg *queue;
+  struct loop_broker_stats_t stats;
+  uint32_t next_msg_id;
+  uint8_t drop_clients;
+};
+
+/*****************************************************************************/
+/* Function Implementation                                                   */
+/*****************************************************************************/
+static uint64_t lb_now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void lb_wake(struct loop_broker *b) {
+  char c = 0;
+
+  (void)!write(b->wake_fd[1], &c, 1);
+}
+
+/* xorshift32, deterministic for a given seed */
+static uint32_t lb_rand(struct loop_broker *b) {
+  uint32_t x = b->rand_state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  b->rand_state = x;
+  return x;
+}
+
+static uint32_t lb_put_length(uint8_t *buf, uint32_t len) {
+  uint32_t i = 0;
+
+  do {
+    buf[i] = len % 128;
+    len /= 128;
+    if (len > 0) {
+      buf[i] |= 0x80;
+    }
+    i++;
+  } while (len > 0);
+  return i;
+}
+
+/* Variable byte integer at p, returns its size, 0 - malformed */
+static uint32_t lb_get_length(const uint8_t *p, uint32_t len,
+                              uint32_t *value) {
+  uint32_t i = 0, mul = 1;
+
+  *value = 0;
+  do {
+    if (i >= len || i >= 4) {
+      return 0;
+    }
+    *value += (p[i] & 0x7F) * mul;
+    mul *= 128;
+  } while (p[i++] & 0x80);
+  return i;
+}
+
+/* Size of the MQTT 5.0 property at p, 0 - unknown or truncated */
+static uint32_t lb_property_size(const uint8_t *p, uint32_t len) {
+  uint32_t size = 0, value = 0;
+
+  if (len < 1) {
+    return 0;
+  }
+  switch (p[0]) {
+    case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28:
+    case 0x29: case 0x2A:
+      size = 2;
+      break;
+    case 0x13: case 0x21: case 0x22: case 0x23:
+      size = 3;
+      break;
+    case 0x02: case 0x11: case 0x18: case 0x27:
+      size = 5;
+      break;
+    case 0x0B:
+      size = lb_get_length(p + 1, len - 1, &value);
+      size = size ? size + 1 : 0;
+      break;
+    case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16:
+    case 0x1A: case 0x1C: case 0x1F:
+      size = (len >= 3) ? 3 + ((p[1] << 8) | p[2]) : 0;
+      break;
+    case 0x26: /* user property, a pair of strings */
+      if (len >= 3 && (size = 3 + ((p[1] << 8) | p[2])) + 2 <= len) {
+        size += 2 + ((p[size] << 8) | p[size + 1]);
+      } else {
+        size = 0;
+      }
+      break;
+    default:
+      return 0;
+  }
+  return (size <= len) ? size : 0;
+}
+
+/* Skip the properties of an MQTT 5.0 packet at *pos, picking up the topic
+ * alias on the way. Returns 0, -1 - malformed */
+static int lb_read_properties(const uint8_t *p, uint32_t len, uint32_t *pos,
+                              uint16_t *topic_alias) {
+  uint32_t props_len = 0, end = 0, n = 0;
+
+  if (0 == (n = lb_get_length(p + *pos, len - *pos, &props_len)) ||
+      (end = *pos + n + props_len) > len) {
+    return -1;
+  }
+  for (*pos += n; *pos < end; *pos += n) {
+    if (0 == (n = lb_property_size(p + *pos, end - *pos))) {
+      return -1;
+    }
+    if (p[*pos] == MQTT_PROPERTY_TOPIC_ALIAS && topic_alias) {
+      *topic_alias = (p[*pos + 1] << 8) | p[*pos + 2];
+    }
+  }
+  return 0;
+}
+
+static void lb_free_msg(struct lb_msg *msg) {
+  free(msg->topic);
+  free(msg->payload);
+  free(msg);
+}
+
+/* Queue a message for delivery after the configured delay */
+static int32_t lb_enqueue(struct loop_broker *b, const char *topic,
+                          const uint8_t *payload, uint32_t payload_len,
+                          uint8_t qos) {
+  struct lb_msg *msg = calloc(1, sizeof(*msg));
+  struct lb_msg **tail = NULL;
+
+  if (NULL == msg || NULL == (msg->topic = strdup(topic)) ||
+      NULL == (msg->payload = malloc(payload_len ? payload_len : 1))) {
+    if (msg) {
+      lb_free_msg(msg);
+    }
+    return -1;
+  }
+  memcpy(msg->payload, payload, payload_len);
+  msg->payload_len = payload_len;
+  msg->qos = qos;
+
+  pthread_mutex_lock(&b->lock);
+  msg->due_ms = lb_now_ms() + b->config.delay_ms;
+  for (tail = &b->queue; *tail; tail = &(*tail)->next) {
+  }
+  *tail = msg;
+  pthread_mutex_unlock(&b->lock);
+
+  lb_wake(b);
+  return 0;
+}
+
+/* Blocking send of a whole packet, a client that cannot keep up is closed */
+static void lb_send(struct loop_broker *b, struct lb_client *c,
+                    const uint8_t *buf, uint32_t len) {
+  uint32_t sent = 0;
+  int ret = 0;
+
+  while (!c->closing && sent < len) {
+    ret = send(c->fd, buf + sent, len - sent, MSG_NOSIGNAL);
+    if (ret > 0) {
+      sent += ret;
+    } else if (ret < 0 && errno == EINTR) {
+      continue;
+    } else if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      struct pollfd pfd = {.fd = c->fd, .events = POLLOUT};
+
+      if (poll(&pfd, 1, LOOP_BROKER_SEND_TIMEOUT) <= 0) {
+        c->closing = 1;
+      }
+    } else {
+      c->closing = 1;
+    }
+  }
+
+  pthread_mutex_lock(&b->lock);
+  b->stats.bytes_out += sent;
+  pthread_mutex_unlock(&b->lock);
+}
+
+/* reason is MQTT 5.0 only, a success code is left out of the packet */
+static void lb_send_ack(struct loop_broker *b, struct lb_client *c,
+                        uint8_t type, uint16_t id, uint8_t reason) {
+  uint8_t buf[5] = {(uint8_t)(type << 4), 2, (uint8_t)(id >> 8), (uint8_t)id,
+                    reason};
+
+  if (type == MQTT_PUBREL) {
+    buf[0] |= 0x02;
+  }
+  if (reason) {
+    buf[1] = 3;
+  }
+  lb_send(b, c, buf, 2 + buf[1]);
+}
+
+/* MQTT 5.0 server side DISCONNECT, then close */
+static void lb_send_disconnect(struct loop_broker *b, struct lb_client *c,
+                               uint8_t reason) {
+  uint8_t buf[3] = {MQTT_DISCONNECT << 4, 1, reason};
+
+  if (b->config.verbose) {
+    fprintf(stderr, "[loop_broker] -> DISCONNECT 0x%02x\n", reason);
+  }
+  lb_send(b, c, buf, sizeof(buf));
+  c->closing = 1;
+}
+
+static void lb_send_publish(struct loop_broker *b, struct lb_client *c,
+                            const struct lb_msg *msg, uint8_t qos) {
+  uint32_t topic_len = strlen(msg->topic);
+  uint32_t rem_len = 2 + topic_len + (qos ? 2 : 0) +
+                     (c->version == 5 ? 1 : 0) + msg->payload_len;
+  uint8_t *buf = malloc(5 + rem_len);
+  uint32_t pos = 0;
+
+  if (NULL == buf) {
+    return;
+  }
+  buf[pos++] = (MQTT_PUBLISH << 4) | (qos << 1);
+  pos += lb_put_length(buf + pos, rem_len);
+  buf[pos++] = topic_len >> 8;
+  buf[pos++] = topic_len & 0xFF;
+  memcpy(buf + pos, msg->topic, topic_len);
+  pos += topic_len;
+  if (qos) {
+    if (0 == ++c->next_id) {
+      c->next_id = 1;
+    }
+    buf[pos++] = c->next_id >> 8;
+    buf[pos++] = c->next_id & 0xFF;
+  }
+  if (c->version == 5) {
+    buf[pos++] = 0; /* no properties */
+  }
+  memcpy(buf + pos, msg->payload, msg->payload_len);
+  pos += msg->payload_len;
+
+  if (b->config.verbose) {
+    fprintf(stderr, "[loop_broker] -> PUBLISH %s (%u bytes)\n", msg->topic,
+            (unsigned)msg->payload_len);
+  }
+  lb_send(b, c, buf, pos);
+  free(buf);
+
+  pthread_mutex_lock(&b->lock);
+  b->stats.publish_out++;
+  pthread_mutex_unlock(&b->lock);
+}
+
+/* MQTT 3.1.1 topic filter matching with + and # wildcards */
+static int lb_topic_match(const char *filter, const char *topic) {
+  while (*filter && *topic) {
+    if (*filter == '#') {
+      return 1;
+    } else if (*filter == '+') {
+      while (*topic && *topic != '/') {
+        topic++;
+      }
+      filter++;
+    } else if (*filter++ != *topic++) {
+      return 0;
+    }
+  }
+  /* "a/#" also matches "a" */
+  if (*topic == '\0' && (strcmp(filter, "/#") == 0 || strcmp(filter, "#") == 0)) {
+    return 1;
+  }
+  return *filter == '\0' && *topic == '\0';
+}
+
+static void lb_route(struct loop_broker *b, const struct lb_msg *msg) {
+  for (int i = 0; i < LOOP_BROKER_MAX_CLIENTS; i++) {
+    struct lb_client *c = &b->clients[i];
+    int qos = -1;
+
+    if (c->fd < 0 || !c->connected || c->closing) {
+      continue;
+    }
+    for (int j = 0; j < LOOP_BROKER_MAX_SUBS; j++) {
+      if (c->subs[j].filter && c->subs[j].qos > qos &&
+          lb_topic_match(c->subs[j].filter, msg->topic)) {
+        qos = c->subs[j].qos;
+      }
+    }
+    if (qos >= 0) {
+      lb_send_publish(b, c, msg, (qos < msg->qos) ? qos : msg->qos);
+    }
+  }
+}
+
+/* Copy the "id" string of a OneJSON payload */
+static void lb_json_id(const uint8_t *payload, uint32_t len, char *id,
+                       uint32_t size) {
+  const char *p = NULL;
+  const char *end = (const char *)payload + len;
+  uint32_t n = 0;
+
+  id[0] = '\0';
+  for (p = (const char *)payload; p + 4 <= end; p++) {
+    if (memcmp(p, "\"id\"", 4) == 0) {
+      break;
+    }
+  }
+  if (p + 4 > end) {
+    return;
+  }
+  for (p += 4; p < end && (*p == ' ' || *p == ':'); p++) {
+  }
+  if (p >= end || *p++ != '"') {
+    return;
+  }
+  while (p < end && *p != '"' && n + 1 < size) {
+    id[n++] = *p++;
+  }
+  id[n] = '\0';
+}
+
+static int lb_ends_with(const char *s, const char *suffix) {
+  size_t len = strlen(s), suffix_len = strlen(suffix);
+
+  return len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0;
+}
+
+/* Answer a device message on $sys/{pid}/{dev}/... the way the platform does,
+ * replies and downlink requests coming back from the device are not answered */
+static void lb_auto_reply(struct loop_broker *b, const char *topic,
+                          const uint8_t *payload, uint32_t payload_len) {
+  char reply_topic[256];
+  char reply[128];
+  char id[33];
+  int len = 0;
+
+  if (strncmp(topic, SYS_PREFIX, strlen(SYS_PREFIX)) != 0 ||
+      lb_ends_with(topic, "reply") || lb_ends_with(topic, "/property/set") ||
+      lb_ends_with(topic, "/property/get") || lb_ends_with(topic, "/invoke")) {
+    return;
+  }
+  if (snprintf(reply_topic, sizeof(reply_topic), "%s/reply", topic) >=
+      (int)sizeof(reply_topic)) {
+    return;
+  }
+
+  lb_json_id(payload, payload_len, id, sizeof(id));
+  if (lb_ends_with(topic, "/property/desired/get")) {
+    len = snprintf(reply, sizeof(reply),
+                   "{\"id\":\"%s\",\"code\":200,\"msg\":\"success\",\"data\":{}}",
+                   id);
+  } else {
+    len = snprintf(reply, sizeof(reply),
+                   "{\"id\":\"%s\",\"code\":200,\"msg\":\"success\"}", id);
+  }
+
+  if (0 == lb_enqueue(b, reply_topic, (const uint8_t *)reply, len, 0)) {
+    pthread_mutex_lock(&b->lock);
+    b->stats.replies++;
+    pthread_mutex_unlock(&b->lock);
+  }
+}
+
+/* CONNACK of an MQTT 5.0 connection, with the limits of the config */
+static void lb_send_connack_v5(struct loop_broker *b, struct lb_client *c,
+                               uint8_t reason, uint16_t receive_max) {
+  uint8_t connack[12] = {MQTT_CONNACK << 4, 3, 0, reason, 0};
+  uint32_t pos = 5;
+
+  if (reason < 0x80 && receive_max) {
+    connack[pos++] = MQTT_PROPERTY_RECEIVE_MAXIMUM;
+    connack[pos++] = receive_max >> 8;
+    connack[pos++] = receive_max & 0xFF;
+  }
+  if (reason < 0x80 && c->alias_max) {
+    connack[pos++] = MQTT_PROPERTY_TOPIC_ALIAS_MAXIMUM;
+    connack[pos++] = c->alias_max >> 8;
+    connack[pos++] = c->alias_max & 0xFF;
+  }
+  connack[1] = pos - 2;
+  connack[4] = pos - 5;
+  lb_send(b, c, connack, pos);
+}
+
+static void lb_handle_connect(struct loop_broker *b, struct lb_client *c,
+                              const uint8_t *p, uint32_t len) {
+  uint8_t connack[4] = {MQTT_CONNACK << 4, 2, 0, 0};
+  uint8_t reason = 0;
+  uint16_t receive_max = 0;
+
+  /* protocol name "MQTT" and level 4 or 5 */
+  if (len < 10 || p[0] != 0 || p[1] != 4 || memcmp(p + 2, "MQTT", 4) != 0 ||
+      (p[6] != 4 && p[6] != 5)) {
+    connack[3] = 0x01;
+    if (len >= 7 && p[6] == 5) {
+      connack[3] = MQTT_REASON_UNSUPPORTED_PROTOCOL_VERSION;
+    }
+    lb_send(b, c, connack, sizeof(connack));
+    c->closing = 1;
+    return;
+  }
+  c->version = p[6];
+
+  if (c->version == 5) {
+    pthread_mutex_lock(&b->lock);
+    reason = b->config.connack_reason;
+    receive_max = b->config.receive_max;
+    c->alias_max = (b->config.topic_alias_max < LOOP_BROKER_TOPIC_ALIAS_MAX)
+                       ? b->config.topic_alias_max
+                       : LOOP_BROKER_TOPIC_ALIAS_MAX;
+    pthread_mutex_unlock(&b->lock);
+
+    lb_send_connack_v5(b, c, reason, receive_max);
+    if (reason >= 0x80) {
+      c->closing = 1;
+      return;
+    }
+  } else {
+    lb_send(b, c, connack, sizeof(connack));
+  }
+  c->connected = 1;
+
+  pthread_mutex_lock(&b->lock);
+  b->stats.connects++;
+  if (c->version == 5) {
+    b->stats.connects_v5++;
+  }
+  pthread_mutex_unlock(&b->lock);
+}
+
+/* Topic of an MQTT 5.0 PUBLISH, binding or resolving its topic alias. NULL
+ * with the connection closed when the alias is not valid */
+static char *lb_publish_topic_v5(struct loop_broker *b, struct lb_client *c,
+                                 const uint8_t *p, uint32_t topic_len,
+                                 uint16_t alias, int *alias_hit) {
+  char *topic = NULL;
+
+  *alias_hit = 0;
+  if (0 == alias) {
+    if (0 == topic_len) {
+      lb_send_disconnect(b, c, MQTT_REASON_PROTOCOL_ERROR);
+      return NULL;
+    }
+    return strndup((const char *)p + 2, topic_len);
+  }
+  if (alias > c->alias_max) {
+    lb_send_disconnect(b, c, MQTT_REASON_TOPIC_ALIAS_INVALID);
+    return NULL;
+  }
+
+  if (topic_len > 0) {
+    /* a topic sent with an alias binds it, also over an older binding */
+    if (NULL == (topic = strndup((const char *)p + 2, topic_len))) {
+      return NULL;
+    }
+    free(c->aliases[alias - 1]);
+    c->aliases[alias - 1] = strdup(topic);
+    return topic;
+  }
+
+  if (NULL == c->aliases[alias - 1]) {
+    lb_send_disconnect(b, c, MQTT_REASON_PROTOCOL_ERROR);
+    return NULL;
+  }
+  *alias_hit = 1;
+  return strdup(c->aliases[alias - 1]);
+}
+
+static void lb_handle_publish(struct loop_broker *b, struct lb_client *c,
+                              uint8_t flags, const uint8_t *p, uint32_t len) {
+  uint8_t qos = (flags >> 1) & 0x03;
+  uint32_t topic_len = 0, pos = 0;
+  uint16_t id = 0, alias = 0;
+  uint32_t loss = 0, disconnect_after = 0;
+  uint8_t puback_reason = 0;
+  char *topic = NULL;
+  int drop = 0, alias_hit = 0;
+
+  if (len < 2 || (topic_len = (p[0] << 8) | p[1]) + 2 + (qos ? 2 : 0) > len) {
+    c->closing = 1;
+    return;
+  }
+  pos = 2 + topic_len;
+  if (qos) {
+    id = (p[pos] << 8) | p[pos + 1];
+    pos += 2;
+  }
+
+  if (c->version == 5) {
+    if (lb_read_properties(p, len, &pos, &alias) != 0) {
+      lb_send_disconnect(b, c, MQTT_REASON_PROTOCOL_ERROR);
+      return;
+    }
+    topic = lb_publish_topic_v5(b, c, p, topic_len, alias, &alias_hit);
+  } else {
+    topic = strndup((const char *)p + 2, topic_len);
+  }
+  if (NULL == topic) {
+    return;
+  }
+
+  pthread_mutex_lock(&b->lock);
+  loss = b->config.loss_percent;
+  disconnect_after = b->config.disconnect_after;
+  puback_reason = (c->version == 5) ? b->config.puback_reason : 0;
+  b->stats.publish_in++;
+  if (alias_hit) {
+    b->stats.alias_hits++;
+  }
+  drop = loss > 0 && (lb_rand(b) % 100) < loss;
+  if (drop) {
+    b->stats.dropped++;
+  }
+  pthread_mutex_unlock(&b->lock);
+
+  if (b->config.verbose) {
+    fprintf(stderr, "[loop_broker] <- PUBLISH %s (%u bytes)%s%s\n", topic,
+            (unsigned)(len - pos), alias ? " aliased" : "",
+            drop ? " dropped" : "");
+  }
+
+  if (!drop) {
+    if (qos == 1) {
+      lb_send_ack(b, c, MQTT_PUBACK, id, puback_reason);
+    } else if (qos == 2) {
+      lb_send_ack(b, c, MQTT_PUBREC, id, 0);
+    }
+
+    if (b->config.on_publish) {
+      b->config.on_publish(b->config.arg, topic, p + pos, len - pos);
+    }
+
+    if (strncmp(topic, SYS_PREFIX, strlen(SYS_PREFIX)) == 0) {
+      /* system topics go to the platform, never to other subscribers */
+      if (b->config.auto_reply) {
+        lb_auto_reply(b, topic, p + pos, len - pos);
+      }
+    } else {
+      lb_enqueue(b, topic, p + pos, len - pos, qos ? 1 : 0);
+    }
+  }
+  free(topic);
+
+  if (disconnect_after && ++c->publish_cnt % disconnect_after == 0) {
+    c->closing = 1;
+  }
+}
+
+static void lb_handle_subscribe(struct loop_broker *b, struct lb_client *c,
+                                const uint8_t *p, uint32_t len) {
+  uint8_t suback[5 + 3 + LOOP_BROKER_MAX_SUBS];
+  uint8_t codes[LOOP_BROKER_MAX_SUBS];
+  uint32_t cnt = 0, pos = 2, hdr = 0;
+
+  if (len < 2 ||
+      (c->version == 5 && lb_read_properties(p, len, &pos, NULL) != 0)) {
+    c->closing = 1;
+    return;
+  }
+
+  while (pos + 2 < len && cnt < LOOP_BROKER_MAX_SUBS) {
+    uint32_t filter_len = (p[pos] << 8) | p[pos + 1];
+    uint8_t qos = 0;
+    char *filter = NULL;
+    int slot = -1;
+
+    if (pos + 2 + filter_len + 1 > len) {
+      c->closing = 1;
+      return;
+    }
+    filter = strndup((const char *)p + pos + 2, filter_len);
+    qos = p[pos + 2 + filter_len] & 0x03;
+    pos += 2 + filter_len + 1;
+
+    /* a filter subscribed again replaces the old one */
+    for (int i = 0; i < LOOP_BROKER_MAX_SUBS && filter; i++) {
+      if (c->subs[i].filter && strcmp(c->subs[i].filter, filter) == 0) {
+        free(c->subs[i].filter);
+        c->subs[i].filter = NULL;
+        slot = i;
+        break;
+      } else if (slot < 0 && NULL == c->subs[i].filter) {
+        slot = i;
+      }
+    }
+    if (filter && slot >= 0) {
+      c->subs[slot].filter = filter;
+      c->subs[slot].qos = (qos > 1) ? 1 : qos;
+      codes[cnt++] = c->subs[slot].qos;
+    } else {
+      free(filter);
+      codes[cnt++] = 0x80;
+    }
+    if (b->config.verbose) {
+      fprintf(stderr, "[loop_broker] <- SUBSCRIBE %.*s\n", (int)filter_len,
+              (const char *)p + pos - 1 - filter_len);
+    }
+  }
+
+  suback[hdr++] = MQTT_SUBACK << 4;
+  hdr += lb_put_length(suback + hdr, 2 + (c->version == 5 ? 1 : 0) + cnt);
+  suback[hdr++] = p[0];
+  suback[hdr++] = p[1];
+  if (c->version == 5) {
+    suback[hdr++] = 0; /* no properties */
+  }
+  memcpy(suback + hdr, codes, cnt);
+  lb_send(b, c, suback, hdr + cnt);
+}
+
+static void lb_handle_unsubscribe(struct loop_broker *b, struct lb_client *c,
+                                  const uint8_t *p, uint32_t len) {
+  /* MQTT 5.0 answers every filter with a reason code */
+  uint8_t unsuback[5 + 3 + LOOP_BROKER_MAX_SUBS];
+  uint8_t codes[LOOP_BROKER_MAX_SUBS];
+  uint32_t cnt = 0, pos = 2, hdr = 0;
+
+  if (len < 2 ||
+      (c->version == 5 && lb_read_properties(p, len, &pos, NULL) != 0)) {
+    c->closing = 1;
+    return;
+  }
+
+  while (pos + 2 <= len) {
+    uint32_t filter_len = (p[pos] << 8) | p[pos + 1];
+    uint8_t code = MQTT_REASON_NO_SUBSCRIPTION_EXISTED;
+
+    if (pos + 2 + filter_len > len) {
+      break;
+    }
+    for (int i = 0; i < LOOP_BROKER_MAX_SUBS; i++) {
+      if (c->subs[i].filter && strlen(c->subs[i].filter) == filter_len &&
+          memcmp(c->subs[i].filter, p + pos + 2, filter_len) == 0) {
+        free(c->subs[i].filter);
+        c->subs[i].filter = NULL;
+        code = 0;
+      }
+    }
+    if (cnt < LOOP_BROKER_MAX_SUBS) {
+      codes[cnt++] = code;
+    }
+    pos += 2 + filter_len;
+  }
+
+  if (c->version != 5) {
+    lb_send_ack(b, c, MQTT_UNSUBACK, (p[0] << 8) | p[1], 0);
+    return;
+  }
+  unsuback[hdr++] = MQTT_UNSUBACK << 4;
+  hdr += lb_put_length(unsuback + hdr, 3 + cnt);
+  unsuback[hdr++] = p[0];
+  unsuback[hdr++] = p[1];
+  unsuback[hdr++] = 0; /* no properties */
+  memcpy(unsuback + hdr, codes, cnt);
+  lb_send(b, c, unsuback, hdr + cnt);
+}
+
+static void lb_handle_packet(struct loop_broker *b, struct lb_client *c,
+                             uint8_t header, const uint8_t *p, uint32_t len) {
+  uint8_t type = header >> 4;
+
+  if (!c->connected && type != MQTT_CONNECT) {
+    c->closing = 1;
+    return;
+  }
+
+  switch (type) {
+    case MQTT_CONNECT:
+      lb_handle_connect(b, c, p, len);
+      break;
+    case MQTT_PUBLISH:
+      lb_handle_publish(b, c, header & 0x0F, p, len);
+      break;
+    case MQTT_PUBREL:
+      if (len >= 2) {
+        lb_send_ack(b, c, MQTT_PUBCOMP, (p[0] << 8) | p[1], 0);
+      }
+      break;
+    case MQTT_PUBREC:
+      if (len >= 2) {
+        lb_send_ack(b, c, MQTT_PUBREL, (p[0] << 8) | p[1], 0);
+      }
+      break;
+    case MQTT_SUBSCRIBE:
+      lb_handle_subscribe(b, c, p, len);
+      break;
+    case MQTT_UNSUBSCRIBE:
+      lb_handle_unsubscribe(b, c, p, len);
+      break;
+    case MQTT_PINGREQ: {
+      uint8_t resp[2] = {MQTT_PINGRESP << 4, 0};
+
+      lb_send(b, c, resp, sizeof(resp));
+      break;
+    }
+    case MQTT_DISCONNECT:
+      c->closing = 1;
+      break;
+    default:
+      /* PUBACK and PUBCOMP for messages sent to the client need no action */
+      break;
+  }
+}
+
+/* Handle every complete packet in the receive buffer */
+static void lb_parse(struct loop_broker *b, struct lb_client *c) {
+  uint32_t pos = 0;
+
+  while (!c->closing && c->rx_len - pos >= 2) {
+    uint32_t rem_len = 0, mul = 1, i = 1;
+
+    do {
+      if (pos + i >= c->rx_len) {
+        goto _MORE;
+      }
+      rem_len += (c->rx_buf[pos + i] & 0x7F) * mul;
+      mul *= 128;
+    } while ((c->rx_buf[pos + i++] & 0x80) && i <= 4);
+
+    if (rem_len > LOOP_BROKER_MAX_PACKET || i > 5) {
+      c->closing = 1;
+      break;
+    }
+    if (c->rx_len - pos - i < rem_len) {
+      break;
+    }
+    lb_handle_packet(b, c, c->rx_buf[pos], c->rx_buf + pos + i, rem_len);
+    pos += i + rem_len;
+  }
+
+_MORE:
+  memmove(c->rx_buf, c->rx_buf + pos, c->rx_len - pos);
+  c->rx_len -= pos;
+}
+
+static void lb_read(struct loop_broker *b, struct lb_client *c) {
+  int ret = 0;
+
+  if (c->rx_size - c->rx_len < 1024) {
+    uint32_t size = c->rx_size ? c->rx_size * 2 : 4096;
+    uint8_t *buf = NULL;
+
+    if (size > LOOP_BROKER_MAX_PACKET + 8 ||
+        NULL == (buf = realloc(c->rx_buf, size))) {
+      c->closing = 1;
+      return;
+    }
+    c->rx_buf = buf;
+    c->rx_size = size;
+  }
+
+  ret = recv(c->fd, c->rx_buf + c->rx_len, c->rx_size - c->rx_len, MSG_DONTWAIT);
+  if (ret > 0) {
+    c->rx_len += ret;
+    pthread_mutex_lock(&b->lock);
+    b->stats.bytes_in += ret;
+    pthread_mutex_unlock(&b->lock);
+    lb_parse(b, c);
+  } else if (ret == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+    c->closing = 1;
+  }
+}
+
+static void lb_close_client(struct loop_broker *b, struct lb_client *c) {
+  if (b->config.verbose) {
+    fprintf(stderr, "[loop_broker] connection %d closed\n", c->fd);
+  }
+  close(c->fd);
+  free(c->rx_buf);
+  for (int i = 0; i < LOOP_BROKER_MAX_SUBS; i++) {
+    free(c->subs[i].filter);
+  }
+  for (int i = 0; i < LOOP_BROKER_TOPIC_ALIAS_MAX; i++) {
+    free(c->aliases[i]);
+  }
+  memset(c, 0, sizeof(*c));
+  c->fd = -1;
+
+  pthread_mutex_lock(&b->lock);
+  b->stats.disconnects++;
+  pthread_mutex_unlock(&b->lock);
+}
+
+static void lb_accept(struct loop_broker *b) {
+  int fd = accept(b->listen_fd, NULL, NULL);
+  int on = 1;
+
+  if (fd < 0) {
+    return;
+  }
+  for (int i = 0; i < LOOP_BROKER_MAX_CLIENTS; i++) {
+    if (b->clients[i].fd < 0) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+      /* replies are small, do not let Nagle hold them back */
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+      b->clients[i].fd = fd;
+      return;
+    }
+  }
+  close(fd);
+}
+
+/* Take the messages whose delivery time has come, returns ms to the next */
+static int lb_take_due(struct loop_broker *b, struct lb_msg **due) {
+  struct lb_msg **pp = &b->queue, **tail = due;
+  uint64_t now = lb_now_ms();
+  int wait_ms = 100;
+
+  pthread_mutex_lock(&b->lock);
+  while (*pp) {
+    struct lb_msg *msg = *pp;
+
+    if (msg->due_ms <= now) {
+      *pp = msg->next;
+      msg->next = NULL;
+      *tail = msg;
+      tail = &msg->next;
+    } else {
+      if (msg->due_ms - now < (uint64_t)wait_ms) {
+        wait_ms = (int)(msg->due_ms - now);
+      }
+      pp = &msg->next;
+    }
+  }
+  pthread_mutex_unlock(&b->lock);
+
+  return wait_ms;
+}
+
+static void *lb_main(void *arg) {
+  struct loop_broker *b = arg;
+  struct pollfd pfds[2 + LOOP_BROKER_MAX_CLIENTS];
+  struct lb_client *owners[2 + LOOP_BROKER_MAX_CLIENTS];
+
+  while (b->running) {
+    struct lb_msg *due = NULL;
+    int wait_ms = lb_take_due(b, &due);
+    int n = 0;
+
+    while (due) {
+      struct lb_msg *msg = due;
+
+      due = msg->next;
+      lb_route(b, msg);
+      lb_free_msg(msg);
+    }
+
+    pthread_mutex_lock(&b->lock);
+    if (b->drop_clients) {
+      b->drop_clients = 0;
+      for (int i = 0; i < LOOP_BROKER_MAX_CLIENTS; i++) {
+        if (b->clients[i].fd >= 0) {
+          b->clients[i].closing = 1;
+        }
+      }
+    }
+    pthread_mutex_unlock(&b->lock);
+
+    for (int i = 0; i < LOOP_BROKER_MAX_CLIENTS; i++) {
+      if (b->clients[i].fd >= 0 && b->clients[i].closing) {
+        lb_close_client(b, &b->clients[i]);
+      }
+    }
+
+    pfds[n].fd = b->wake_fd[0];
+    pfds[n].events = POLLIN;
+    owners[n++] = NULL;
+    pfds[n].fd = b->listen_fd;
+    pfds[n].events = POLLIN;
+    owners[n++] = NULL;
+    for (int i = 0; i < LOOP_BROKER_MAX_CLIENTS; i++) {
+      if (b->clients[i].fd >= 0) {
+        pfds[n].fd = b->clients[i].fd;
+        pfds[n].events = POLLIN;
+        owners[n++] = &b->clients[i];
+      }
+    }
+
+    if (poll(pfds, n, wait_ms) <= 0) {
+      continue;
+    }
+
+    if (pfds[0].revents) {
+      char drain[64];
+
+      while (read(b->wake_fd[0], drain, sizeof(drain)) > 0) {
+      }
+    }
+    if (pfds[1].revents & POLLIN) {
+      lb_accept(b);
+    }
+    for (int i = 2; i < n; i++) {
+      if (pfds[i].revents) {
+        lb_read(b, owners[i]);
+      }
+    }
+  }
+
+  return NULL;
+}
+
+struct loop_broker *loop_broker_start(
+    const struct loop_broker_config_t *config) {
+  struct loop_broker *b = calloc(1, sizeof(*b));
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+  int on = 1;
+
+  if (NULL == b) {
+    return NULL;
+  }
+  b->config = *config;
+  b->rand_state = config->seed ? config->seed : 1;
+  b->listen_fd = -1;
+  b->wake_fd[0] = b->wake_fd[1] = -1;
+  for (int i = 0; i < LOOP_BROKER_MAX_CLIENTS; i++) {
+    b->clients[i].fd = -1;
+  }
+  pthread_mutex_init(&b->lock, NULL);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(config->port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if (pipe(b->wake_fd) < 0 ||
+      (b->listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
+    goto _ERROR;
+  }
+  fcntl(b->wake_fd[0], F_SETFL, O_NONBLOCK);
+  fcntl(b->wake_fd[1], F_SETFL, O_NONBLOCK);
+  setsockopt(b->listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  if (bind(b->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(b->listen_fd, LOOP_BROKER_MAX_CLIENTS) < 0 ||
+      getsockname(b->listen_fd, (struct sockaddr *)&addr, &addr_len) < 0) {
+    fprintf(stderr, "[loop_broker] listen on port %u failed: errno %d\n",
+            (unsigned)config->port, errno);
+    goto _ERROR;
+  }
+  b->port = ntohs(addr.sin_port);
+
+  b->running = 1;
+  if (pthread_create(&b->thread, NULL, lb_main, b) != 0) {
+    goto _ERROR;
+  }
+  return b;
+
+_ERROR:
+  if (b->listen_fd >= 0) {
+    close(b->listen_fd);
+  }
+  if (b->wake_fd[0] >= 0) {
+    close(b->wake_fd[0]);
+    close(b->wake_fd[1]);
+  }
+  pthread_mutex_destroy(&b->lock);
+  free(b);
+  return NULL;
+}
+
+void loop_broker_stop(struct loop_broker *broker) {
+  struct lb_msg *msg = NULL;
+
+  if (NULL == broker) {
+    return;
+  }
+  broker->running = 0;
+  lb_wake(broker);
+  pthread_join(broker->thread, NULL);
+
+  for (int i = 0; i < LOOP_BROKER_MAX_CLIENTS; i++) {
+    if (broker->clients[i].fd >= 0) {
+      lb_close_client(broker, &broker->clients[i]);
+    }
+  }
+  while (NULL != (msg = broker->queue)) {
+    broker->queue = msg->next;
+    lb_free_msg(msg);
+  }
+  close(broker->listen_fd);
+  close(broker->wake_fd[0]);
+  close(broker->wake_fd[1]);
+  pthread_mutex_destroy(&broker->lock);
+  free(broker);
+}
+
+uint16_t loop_broker_port(struct loop_broker *broker) {
+  return broker->port;
+}
+
+void loop_broker_set_faults(struct loop_broker *broker, uint32_t delay_ms,
+                            uint32_t loss_percent, uint32_t disconnect_after) {
+  pthread_mutex_lock(&broker->lock);
+  broker->config.delay_ms = delay_ms;
+  broker->config.loss_percent = loss_percent;
+  broker->config.disconnect_after = disconnect_after;
+  pthread_mutex_unlock(&broker->lock);
+}
+
+void loop_broker_set_reason_codes(struct loop_broker *broker,
+                                  uint8_t connack_reason,
+                                  uint8_t puback_reason) {
+  pthread_mutex_lock(&broker->lock);
+  broker->config.connack_reason = connack_reason;
+  broker->config.puback_reason = puback_reason;
+  pthread_mutex_unlock(&broker->lock);
+}
+
+int32_t loop_broker_publish(struct loop_broker *broker, const char *topic,
+                            const uint8_t *payload, uint32_t payload_len,
+                            uint8_t qos) {
+  return lb_enqueue(broker, topic, payload, payload_len, qos ? 1 : 0);
+}
+
+/* Send a OneJSON request {"id","version","params"} to a device topic */
+static int32_t lb_request(struct loop_broker *b, const char *topic,
+                          const char *params) {
+  char *payload = NULL;
+  int32_t id = 0;
+  int len = 0;
+
+  pthread_mutex_lock(&b->lock);
+  id = (int32_t)(++b->next_msg_id & 0x7FFFFFFF);
+  pthread_mutex_unlock(&b->lock);
+
+  len = snprintf(NULL, 0, "{\"id\":\"%d\",\"version\":\"1.0\",\"params\":%s}",
+                 (int)id, params);
+  if (NULL == (payload = malloc(len + 1))) {
+    return -1;
+  }
+  snprintf(payload, len + 1, "{\"id\":\"%d\",\"version\":\"1.0\",\"params\":%s}",
+           (int)id, params);
+
+  if (lb_enqueue(b, topic, (const uint8_t *)payload, len, 0) < 0) {
+    id = -1;
+  }
+  free(payload);
+  return id;
+}
+
+int32_t loop_broker_property_set(struct loop_broker *broker,
+                                 const char *product_id, const char *dev_name,
+                                 const char *params) {
+  char topic[256];
+
+  snprintf(topic, sizeof(topic), SYS_PREFIX "%s/%s/thing/property/set",
+           product_id, dev_name);
+  return lb_request(broker, topic, params);
+}
+
+int32_t loop_broker_service_invoke(struct loop_broker *broker,
+                                   const char *product_id,
+                                   const char *dev_name,
+                                   const char *identifier, const char *params) {
+  char topic[256];
+
+  snprintf(topic, sizeof(topic), SYS_PREFIX "%s/%s/thing/service/%s/invoke",
+           product_id, dev_name, identifier);
+  return lb_request(broker, topic, params);
+}
+
+void loop_broker_drop_clients(struct loop_broker *broker) {
+  pthread_mutex_lock(&broker->lock);
+  broker->drop_clients = 1;
+  pthread_mutex_unlock(&broker->lock);
+  lb_wake(broker);
+}
+
+void loop_broker_get_stats(struct loop_broker *broker,
+                           struct loop_broker_stats_t *stats) {
+  pthread_mutex_lock(&broker->lock);
+  *stats = broker->stats;
+  pthread_mutex_unlock(&broker->lock);
+}
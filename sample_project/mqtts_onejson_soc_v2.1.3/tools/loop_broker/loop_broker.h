@@ -0,0 +1,186 @@
+/**
+ * Copyright (c), 2012~2024 iot.10086.cn All Rights Reserved
+ *
+ * @file loop_broker.h
+ * @brief Loopback MQTT 3.1.1 and 5.0 broker standing in for the OneNET platform
+ *
+ * Runs in a thread of the host process and listens on localhost. Messages
+ * posted on $sys/{pid}/{dev}/... topics get the OneJSON reply the platform
+ * would send, downlink requests can be injected, and delay, loss and
+ * disconnects can be added to exercise the client's recovery paths. Build the
+ * SDK with IOT_MQTT_SERVER_ADDR="127.0.0.1" and IOT_MQTT_SERVER_PORT set to
+ * the broker's port to run it offline.
+ *
+ * MQTT 5.0 clients get the Topic Alias Maximum and Receive Maximum of the
+ * config in their CONNACK, and their topic aliases are resolved the way a
+ * server does. The reason codes of CONNACK and PUBACK can be set to check how
+ * the client reports refusals.
+ */
+
+#ifndef __LOOP_BROKER_H__
+#define __LOOP_BROKER_H__
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+/* External Definition ( Constant and Macro )                                */
+/*****************************************************************************/
+/* Topic aliases kept per MQTT 5.0 connection */
+#ifndef LOOP_BROKER_TOPIC_ALIAS_MAX
+#define LOOP_BROKER_TOPIC_ALIAS_MAX 16
+#endif
+
+/*****************************************************************************/
+/* External Structures, Enum and Typedefs                                    */
+/*****************************************************************************/
+struct loop_broker;
+
+/**
+ * @brief Called from the broker thread for every PUBLISH a client sends
+ *
+ * Dropped messages (see loss_percent) are not reported.
+ */
+typedef void (*loop_broker_publish_cb)(void *arg, const char *topic,
+                                       const uint8_t *payload,
+                                       uint32_t payload_len);
+
+struct loop_broker_config_t {
+  /** Port to listen on, 0 - any free port, see loop_broker_port() */
+  uint16_t port;
+  /** Delay before a reply or injected message is delivered */
+  uint32_t delay_ms;
+  /** Percentage of client PUBLISH packets dropped without ack or reply */
+  uint32_t loss_percent;
+  /** Close a connection after this many PUBLISH packets from it, 0 - never */
+  uint32_t disconnect_after;
+  /** Seed of the loss generator, the same seed drops the same messages */
+  uint32_t seed;
+  /** Non-zero to answer $sys/... posts and requests with code 200 */
+  uint8_t auto_reply;
+  /** Non-zero to print every packet to stderr */
+  uint8_t verbose;
+  /** MQTT 5.0: Topic Alias Maximum announced in the CONNACK, 0 - no aliases,
+   * at most LOOP_BROKER_TOPIC_ALIAS_MAX */
+  uint16_t topic_alias_max;
+  /** MQTT 5.0: Receive Maximum announced in the CONNACK, 0 - not announced */
+  uint16_t receive_max;
+  /** MQTT 5.0: reason code of the CONNACK, 0x80 and above refuses the
+   * connection */
+  uint8_t connack_reason;
+  /** MQTT 5.0: reason code of every PUBACK */
+  uint8_t puback_reason;
+  loop_broker_publish_cb on_publish;
+  void *arg;
+};
+
+struct loop_broker_stats_t {
+  uint32_t connects;
+  uint32_t disconnects;
+  /** PUBLISH packets received from clients, including dropped ones */
+  uint32_t publish_in;
+  /** PUBLISH packets delivered to clients */
+  uint32_t publish_out;
+  /** Replies generated for $sys/... posts */
+  uint32_t replies;
+  /** PUBLISH packets dropped by loss_percent */
+  uint32_t dropped;
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+  /** Connections accepted with MQTT 5.0, counted in connects as well */
+  uint32_t connects_v5;
+  /** PUBLISH packets that carried a topic alias in place of the topic */
+  uint32_t alias_hits;
+};
+
+/*****************************************************************************/
+/* External Variables and Functions                                          */
+/*****************************************************************************/
+/**
+ * @brief Start a broker thread listening on 127.0.0.1
+ *
+ * @param config Broker settings, copied
+ * @return Broker, NULL - Failed
+ */
+struct loop_broker *loop_broker_start(const struct loop_broker_config_t *config);
+
+/**
+ * @brief Close all connections, stop the thread and free the broker
+ */
+void loop_broker_stop(struct loop_broker *broker);
+
+/**
+ * @brief Port the broker is listening on
+ */
+uint16_t loop_broker_port(struct loop_broker *broker);
+
+/**
+ * @brief Change delay, loss and disconnects while the broker is running
+ */
+void loop_broker_set_faults(struct loop_broker *broker, uint32_t delay_ms,
+                            uint32_t loss_percent, uint32_t disconnect_after);
+
+/**
+ * @brief Change the MQTT 5.0 reason codes while the broker is running
+ *
+ * Applies to CONNACKs and PUBACKs sent from now on, 3.1.1 clients are not
+ * affected.
+ */
+void loop_broker_set_reason_codes(struct loop_broker *broker,
+                                  uint8_t connack_reason,
+                                  uint8_t puback_reason);
+
+/**
+ * @brief Deliver a message to every client subscribed to the topic
+ *
+ * @param qos Highest QoS to deliver with, 0 or 1
+ * @retval  0 - Queued
+ * @retval -1 - Failed
+ */
+int32_t loop_broker_publish(struct loop_broker *broker, const char *topic,
+                            const uint8_t *payload, uint32_t payload_len,
+                            uint8_t qos);
+
+/**
+ * @brief Send a property/set request to a device
+ *
+ * @param params OneJSON params object, e.g. {"power":true}
+ * @return Message id used in the request, -1 - Failed
+ */
+int32_t loop_broker_property_set(struct loop_broker *broker,
+                                 const char *product_id, const char *dev_name,
+                                 const char *params);
+
+/**
+ * @brief Send a service/{identifier}/invoke request to a device
+ *
+ * @param params OneJSON params object passed to the service
+ * @return Message id used in the request, -1 - Failed
+ */
+int32_t loop_broker_service_invoke(struct loop_broker *broker,
+                                   const char *product_id,
+                                   const char *dev_name,
+                                   const char *identifier, const char *params);
+
+/**
+ * @brief Close every client connection now, as a broker restart would
+ */
+void loop_broker_drop_clients(struct loop_broker *broker);
+
+/**
+ * @brief Copy the counters collected since the broker started
+ */
+void loop_broker_get_stats(struct loop_broker *broker,
+                           struct loop_broker_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,100 @@
+/**
+ * Copyright (c), 2012~2024 iot.10086.cn All Rights Reserved
+ *
+ * @file main.c
+ * @brief Run the loopback broker as a standalone process
+ *
+ * loop_broker [-p port] [-d delay_ms] [-l loss_percent] [-k disconnect_after]
+ *             [-s seed] [-P product_id -D dev_name -S params -i interval_ms]
+ *             [-a topic_alias_max] [-v]
+ *
+ * With -P and -D a property/set carrying the -S params is sent to the device
+ * every -i milliseconds. -a lets MQTT 5.0 clients use topic aliases.
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "loop_broker.h"
+
+/*****************************************************************************/
+/* Local Variables                                                           */
+/*****************************************************************************/
+static volatile sig_atomic_t exit_flag = 0;
+
+/*****************************************************************************/
+/* Function Implementation                                                   */
+/*****************************************************************************/
+static void on_signal(int sig) {
+  exit_flag = 1;
+}
+
+int main(int argc, char *argv[]) {
+  struct loop_broker_config_t config = {
+      .port = 1883, .seed = 1, .auto_reply = 1};
+  struct loop_broker_stats_t stats;
+  struct loop_broker *broker = NULL;
+  const char *product_id = NULL, *dev_name = NULL, *params = "{}";
+  uint32_t interval_ms = 1000, elapsed_ms = 0;
+  int opt = 0;
+
+  while ((opt = getopt(argc, argv, "p:d:l:k:s:P:D:S:i:a:v")) != -1) {
+    switch (opt) {
+      case 'p': config.port = atoi(optarg); break;
+      case 'd': config.delay_ms = atoi(optarg); break;
+      case 'l': config.loss_percent = atoi(optarg); break;
+      case 'k': config.disconnect_after = atoi(optarg); break;
+      case 's': config.seed = atoi(optarg); break;
+      case 'P': product_id = optarg; break;
+      case 'D': dev_name = optarg; break;
+      case 'S': params = optarg; break;
+      case 'i': interval_ms = atoi(optarg); break;
+      case 'a': config.topic_alias_max = atoi(optarg); break;
+      case 'v': config.verbose = 1; break;
+      default:
+        fprintf(stderr,
+                "usage: %s [-p port] [-d delay_ms] [-l loss_percent] "
+                "[-k disconnect_after] [-s seed] [-P product_id -D dev_name "
+                "-S params -i interval_ms] [-a topic_alias_max] [-v]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  if (NULL == (broker = loop_broker_start(&config))) {
+    return 1;
+  }
+  printf("loop_broker listening on 127.0.0.1:%u\n",
+         (unsigned)loop_broker_port(broker));
+  fflush(stdout);
+
+  while (!exit_flag) {
+    usleep(100 * 1000);
+    elapsed_ms += 100;
+    if (product_id && dev_name && interval_ms && elapsed_ms >= interval_ms) {
+      elapsed_ms = 0;
+      loop_broker_property_set(broker, product_id, dev_name, params);
+    }
+  }
+
+  loop_broker_get_stats(broker, &stats);
+  loop_broker_stop(broker);
+
+  printf("connects %u disconnects %u publish_in %u publish_out %u replies %u "
+         "dropped %u bytes_in %llu bytes_out %llu connects_v5 %u alias_hits %u\n",
+         (unsigned)stats.connects, (unsigned)stats.disconnects,
+         (unsigned)stats.publish_in, (unsigned)stats.publish_out,
+         (unsigned)stats.replies, (unsigned)stats.dropped,
+         (unsigned long long)stats.bytes_in,
+         (unsigned long long)stats.bytes_out, (unsigned)stats.connects_v5,
+         (unsigned)stats.alias_hits);
+  return 0;
+}
@@ -0,0 +1,375 @@
+/**
+ * Copyright (c), 2012~2024 iot.10086.cn All Rights Reserved
+ *
+ * @file mqtt5_check.c
+ * @brief MQTT 5.0 checks of the client against the loopback broker
+ *
+ * Built with MQTTV5. Covers the reason code to error mapping, topic alias
+ * reuse, CONNACK and PUBACK refusals, Receive Maximum and a 3.1.1 login on the
+ * same build. Prints one line per check and exits non-zero when one fails.
+ *
+ * mqtt5_check [-v]
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "err_def.h"
+#include "loop_broker.h"
+#include "mqtt_api.h"
+#include "mqtt_client.h"
+#include "plat_tcp.h"
+
+/*****************************************************************************/
+/* Local Definitions ( Constant and Macro )                                  */
+/*****************************************************************************/
+#if !defined(MQTTV5)
+#error "mqtt5_check needs the SDK built with MQTTV5"
+#endif
+
+#define CHECK_TIMEOUT_MS 2000
+#define CHECK_BUF_LEN 1024
+#define CHECK_MAX_TOPICS 16
+
+#define CHECK(cond, ...)               \
+  do {                                 \
+    if (!(cond)) {                     \
+      printf("  failed: " __VA_ARGS__); \
+      printf("\n");                    \
+      return -1;                       \
+    }                                  \
+  } while (0)
+
+/*****************************************************************************/
+/* Local Variables                                                           */
+/*****************************************************************************/
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static char g_topics[CHECK_MAX_TOPICS][64];
+static uint32_t g_topic_cnt = 0;
+
+static uint8_t g_send_buf[CHECK_BUF_LEN];
+static uint8_t g_recv_buf[CHECK_BUF_LEN];
+
+/*****************************************************************************/
+/* Function Implementation                                                   */
+/*****************************************************************************/
+/* Topics as the broker resolved them, called from the broker thread */
+static void on_publish(void *arg, const char *topic, const uint8_t *payload,
+                       uint32_t payload_len) {
+  pthread_mutex_lock(&g_lock);
+  if (g_topic_cnt < CHECK_MAX_TOPICS) {
+    snprintf(g_topics[g_topic_cnt++], sizeof(g_topics[0]), "%s", topic);
+  }
+  pthread_mutex_unlock(&g_lock);
+}
+
+static void topics_reset(void) {
+  pthread_mutex_lock(&g_lock);
+  g_topic_cnt = 0;
+  pthread_mutex_unlock(&g_lock);
+}
+
+static uint32_t topics_count(void) {
+  uint32_t cnt = 0;
+
+  pthread_mutex_lock(&g_lock);
+  cnt = g_topic_cnt;
+  pthread_mutex_unlock(&g_lock);
+  return cnt;
+}
+
+static struct loop_broker *broker_start(uint16_t topic_alias_max,
+                                        uint16_t receive_max, int verbose) {
+  struct loop_broker_config_t config = {.port = 0,
+                                        .seed = 1,
+                                        .verbose = verbose,
+                                        .topic_alias_max = topic_alias_max,
+                                        .receive_max = receive_max,
+                                        .on_publish = on_publish};
+
+  topics_reset();
+  return loop_broker_start(&config);
+}
+
+static void *client_connect(struct loop_broker *broker, int v5) {
+  struct mqtt_param_t param = {0};
+
+  param.client_id = (const uint8_t *)"mqtt5_check";
+  param.connect_flag = MQTT_CONNECT_FLAG_CLEAN_SESSION |
+                       (v5 ? MQTT_CONNECT_FLAG_PROTOCOL_V5 : 0);
+  param.send_buf = g_send_buf;
+  param.send_buf_len = sizeof(g_send_buf);
+  param.recv_buf = g_recv_buf;
+  param.recv_buf_len = sizeof(g_recv_buf);
+
+  return mqtt_connect((const uint8_t *)"127.0.0.1", loop_broker_port(broker),
+                      NULL, 0, &param, CHECK_TIMEOUT_MS);
+}
+
+static int32_t publish(void *client, const char *topic, enum mqtt_qos_e qos) {
+  struct mqtt_message_t msg = {.qos = qos,
+                               .payload = (uint8_t *)"{}",
+                               .payload_len = 2};
+
+  return mqtt_publish(client, (const uint8_t *)topic, &msg, CHECK_TIMEOUT_MS);
+}
+
+/* Publish the topics in order with QoS1 and compare what the broker saw */
+static int publish_topics(void *client, struct loop_broker *broker,
+                          const char *const *topics, uint32_t cnt,
+                          uint32_t alias_hits) {
+  struct loop_broker_stats_t stats;
+  int32_t ret = 0;
+
+  for (uint32_t i = 0; i < cnt; i++) {
+    CHECK(0 == (ret = publish(client, topics[i], MQTT_QOS1)),
+          "publish %s returned %d", topics[i], (int)ret);
+  }
+
+  /* the broker acknowledges before it reports the message */
+  for (int i = 0; i < CHECK_TIMEOUT_MS / 10 && topics_count() < cnt; i++) {
+    usleep(10 * 1000);
+  }
+
+  pthread_mutex_lock(&g_lock);
+  for (uint32_t i = 0; i < cnt; i++) {
+    int same = i < g_topic_cnt && 0 == strcmp(g_topics[i], topics[i]);
+
+    pthread_mutex_unlock(&g_lock);
+    CHECK(same, "message %u arrived on the wrong topic", (unsigned)i);
+    pthread_mutex_lock(&g_lock);
+  }
+  pthread_mutex_unlock(&g_lock);
+
+  loop_broker_get_stats(broker, &stats);
+  CHECK(stats.alias_hits == alias_hits, "%u alias hits, expected %u",
+        (unsigned)stats.alias_hits, (unsigned)alias_hits);
+  return 0;
+}
+
+static int check_reason_codes(int verbose) {
+  static const struct {
+    uint8_t reason;
+    int32_t err;
+  } table[] = {
+      {0x00, ERR_OK},           {0x10, ERR_OK},
+      {0x80, ERR_CLOUD},        {0x87, ERR_REQUEST_FAILED},
+      {0x89, ERR_RESOURCE_BUSY}, {0x8E, ERR_REPETITIVE},
+      {0x94, ERR_INVALID_DATA},  {0x97, ERR_OVERFLOW},
+  };
+
+  for (uint32_t i = 0; i < sizeof(table) / sizeof(table[0]); i++) {
+    int32_t err = mqtt_client_reason_to_err(table[i].reason);
+
+    CHECK(err == table[i].err, "reason 0x%02x maps to %d, expected %d",
+          table[i].reason, (int)err, (int)table[i].err);
+  }
+  return 0;
+}
+
+static int check_alias_reuse(int verbose) {
+  static const char *const topics[] = {"check/a", "check/a", "check/b",
+                                       "check/a", "check/b"};
+  struct loop_broker *broker = NULL;
+  void *client = NULL;
+  int ret = -1;
+
+  if (NULL == (broker = broker_start(4, 0, verbose))) {
+    return -1;
+  }
+  if (NULL != (client = client_connect(broker, 1))) {
+    /* a, b bind their aliases, the three repeats go out as the alias */
+    ret = publish_topics(client, broker, topics, 5, 3);
+    mqtt_disconnect(client, CHECK_TIMEOUT_MS);
+  } else {
+    printf("  failed: MQTT 5.0 login\n");
+  }
+  loop_broker_stop(broker);
+  return ret;
+}
+
+static int check_alias_used_up(int verbose) {
+  static const char *const topics[] = {"check/a", "check/b", "check/b",
+                                       "check/a", "check/b"};
+  struct loop_broker *broker = NULL;
+  void *client = NULL;
+  int ret = -1;
+
+  if (NULL == (broker = broker_start(1, 0, verbose))) {
+    return -1;
+  }
+  if (NULL != (client = client_connect(broker, 1))) {
+    /* a takes the only alias, b keeps going out with the full topic */
+    ret = publish_topics(client, broker, topics, 5, 1);
+    mqtt_disconnect(client, CHECK_TIMEOUT_MS);
+  } else {
+    printf("  failed: MQTT 5.0 login\n");
+  }
+  loop_broker_stop(broker);
+  return ret;
+}
+
+static int connack_refused(struct loop_broker *broker) {
+  MQTTPacket_connectData options = MQTTPacket_connectData_initializer;
+  mqtt_network net = {0};
+  void *client = NULL;
+  int32_t ret = 0;
+
+  net.handle = plat_tcp_connect((const uint8_t *)"127.0.0.1",
+                                loop_broker_port(broker), CHECK_TIMEOUT_MS);
+  net.mqttread = plat_tcp_recv;
+  net.mqttwrite = plat_tcp_send;
+  net.disconnect = plat_tcp_disconnect;
+  CHECK(-1 != net.handle, "tcp connect");
+
+  if (NULL == (client = mqtt_client_init(&net, g_send_buf, sizeof(g_send_buf),
+                                         g_recv_buf, sizeof(g_recv_buf)))) {
+    plat_tcp_disconnect(net.handle);
+    CHECK(0, "client init");
+  }
+  options.MQTTVersion = 5;
+  options.clientID.cstring = "mqtt5_check";
+  ret = mqtt_client_connect(client, &options, CHECK_TIMEOUT_MS);
+  mqtt_client_deinit(client);
+  plat_tcp_disconnect(net.handle);
+
+  CHECK(ERR_REQUEST_FAILED == ret, "CONNACK 0x87 returned %d, expected %d",
+        (int)ret, ERR_REQUEST_FAILED);
+  return 0;
+}
+
+static int puback_refused(struct loop_broker *broker) {
+  void *client = NULL;
+  int32_t ret = 0;
+
+  CHECK(NULL != (client = client_connect(broker, 1)), "MQTT 5.0 login");
+  ret = publish(client, "check/a", MQTT_QOS1);
+  mqtt_disconnect(client, CHECK_TIMEOUT_MS);
+
+  CHECK(ERR_OVERFLOW == ret, "PUBACK 0x97 returned %d, expected %d", (int)ret,
+        ERR_OVERFLOW);
+  return 0;
+}
+
+static int check_refusals(int verbose) {
+  struct loop_broker *broker = NULL;
+  int ret = -1;
+
+  if (NULL == (broker = broker_start(0, 0, verbose))) {
+    return -1;
+  }
+  loop_broker_set_reason_codes(broker, 0x87, 0);
+  if (0 == connack_refused(broker)) {
+    loop_broker_set_reason_codes(broker, 0, 0x97);
+    ret = puback_refused(broker);
+  }
+  loop_broker_stop(broker);
+  return ret;
+}
+
+static int receive_max_window(struct loop_broker *broker) {
+  struct mqtt_message_t msg = {.qos = MQTT_QOS1,
+                               .payload = (uint8_t *)"{}",
+                               .payload_len = 2};
+  void *client = NULL;
+  int32_t ret[3] = {0};
+  uint32_t inflight = 0;
+
+  CHECK(NULL != (client = client_connect(broker, 1)), "MQTT 5.0 login");
+  mqtt_client_set_inflight_window(client, 8, 60 * 1000);
+
+  /* nothing is acknowledged, the third one finds the window full */
+  for (int i = 0; i < 3; i++) {
+    ret[i] = mqtt_publish_async(client, (const uint8_t *)"check/a", &msg, NULL,
+                                NULL, 200);
+  }
+  inflight = mqtt_client_inflight_count(client);
+  mqtt_disconnect(client, CHECK_TIMEOUT_MS);
+
+  CHECK(0 == ret[0] && 0 == ret[1], "first publishes returned %d, %d",
+        (int)ret[0], (int)ret[1]);
+  CHECK(0 != ret[2] && 2 == inflight,
+        "third publish returned %d with %u in flight", (int)ret[2],
+        (unsigned)inflight);
+  return 0;
+}
+
+static int check_receive_max(int verbose) {
+  struct loop_broker *broker = NULL;
+  int ret = -1;
+
+  if (NULL == (broker = broker_start(0, 2, verbose))) {
+    return -1;
+  }
+  loop_broker_set_faults(broker, 0, 100, 0);
+  ret = receive_max_window(broker);
+  loop_broker_stop(broker);
+  return ret;
+}
+
+static int check_v311(int verbose) {
+  static const char *const topics[] = {"check/a", "check/a", "check/a"};
+  struct loop_broker_stats_t stats;
+  struct loop_broker *broker = NULL;
+  void *client = NULL;
+  int ret = -1;
+
+  if (NULL == (broker = broker_start(4, 0, verbose))) {
+    return -1;
+  }
+  if (NULL != (client = client_connect(broker, 0))) {
+    /* without MQTT_CONNECT_FLAG_PROTOCOL_V5 the build still speaks 3.1.1 */
+    ret = publish_topics(client, broker, topics, 3, 0);
+    mqtt_disconnect(client, CHECK_TIMEOUT_MS);
+    loop_broker_get_stats(broker, &stats);
+    if (0 == ret && stats.connects_v5 != 0) {
+      printf("  failed: logged in with MQTT 5.0\n");
+      ret = -1;
+    }
+  } else {
+    printf("  failed: MQTT 3.1.1 login\n");
+  }
+  loop_broker_stop(broker);
+  return ret;
+}
+
+int main(int argc, char *argv[]) {
+  static const struct {
+    const char *name;
+    int (*fn)(int verbose);
+  } checks[] = {
+      {"reason codes", check_reason_codes},
+      {"topic alias reuse", check_alias_reuse},
+      {"topic aliases used up", check_alias_used_up},
+      {"CONNACK and PUBACK refusals", check_refusals},
+      {"receive maximum", check_receive_max},
+      {"MQTT 3.1.1 login", check_v311},
+  };
+  uint32_t failed = 0;
+  int verbose = 0, opt = 0;
+
+  while ((opt = getopt(argc, argv, "v")) != -1) {
+    switch (opt) {
+      case 'v':
+        verbose = 1;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  for (uint32_t i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+    int ret = checks[i].fn(verbose);
+
+    printf("%-30s %s\n", checks[i].name, ret ? "FAIL" : "ok");
+    failed += ret ? 1 : 0;
+  }
+  return failed ? 1 : 0;
+}
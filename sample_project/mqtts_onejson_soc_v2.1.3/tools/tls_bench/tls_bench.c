@@ -0,0 +1,350 @@
+/**
+ * Copyright (c), 2012~2024 iot.10086.cn All Rights Reserved
+ *
+ * @file tls_bench.c
+ * @brief Handshake benchmark of tls_connect()
+ *
+ * Connects to a TLS server over and over and prints the handshake figures as
+ * JSON, split into full and resumed handshakes. Needs a build with
+ * CONFIG_NETWORK_TLS=1 and a server to talk to, for instance
+ *
+ *   openssl s_server -accept 18443 -cert cert.pem -key key.pem -tls1_2
+ *
+ * tls_bench [-h host] [-p port] [-n connects] [-c ca_cert] [-w wrong_ca]
+ *           [-i psk_identity -k psk_key_hex] [-o file]
+ *
+ * With -w one handshake is first made with a CA that did not sign the server
+ * certificate, it has to fail. The run fails when it does not.
+ *
+ * With -i and -k the handshakes use TLS-PSK, against for instance
+ *
+ *   openssl s_server -accept 18443 -nocert -psk 00112233 -psk_identity dev1
+ *
+ * Wall time includes the server's share of the handshake. CPU time is the
+ * client thread alone and is the figure that carries over to the device.
+ * Heap figures count the malloc/calloc/realloc calls made during
+ * tls_connect(), the link wraps them (-Wl,--wrap).
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tls.h"
+
+/*****************************************************************************/
+/* Local Definitions ( Constant and Macro )                                  */
+/*****************************************************************************/
+#define BENCH_TIMEOUT_MS 5000
+#define BENCH_CA_MAX 8192
+#define BENCH_PSK_KEY_MAX 64
+
+/*****************************************************************************/
+/* Structures, Enum and Typedefs                                             */
+/*****************************************************************************/
+struct bench_heap {
+  uint64_t allocs;
+  int64_t cur_bytes;
+  int64_t peak_bytes;
+};
+
+struct bench_result {
+  uint32_t cnt;
+  uint32_t *lat_us;
+  uint64_t cpu_us;
+  uint64_t allocs;
+  uint64_t peak_bytes; /* highest peak of all handshakes */
+};
+
+/*****************************************************************************/
+/* Local Variables                                                           */
+/*****************************************************************************/
+static int g_counting = 0;
+static struct bench_heap g_heap;
+
+/*****************************************************************************/
+/* Heap accounting                                                           */
+/*****************************************************************************/
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static void heap_add(void *ptr, int64_t sign) {
+  if (ptr && g_counting) {
+    g_heap.cur_bytes += sign * (int64_t)malloc_usable_size(ptr);
+    if (sign > 0) {
+      g_heap.allocs++;
+      if (g_heap.cur_bytes > g_heap.peak_bytes) {
+        g_heap.peak_bytes = g_heap.cur_bytes;
+      }
+    }
+  }
+}
+
+void *__wrap_malloc(size_t size) {
+  void *ptr = __real_malloc(size);
+
+  heap_add(ptr, 1);
+  return ptr;
+}
+
+void *__wrap_calloc(size_t num, size_t size) {
+  void *ptr = __real_calloc(num, size);
+
+  heap_add(ptr, 1);
+  return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  void *new_ptr = NULL;
+
+  heap_add(ptr, -1);
+  if (NULL == (new_ptr = __real_realloc(ptr, size)) && size) {
+    heap_add(ptr, 1);
+    return NULL;
+  }
+  heap_add(new_ptr, 1);
+  return new_ptr;
+}
+
+void __wrap_free(void *ptr) {
+  heap_add(ptr, -1);
+  __real_free(ptr);
+}
+
+/*****************************************************************************/
+/* Function Implementation                                                   */
+/*****************************************************************************/
+static uint64_t now_us(clockid_t clock) {
+  struct timespec ts;
+
+  clock_gettime(clock, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+static void print_result(FILE *out, const struct bench_result *r) {
+  uint32_t n = r->cnt;
+
+  qsort(r->lat_us, n, sizeof(uint32_t), cmp_u32);
+  fprintf(out, "\"handshakes\": %u", (unsigned)n);
+  if (0 == n) {
+    return;
+  }
+  fprintf(out,
+          ", \"p50_us\": %u, \"max_us\": %u, \"cpu_us_per_handshake\": %.1f, "
+          "\"allocs_per_handshake\": %.1f, \"peak_heap_bytes\": %llu",
+          (unsigned)r->lat_us[n / 2], (unsigned)r->lat_us[n - 1],
+          (double)r->cpu_us / n, (double)r->allocs / n,
+          (unsigned long long)r->peak_bytes);
+}
+
+static uint32_t load_file(const char *path, uint8_t *buf, uint32_t len) {
+  FILE *fp = fopen(path, "rb");
+  size_t ret = 0;
+
+  if (NULL == fp) {
+    perror(path);
+    return 0;
+  }
+  ret = fread(buf, 1, len, fp);
+  fclose(fp);
+  return (uint32_t)ret;
+}
+
+/* Hex string to bytes, 0 - not valid hex */
+static uint32_t hex_decode(const char *hex, uint8_t *buf, uint32_t len) {
+  uint32_t n = 0;
+  unsigned int byte = 0;
+
+  if (0 == strlen(hex) || strlen(hex) % 2 || strlen(hex) / 2 > len) {
+    return 0;
+  }
+  for (n = 0; hex[n * 2]; n++) {
+    if (1 != sscanf(hex + n * 2, "%2x", &byte)) {
+      return 0;
+    }
+    buf[n] = (uint8_t)byte;
+  }
+  return n;
+}
+
+/* Handshake with a CA that did not sign the server certificate, 1 - it was
+ * rejected as it should */
+static int wrong_ca_rejected(const char *host, uint32_t port,
+                             const uint8_t *ca_cert, uint32_t ca_cert_len) {
+  handle_t handle = -1;
+
+  if (0 != tls_init(ca_cert, ca_cert_len)) {
+    fprintf(stderr, "tls_init failed with the wrong CA\n");
+    return 0;
+  }
+  handle = tls_connect((const uint8_t *)host, port, NULL, 0, BENCH_TIMEOUT_MS);
+  if (-1 != handle) {
+    tls_disconnect(handle);
+  }
+  /* the benchmark builds its own context with the right CA */
+  tls_deinit();
+
+  return -1 == handle;
+}
+
+int main(int argc, char *argv[]) {
+  static uint8_t ca_cert[BENCH_CA_MAX];
+  static uint8_t wrong_ca[BENCH_CA_MAX];
+  uint8_t psk_key[BENCH_PSK_KEY_MAX];
+  struct tls_psk_t psk = {0};
+  struct bench_result full = {0}, resumed = {0}, *r = NULL;
+  struct tls_stats_t stats;
+  const char *host = "127.0.0.1", *ca_path = NULL, *out_path = NULL;
+  const char *wrong_path = NULL;
+  uint32_t port = 18443, n = 20, ca_cert_len = 0, failed = 0, resumed_cnt = 0;
+  uint32_t wrong_ca_len = 0;
+  int rejected = 0;
+  uint64_t t0 = 0, cpu0 = 0;
+  handle_t handle = -1;
+  FILE *out = stdout;
+  int opt = 0;
+
+  while ((opt = getopt(argc, argv, "h:p:n:c:w:i:k:o:")) != -1) {
+    switch (opt) {
+      case 'h':
+        host = optarg;
+        break;
+      case 'p':
+        port = atoi(optarg);
+        break;
+      case 'n':
+        n = atoi(optarg);
+        break;
+      case 'c':
+        ca_path = optarg;
+        break;
+      case 'w':
+        wrong_path = optarg;
+        break;
+      case 'i':
+        psk.identity = (const uint8_t *)optarg;
+        break;
+      case 'k':
+        psk.key = psk_key;
+        psk.key_len = hex_decode(optarg, psk_key, sizeof(psk_key));
+        break;
+      case 'o':
+        out_path = optarg;
+        break;
+      default:
+        fprintf(stderr,
+                "usage: %s [-h host] [-p port] [-n connects] [-c ca_cert] "
+                "[-w wrong_ca] [-i psk_identity -k psk_key_hex] [-o file]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if (0 == n) {
+    n = 1;
+  }
+  if (ca_path && 0 == (ca_cert_len = load_file(ca_path, ca_cert,
+                                               sizeof(ca_cert)))) {
+    return 1;
+  }
+  if (wrong_path && (psk.identity || psk.key)) {
+    fprintf(stderr, "-w checks certificates, it does not go with -i and -k\n");
+    return 1;
+  }
+  if (wrong_path && 0 == (wrong_ca_len = load_file(wrong_path, wrong_ca,
+                                                   sizeof(wrong_ca)))) {
+    return 1;
+  }
+  if ((psk.identity || psk.key) && 0 != tls_set_psk(&psk)) {
+    fprintf(stderr, "-i and -k take an identity and a hex key\n");
+    return 1;
+  }
+  if (wrong_path) {
+    rejected = wrong_ca_rejected(host, port, wrong_ca, wrong_ca_len);
+  }
+  if (0 != tls_init(ca_cert_len ? ca_cert : NULL, ca_cert_len)) {
+    fprintf(stderr, "tls_init failed\n");
+    return 1;
+  }
+
+  full.lat_us = calloc(n, sizeof(uint32_t));
+  resumed.lat_us = calloc(n, sizeof(uint32_t));
+
+  for (uint32_t i = 0; i < n; i++) {
+    g_heap.allocs = 0;
+    g_heap.cur_bytes = 0;
+    g_heap.peak_bytes = 0;
+    g_counting = 1;
+    t0 = now_us(CLOCK_MONOTONIC);
+    cpu0 = now_us(CLOCK_THREAD_CPUTIME_ID);
+
+    handle = tls_connect((const uint8_t *)host, port, NULL, 0,
+                         BENCH_TIMEOUT_MS);
+
+    cpu0 = now_us(CLOCK_THREAD_CPUTIME_ID) - cpu0;
+    t0 = now_us(CLOCK_MONOTONIC) - t0;
+    g_counting = 0;
+
+    if (-1 == handle) {
+      failed++;
+      continue;
+    }
+
+    /* the counters tell whether the saved session was taken */
+    tls_get_stats(&stats);
+    r = (stats.resumed != resumed_cnt) ? &resumed : &full;
+    resumed_cnt = stats.resumed;
+
+    r->lat_us[r->cnt++] = (uint32_t)t0;
+    r->cpu_us += cpu0;
+    r->allocs += g_heap.allocs;
+    if ((uint64_t)g_heap.peak_bytes > r->peak_bytes) {
+      r->peak_bytes = g_heap.peak_bytes;
+    }
+
+    tls_disconnect(handle);
+  }
+  tls_deinit();
+
+  if (out_path && NULL == (out = fopen(out_path, "w"))) {
+    perror(out_path);
+    return 1;
+  }
+
+  tls_get_stats(&stats);
+  fprintf(out,
+          "{\n  \"server\": \"%s:%u\", \"mode\": \"%s\", \"connects\": %u, "
+          "\"failed\": %u, \"resume_missed\": %u,\n",
+          host, (unsigned)port, psk.key ? "psk" : "certificate", (unsigned)n,
+          (unsigned)failed, (unsigned)stats.resume_missed);
+  if (wrong_path) {
+    fprintf(out, "  \"wrong_ca\": \"%s\",\n",
+            rejected ? "rejected" : "accepted");
+  }
+  fprintf(out, "  \"full\": {");
+  print_result(out, &full);
+  fprintf(out, "},\n  \"resumed\": {");
+  print_result(out, &resumed);
+  fprintf(out, "}\n}\n");
+
+  if (out != stdout) {
+    fclose(out);
+  }
+  free(full.lat_us);
+  free(resumed.lat_us);
+
+  return (failed || (wrong_path && !rejected)) ? 1 : 0;
+}
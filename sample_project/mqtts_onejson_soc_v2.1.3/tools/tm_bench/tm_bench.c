@@ -0,0 +1,375 @@
+/**
+ * Copyright (c), 2012~2024 iot.10086.cn All Rights Reserved
+ *
+ * @file tm_bench.c
+ * @brief Uplink and downlink benchmark of the thing model API
+ *
+ * Runs the SDK against the loopback broker in the same process and prints the
+ * results as JSON, so they can be stored and compared between commits.
+ *
+ * tm_bench [-n messages] [-s size,size,...] [-o file]
+ *
+ * Heap figures count the malloc/calloc/realloc calls made by the benchmark
+ * thread, the link wraps them (-Wl,--wrap). CPU time is the thread CPU time,
+ * the broker runs in its own thread and is not included.
+ */
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "aiot_tm_api.h"
+#include "loop_broker.h"
+#include "tm_data.h"
+
+/*****************************************************************************/
+/* Local Definitions ( Constant and Macro )                                  */
+/*****************************************************************************/
+#define BENCH_PRODUCT_ID "bench"
+#define BENCH_DEV_NAME "dev1"
+#define BENCH_ACCESS_KEY "YmVuY2hiZW5jaGJlbmNoYmVuY2g="
+#define BENCH_TIMEOUT_MS 3000
+#define BENCH_MAX_SIZES 16
+
+/*****************************************************************************/
+/* Structures, Enum and Typedefs                                             */
+/*****************************************************************************/
+struct bench_heap {
+  uint64_t allocs;
+  int64_t cur_bytes;
+  int64_t peak_bytes;
+};
+
+struct bench_result {
+  uint32_t ok;
+  uint32_t cnt;
+  uint32_t *lat_us;
+  uint64_t wall_us;
+  uint64_t cpu_us;
+  uint64_t allocs;
+  uint64_t peak_bytes; /* sum of the per message peaks */
+  uint64_t payload_bytes;
+};
+
+/*****************************************************************************/
+/* Local Variables                                                           */
+/*****************************************************************************/
+static __thread int t_counting = 0;
+static __thread struct bench_heap t_heap;
+
+static volatile uint64_t g_wr_at_us = 0;
+static volatile uint32_t g_post_len = 0;
+
+/*****************************************************************************/
+/* Heap accounting                                                           */
+/*****************************************************************************/
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static void heap_add(void *ptr, int64_t sign) {
+  if (ptr && t_counting) {
+    t_heap.cur_bytes += sign * (int64_t)malloc_usable_size(ptr);
+    if (sign > 0) {
+      t_heap.allocs++;
+      if (t_heap.cur_bytes > t_heap.peak_bytes) {
+        t_heap.peak_bytes = t_heap.cur_bytes;
+      }
+    }
+  }
+}
+
+void *__wrap_malloc(size_t size) {
+  void *ptr = __real_malloc(size);
+
+  heap_add(ptr, 1);
+  return ptr;
+}
+
+void *__wrap_calloc(size_t num, size_t size) {
+  void *ptr = __real_calloc(num, size);
+
+  heap_add(ptr, 1);
+  return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  void *new_ptr = NULL;
+
+  heap_add(ptr, -1);
+  if (NULL == (new_ptr = __real_realloc(ptr, size)) && size) {
+    heap_add(ptr, 1);
+    return NULL;
+  }
+  heap_add(new_ptr, 1);
+  return new_ptr;
+}
+
+void __wrap_free(void *ptr) {
+  heap_add(ptr, -1);
+  __real_free(ptr);
+}
+
+/* Start counting, the peak is measured from the current level */
+static void heap_begin(void) {
+  t_heap.allocs = 0;
+  t_heap.cur_bytes = 0;
+  t_heap.peak_bytes = 0;
+  t_counting = 1;
+}
+
+static void heap_end(struct bench_result *r) {
+  t_counting = 0;
+  r->allocs += t_heap.allocs;
+  r->peak_bytes += t_heap.peak_bytes;
+}
+
+/*****************************************************************************/
+/* Thing model of the benchmark device                                       */
+/*****************************************************************************/
+static uint64_t now_us(clockid_t clock) {
+  struct timespec ts;
+
+  clock_gettime(clock, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int32_t tm_prop_bench_int_rd_cb(void *data) {
+  return tm_data_set_int32(data, "bench_int", 0, 0);
+}
+
+static int32_t tm_prop_bench_int_wr_cb(void *data) {
+  g_wr_at_us = now_us(CLOCK_MONOTONIC);
+  return 0;
+}
+
+static int32_t tm_prop_bench_str_rd_cb(void *data) {
+  return tm_data_set_string(data, "bench_str", "", 0);
+}
+
+static int32_t tm_prop_bench_str_wr_cb(void *data) {
+  return 0;
+}
+
+struct tm_prop_tbl_t tm_prop_list[] = {TM_PROPERTY_RW(bench_int),
+                                       TM_PROPERTY_RW(bench_str)};
+uint16_t tm_prop_list_size = ARRAY_SIZE(tm_prop_list);
+
+struct tm_svc_tbl_t tm_svc_list[] = {0};
+uint16_t tm_svc_list_size = 0;
+
+/*****************************************************************************/
+/* Function Implementation                                                   */
+/*****************************************************************************/
+static void on_publish(void *arg, const char *topic, const uint8_t *payload,
+                       uint32_t payload_len) {
+  size_t len = strlen(topic);
+
+  if (len > 14 && strcmp(topic + len - 14, "/property/post") == 0) {
+    g_post_len = payload_len;
+  }
+}
+
+static int cmp_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+static void print_result(FILE *out, const struct bench_result *r) {
+  uint32_t n = r->ok;
+
+  qsort(r->lat_us, n, sizeof(uint32_t), cmp_u32);
+  fprintf(out, "\"messages\": %u, \"ok\": %u, ", (unsigned)r->cnt,
+          (unsigned)r->ok);
+  if (0 == n) {
+    fprintf(out, "\"msgs_per_s\": 0");
+    return;
+  }
+  fprintf(out,
+          "\"msgs_per_s\": %.1f, \"p50_us\": %u, \"p99_us\": %u, "
+          "\"max_us\": %u, \"cpu_us_per_msg\": %.1f, "
+          "\"allocs_per_msg\": %.1f, \"peak_heap_bytes_per_msg\": %.1f",
+          r->wall_us ? n * 1e6 / r->wall_us : 0.0, (unsigned)r->lat_us[n / 2],
+          (unsigned)r->lat_us[(n * 99 / 100 < n - 1) ? n * 99 / 100 : n - 1],
+          (unsigned)r->lat_us[n - 1], (double)r->cpu_us / n,
+          (double)r->allocs / n, (double)r->peak_bytes / n);
+}
+
+/* Post a property with a string of the given size, n times */
+static void bench_uplink(uint32_t size, uint32_t n, struct bench_result *r) {
+  char *str = malloc(size + 1);
+  uint64_t start = 0, cpu = 0;
+
+  memset(str, 'x', size);
+  str[size] = '\0';
+
+  start = now_us(CLOCK_MONOTONIC);
+  cpu = now_us(CLOCK_THREAD_CPUTIME_ID);
+  for (uint32_t i = 0; i < n; i++) {
+    void *data = tm_data_create();
+    uint64_t t0 = 0;
+
+    tm_data_set_string(data, "bench_str", str, 0);
+
+    heap_begin();
+    t0 = now_us(CLOCK_MONOTONIC);
+    if (0 == tm_post_property(data, BENCH_TIMEOUT_MS)) {
+      r->lat_us[r->ok++] = (uint32_t)(now_us(CLOCK_MONOTONIC) - t0);
+      r->payload_bytes += g_post_len;
+    }
+    heap_end(r);
+  }
+  r->cnt = n;
+  r->wall_us = now_us(CLOCK_MONOTONIC) - start;
+  r->cpu_us = now_us(CLOCK_THREAD_CPUTIME_ID) - cpu;
+
+  free(str);
+}
+
+/* Inject property/set and step until the write callback runs */
+static void bench_downlink(struct loop_broker *broker, uint32_t n,
+                           struct bench_result *r) {
+  char params[32];
+  uint64_t start = now_us(CLOCK_MONOTONIC);
+  uint64_t cpu = now_us(CLOCK_THREAD_CPUTIME_ID);
+
+  for (uint32_t i = 0; i < n; i++) {
+    uint64_t t0 = 0;
+
+    snprintf(params, sizeof(params), "{\"bench_int\":%u}", (unsigned)i);
+    g_wr_at_us = 0;
+
+    heap_begin();
+    t0 = now_us(CLOCK_MONOTONIC);
+    loop_broker_property_set(broker, BENCH_PRODUCT_ID, BENCH_DEV_NAME, params);
+    while (0 == g_wr_at_us &&
+           now_us(CLOCK_MONOTONIC) - t0 < BENCH_TIMEOUT_MS * 1000ULL) {
+      if (0 != tm_step(100)) {
+        break;
+      }
+    }
+    /* the set_reply has gone out by the time the callback returned */
+    if (g_wr_at_us) {
+      r->lat_us[r->ok++] = (uint32_t)(g_wr_at_us - t0);
+    }
+    heap_end(r);
+  }
+  r->cnt = n;
+  r->wall_us = now_us(CLOCK_MONOTONIC) - start;
+  r->cpu_us = now_us(CLOCK_THREAD_CPUTIME_ID) - cpu;
+}
+
+int main(int argc, char *argv[]) {
+  struct loop_broker_config_t config = {.port = IOT_MQTT_SERVER_PORT,
+                                        .seed = 1,
+                                        .auto_reply = 1,
+                                        .on_publish = on_publish};
+  struct bench_result results[BENCH_MAX_SIZES];
+  struct bench_result first = {0}, down = {0};
+  uint32_t sizes[BENCH_MAX_SIZES] = {16, 256, 1024, 3072};
+  uint32_t size_cnt = 4, n = 200, failed = 0;
+  struct loop_broker *broker = NULL;
+  uint64_t login_us = 0, t0 = 0;
+  const char *out_path = NULL;
+  FILE *out = stdout;
+  int opt = 0;
+
+  while ((opt = getopt(argc, argv, "n:s:o:")) != -1) {
+    switch (opt) {
+      case 'n':
+        n = atoi(optarg);
+        break;
+      case 's': {
+        char *tok = strtok(optarg, ",");
+
+        for (size_cnt = 0; tok && size_cnt < BENCH_MAX_SIZES;
+             tok = strtok(NULL, ",")) {
+          sizes[size_cnt++] = atoi(tok);
+        }
+        break;
+      }
+      case 'o':
+        out_path = optarg;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n messages] [-s size,...] [-o file]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if (0 == n) {
+    n = 1;
+  }
+
+  if (NULL == (broker = loop_broker_start(&config))) {
+    return 1;
+  }
+
+  /* login and first publish, the first message also pays for warming up */
+  t0 = now_us(CLOCK_MONOTONIC);
+  if (0 != tm_login(BENCH_PRODUCT_ID, BENCH_DEV_NAME, BENCH_ACCESS_KEY,
+                    1924833600, BENCH_TIMEOUT_MS)) {
+    fprintf(stderr, "login to the loopback broker failed\n");
+    loop_broker_stop(broker);
+    return 1;
+  }
+  login_us = now_us(CLOCK_MONOTONIC) - t0;
+  first.lat_us = calloc(1, sizeof(uint32_t));
+  bench_uplink(16, 1, &first);
+
+  memset(results, 0, sizeof(results));
+  for (uint32_t i = 0; i < size_cnt; i++) {
+    results[i].lat_us = calloc(n, sizeof(uint32_t));
+    bench_uplink(sizes[i], n, &results[i]);
+  }
+  down.lat_us = calloc(n, sizeof(uint32_t));
+  bench_downlink(broker, n, &down);
+
+  tm_logout(BENCH_TIMEOUT_MS);
+  loop_broker_stop(broker);
+
+  if (out_path && NULL == (out = fopen(out_path, "w"))) {
+    perror(out_path);
+    return 1;
+  }
+
+  fprintf(out, "{\n  \"login\": {\"login_us\": %llu, \"first_post_us\": %u, "
+               "\"login_to_first_publish_us\": %llu},\n",
+          (unsigned long long)login_us,
+          (unsigned)(first.ok ? first.lat_us[0] : 0),
+          (unsigned long long)(login_us + (first.ok ? first.lat_us[0] : 0)));
+  fprintf(out, "  \"uplink\": [\n");
+  for (uint32_t i = 0; i < size_cnt; i++) {
+    fprintf(out, "    {\"value_bytes\": %u, \"payload_bytes\": %llu, ",
+            (unsigned)sizes[i],
+            (unsigned long long)(results[i].ok
+                                     ? results[i].payload_bytes / results[i].ok
+                                     : 0));
+    print_result(out, &results[i]);
+    fprintf(out, "}%s\n", (i + 1 < size_cnt) ? "," : "");
+    failed += results[i].cnt - results[i].ok;
+    free(results[i].lat_us);
+  }
+  fprintf(out, "  ],\n  \"downlink_property_set\": {");
+  print_result(out, &down);
+  fprintf(out, "}\n}\n");
+
+  if (out != stdout) {
+    fclose(out);
+  }
+  free(first.lat_us);
+  free(down.lat_us);
+
+  failed += down.cnt - down.ok;
+
+  return failed ? 1 : 0;
+}